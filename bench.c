@@ -0,0 +1,458 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ncurses.h>
+#include <netinet/tcp.h>
+#include "network.h"
+#include "maze.h"
+#include "render.h"
+#include "flood.h"
+#include "path.h"
+#include "fov.h"
+
+// Microbenchmarks for the hot paths: maze generation and scoring, movement,
+// drawing and the GameState wire format.
+//
+//   deja_bench [-b baseline] [filter]
+//
+// Each benchmark is calibrated to run for about BENCH_TARGET_NS, then timed
+// BENCH_REPEATS times; the fastest run is reported, which keeps the numbers
+// steady on a busy machine. Save the output of one commit and pass it with -b
+// on the next to see the change per benchmark.
+
+#define BENCH_TARGET_NS 100000000L
+#define BENCH_REPEATS 7
+#define BENCH_REGRESSION 0.10       // Slowdowns beyond this are flagged against a baseline
+#define MAX_BASELINE 64
+#define BENCH_LINES 50              // Screen size for drawing the large maze
+#define BENCH_COLS 200
+
+// Heap allocations made by the code under test. The allocator is wrapped at
+// link time (--wrap), so this counts calls from the game's own objects but
+// not from inside libc or ncurses.
+static long allocations = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+    allocations++;
+    return __real_realloc(pointer, size);
+}
+
+typedef struct {
+    const char* name;
+    void (*run)(void* arg, long iterations);
+    void* arg;
+} Benchmark;
+
+typedef struct {
+    char name[64];
+    double nsPerOp;
+} BaselineEntry;
+
+static BaselineEntry baseline[MAX_BASELINE];
+static int baselineCount = 0;
+
+static long nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// --- initializeMaze ---
+
+typedef struct {
+    int height, width;
+    Maze maze;
+    Rng rng;
+} GenerateArgs;
+
+static void benchGenerate(void* arg, long iterations) {
+    GenerateArgs* args = arg;
+    for (long i = 0; i < iterations; i++) {
+        initializeMaze(&args->maze, args->height, args->width, &args->rng);
+    }
+}
+
+// --- Flood fill ---
+
+typedef struct {
+    Maze maze;
+} FloodArgs;
+
+// Start to exit, the search scoreMaze() runs on every new maze
+static void benchDistance(void* arg, long iterations) {
+    FloodArgs* args = arg;
+    Maze* maze = &args->maze;
+    for (long i = 0; i < iterations; i++) {
+        mazeDistance(maze, maze->startY, maze->startX, maze->exitY, maze->exitX);
+    }
+}
+
+static void benchDeadEnds(void* arg, long iterations) {
+    FloodArgs* args = arg;
+    for (long i = 0; i < iterations; i++) {
+        mazeDeadEnds(&args->maze);
+    }
+}
+
+// --- Hierarchical pathfinding ---
+
+typedef struct {
+    Maze maze;
+    PathGraph graph;
+    PathPlan plans[2];      // Start to exit and back
+    int y, x;
+    int leg;
+} PathArgs;
+
+// Start to exit over clusters already cached, as a bot plans after the exit moves
+static void benchPlan(void* arg, long iterations) {
+    PathArgs* args = arg;
+    Maze* maze = &args->maze;
+    for (long i = 0; i < iterations; i++) {
+        planPath(&args->graph, &args->plans[0], maze, maze->startY, maze->startX, maze->exitY, maze->exitX);
+    }
+}
+
+// One step along a plan, walking from the start to the exit and back
+static void benchStep(void* arg, long iterations) {
+    PathArgs* args = arg;
+    for (long i = 0; i < iterations; i++) {
+        int direction = pathStep(&args->graph, &args->plans[args->leg], &args->maze, args->y, args->x);
+        if (direction < 0) {
+            args->leg ^= 1;
+            args->plans[args->leg].next = 0;
+            continue;
+        }
+        args->y += (direction == DOWN) - (direction == UP);
+        args->x += (direction == RIGHT) - (direction == LEFT);
+    }
+}
+
+// --- movePlayer ---
+
+#define WALK_STEPS 4096
+
+typedef struct {
+    Maze maze;
+    unsigned char directions[WALK_STEPS];
+} WalkArgs;
+
+// A random walk; about half the steps run into a wall, as in play
+static void benchMove(void* arg, long iterations) {
+    WalkArgs* args = arg;
+    int y = args->maze.startY;
+    int x = args->maze.startX;
+    int movesLeft = 0;
+    for (long i = 0; i < iterations; i++) {
+        movesLeft = 12;
+        movePlayer(&args->maze, &y, &x, args->directions[i & (WALK_STEPS - 1)], &movesLeft);
+    }
+}
+
+// --- Fog of war ---
+
+typedef struct {
+    Maze maze;
+    Fov fov;
+    int y[WALK_STEPS], x[WALK_STEPS];   // A random walk, recast from at every step
+} FovArgs;
+
+static void benchFov(void* arg, long iterations) {
+    FovArgs* args = arg;
+    for (long i = 0; i < iterations; i++) {
+        int step = i & (WALK_STEPS - 1);
+        updateFov(&args->fov, &args->maze, args->y[step], args->x[step]);
+    }
+}
+
+// --- drawMaze ---
+
+typedef struct {
+    Maze maze;
+    bool full;              // Repaint everything each frame instead of only what changed
+    int lines, cols;        // Screen size
+    int renderer;
+    int fd;                 // Where RENDER_ANSI frames go
+    int y[2], x[2];         // Two neighbouring cells the survivor moves between
+} DrawArgs;
+
+static void benchDraw(void* arg, long iterations) {
+    DrawArgs* args = arg;
+    Maze* maze = &args->maze;
+    if (LINES != args->lines || COLS != args->cols) {
+        resizeterm(args->lines, args->cols);
+    }
+    setRenderer(args->renderer, args->fd);
+    for (long i = 0; i < iterations; i++) {
+        if (args->full) {
+            invalidateMazeView();
+        }
+        drawMaze(maze, args->y[i & 1], args->x[i & 1], maze->startY, maze->startX, 6, 7, SURVIVOR_TURN);
+    }
+}
+
+// --- GameState over loopback ---
+
+typedef struct {
+    Maze maze;
+    Maze received;
+    int sender, receiver;
+} WireArgs;
+
+static void benchWire(void* arg, long iterations) {
+    WireArgs* args = arg;
+    GameState state;
+    memset(&state, 0, sizeof(state));
+    for (long i = 0; i < iterations; i++) {
+        state.survivorMovesLeft = (int)i;
+        if (sendGameState(args->sender, &state, &args->maze) < 0 ||
+            receiveGameState(args->receiver, &state, &args->received, NULL) <= 0) {
+            fprintf(stderr, "Loopback transfer failed\n");
+            exit(1);
+        }
+    }
+}
+
+// Connected pair of TCP sockets on 127.0.0.1
+static int loopbackPair(int* sender, int* receiver) {
+    int listenFd = createListener(0);
+    if (listenFd < 0) {
+        return -1;
+    }
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    getsockname(listenFd, (struct sockaddr*)&address, &length);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    *sender = socket(AF_INET, SOCK_STREAM, 0);
+    if (*sender < 0 || connect(*sender, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        perror("Loopback connect failed");
+        close(listenFd);
+        return -1;
+    }
+    *receiver = accept(listenFd, NULL, NULL);
+    close(listenFd);
+    if (*receiver < 0) {
+        perror("Loopback accept failed");
+        return -1;
+    }
+
+    int opt = 1;
+    setsockopt(*sender, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    return 0;
+}
+
+// --- Runner ---
+
+static void loadBaseline(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        perror("Cannot open baseline");
+        exit(1);
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL && baselineCount < MAX_BASELINE) {
+        BaselineEntry* entry = &baseline[baselineCount];
+        if (sscanf(line, "%63s %lf", entry->name, &entry->nsPerOp) == 2 && entry->nsPerOp > 0) {
+            baselineCount++;
+        }
+    }
+    fclose(file);
+}
+
+static const BaselineEntry* findBaseline(const char* name) {
+    for (int i = 0; i < baselineCount; i++) {
+        if (strcmp(baseline[i].name, name) == 0) {
+            return &baseline[i];
+        }
+    }
+    return NULL;
+}
+
+// Calibrate, time and print one benchmark
+static void runBenchmark(const Benchmark* bench) {
+    long iterations = 1;
+    long elapsed;
+    while ((elapsed = nowNs(), bench->run(bench->arg, iterations), elapsed = nowNs() - elapsed) <
+           BENCH_TARGET_NS / 10) {
+        iterations *= 2;
+    }
+    if (elapsed > 0) {
+        iterations = (long)((double)iterations * BENCH_TARGET_NS / elapsed) + 1;
+    }
+
+    double best = 0;
+    long allocationsPerRun = 0;
+    for (int repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+        long allocationsBefore = allocations;
+        long start = nowNs();
+        bench->run(bench->arg, iterations);
+        double nsPerOp = (double)(nowNs() - start) / iterations;
+        allocationsPerRun = allocations - allocationsBefore;
+        if (repeat == 0 || nsPerOp < best) {
+            best = nsPerOp;
+        }
+    }
+
+    printf("%-28s %14.1f %12.2f %12ld", bench->name, best,
+           (double)allocationsPerRun / iterations, iterations);
+    const BaselineEntry* previous = findBaseline(bench->name);
+    if (previous != NULL) {
+        double change = best / previous->nsPerOp - 1.0;
+        printf(" %+8.1f%%%s", 100.0 * change, change > BENCH_REGRESSION ? "  SLOWER" : "");
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    const char* filter = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            loadBaseline(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [-b baseline] [filter]\n", argv[0]);
+            return 1;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    // Generation at the default size, a large size, a huge one and the start
+    // of a streaming one
+    static GenerateArgs generate[4];
+    int generateSizes[4][2] = { { DEFAULT_HEIGHT, DEFAULT_WIDTH }, { 101, 101 }, { 1001, 1001 }, { 1000000, 101 } };
+    for (int i = 0; i < 4; i++) {
+        generate[i].height = generateSizes[i][0];
+        generate[i].width = generateSizes[i][1];
+        rngSeed(&generate[i].rng, 1);
+    }
+
+    Rng rng;
+    rngSeed(&rng, 1);
+
+    static FloodArgs flood;
+    initializeMaze(&flood.maze, 1001, 1001, &rng);
+
+    static PathArgs path;
+    initializeMaze(&path.maze, 1001, 1001, &rng);
+    initPathGraph(&path.graph);
+    initPathPlan(&path.plans[0]);
+    initPathPlan(&path.plans[1]);
+    planPath(&path.graph, &path.plans[0], &path.maze, path.maze.startY, path.maze.startX,
+             path.maze.exitY, path.maze.exitX);
+    planPath(&path.graph, &path.plans[1], &path.maze, path.maze.exitY, path.maze.exitX,
+             path.maze.startY, path.maze.startX);
+    path.y = path.maze.startY;
+    path.x = path.maze.startX;
+
+    static WalkArgs walk;
+    initializeMaze(&walk.maze, 101, 101, &rng);
+    for (int i = 0; i < WALK_STEPS; i++) {
+        walk.directions[i] = rngRange(&rng, 4);
+    }
+
+    // The same walk on a small and a large maze; a cast should cost the same on both
+    static FovArgs fov[2];
+    for (int i = 0; i < 2; i++) {
+        int size = i == 0 ? 101 : 1001;
+        initializeMaze(&fov[i].maze, size, size, &rng);
+        initFov(&fov[i].fov, &fov[i].maze);
+        int y = fov[i].maze.startY;
+        int x = fov[i].maze.startX;
+        for (int step = 0; step < WALK_STEPS; step++) {
+            // Only steps that move are kept, so every iteration casts
+            do {
+                int movesLeft = 1;
+                movePlayer(&fov[i].maze, &y, &x, rngRange(&rng, 4), &movesLeft);
+            } while (step > 0 && y == fov[i].y[step - 1] && x == fov[i].x[step - 1]);
+            fov[i].y[step] = y;
+            fov[i].x[step] = x;
+        }
+    }
+
+    // Drawing goes to a terminal on /dev/null, so only the cost of composing
+    // and encoding frames is measured
+    FILE* devNull = fopen("/dev/null", "r+");
+    if (devNull == NULL || newterm("xterm", devNull, devNull) == NULL) {
+        fprintf(stderr, "Cannot open a headless terminal\n");
+        return 1;
+    }
+    start_color();
+    // The default maze, then a large one whose view fills a big screen,
+    // each through ncurses and then as raw ANSI frames
+    static DrawArgs draw[6];
+    for (int i = 0; i < 6; i++) {
+        int size = (i % 3 == 2) ? 1001 : 0;
+        initializeMaze(&draw[i].maze, size ? size : DEFAULT_HEIGHT, size ? size : DEFAULT_WIDTH, &rng);
+        draw[i].full = (i % 3 != 0);
+        draw[i].lines = size ? BENCH_LINES : LINES;
+        draw[i].cols = size ? BENCH_COLS : COLS;
+        draw[i].renderer = i < 3 ? RENDER_CURSES : RENDER_ANSI;
+        draw[i].fd = fileno(devNull);
+        draw[i].y[0] = draw[i].y[1] = draw[i].maze.startY;
+        draw[i].x[0] = draw[i].maze.startX;
+        int open = mazeOpenNeighbors(&draw[i].maze, draw[i].maze.startY, draw[i].maze.startX);
+        draw[i].y[1] += (open & DIR_BIT(DOWN)) ? 1 : (open & DIR_BIT(UP)) ? -1 : 0;
+        draw[i].x[1] += (open & (DIR_BIT(DOWN) | DIR_BIT(UP))) ? 0 : (open & DIR_BIT(RIGHT)) ? 1 : -1;
+    }
+
+    static WireArgs wire[2];
+    int wireSizes[2][2] = { { DEFAULT_HEIGHT, DEFAULT_WIDTH }, { 501, 501 } };
+    for (int i = 0; i < 2; i++) {
+        initializeMaze(&wire[i].maze, wireSizes[i][0], wireSizes[i][1], &rng);
+        if (loopbackPair(&wire[i].sender, &wire[i].receiver) < 0) {
+            endwin();
+            return 1;
+        }
+    }
+
+    Benchmark benchmarks[] = {
+        { "initializeMaze/10x25", benchGenerate, &generate[0] },
+        { "initializeMaze/101x101", benchGenerate, &generate[1] },
+        { "initializeMaze/1001x1001", benchGenerate, &generate[2] },
+        { "initializeMaze/1000000x101", benchGenerate, &generate[3] },
+        { "mazeDistance/1001x1001", benchDistance, &flood },
+        { "mazeDeadEnds/1001x1001", benchDeadEnds, &flood },
+        { "planPath/1001x1001", benchPlan, &path },
+        { "pathStep/1001x1001", benchStep, &path },
+        { "movePlayer/101x101", benchMove, &walk },
+        { "updateFov/101x101", benchFov, &fov[0] },
+        { "updateFov/1001x1001", benchFov, &fov[1] },
+        { "drawMaze/incremental", benchDraw, &draw[0] },
+        { "drawMaze/full", benchDraw, &draw[1] },
+        { "drawMaze/full/1001x1001", benchDraw, &draw[2] },
+        { "drawMaze/ansi/incremental", benchDraw, &draw[3] },
+        { "drawMaze/ansi/full", benchDraw, &draw[4] },
+        { "drawMaze/ansi/full/1001x1001", benchDraw, &draw[5] },
+        { "gameState/loopback/10x25", benchWire, &wire[0] },
+        { "gameState/loopback/501x501", benchWire, &wire[1] },
+    };
+
+    printf("%-28s %14s %12s %12s%s\n", "benchmark", "ns/op", "allocs/op", "iterations",
+           baselineCount > 0 ? "   change" : "");
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (filter == NULL || strstr(benchmarks[i].name, filter) != NULL) {
+            runBenchmark(&benchmarks[i]);
+        }
+    }
+
+    endwin();
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bot.h"
+
+// Offsets for the UP, DOWN, LEFT and RIGHT directions
+static const int stepY[4] = {-1, 1, 0, 0};
+static const int stepX[4] = {0, 0, -1, 1};
+
+static void freeField(DistanceField* field) {
+    free(field->seen);
+    free(field->distance);
+    free(field->queue);
+    memset(field, 0, sizeof(*field));
+    field->targetY = -1;
+    field->targetX = -1;
+}
+
+// Make sure the field covers the maze; returns -1 if it cannot be allocated
+static int sizeField(DistanceField* field, const Maze* maze) {
+    if (field->seen != NULL && field->height == maze->height && field->width == maze->width) {
+        return 0;
+    }
+    freeField(field);
+
+    size_t cells = (size_t)maze->height * maze->width;
+    field->seen = calloc(cells, sizeof(unsigned int));
+    field->distance = malloc(cells * sizeof(int));
+    field->queue = malloc(cells * sizeof(int));
+    if (field->seen == NULL || field->distance == NULL || field->queue == NULL) {
+        freeField(field);
+        return -1;
+    }
+    field->height = maze->height;
+    field->width = maze->width;
+    return 0;
+}
+
+// Begin a new search from (y, x); the old one is forgotten by bumping the stamp
+static void startField(DistanceField* field, int y, int x) {
+    if (++field->stamp == 0) {
+        memset(field->seen, 0, (size_t)field->height * field->width * sizeof(unsigned int));
+        field->stamp = 1;
+    }
+    int index = y * field->width + x;
+    field->seen[index] = field->stamp;
+    field->distance[index] = 0;
+    field->queue[0] = index;
+    field->head = 0;
+    field->tail = 1;
+    field->targetY = y;
+    field->targetX = x;
+}
+
+// Steps from the target to (y, x), resuming the search until that cell is
+// reached. Returns -1 if it cannot be reached.
+static int fieldDistance(DistanceField* field, const Maze* maze, int y, int x) {
+    int goal = y * field->width + x;
+    while (field->seen[goal] != field->stamp && field->head < field->tail) {
+        int index = field->queue[field->head++];
+        int cellY = index / field->width;
+        int cellX = index % field->width;
+        int open = mazeOpenNeighbors(maze, cellY, cellX);
+        for (int direction = UP; direction <= RIGHT; direction++) {
+            if (!(open & DIR_BIT(direction))) {
+                continue;
+            }
+            int next = index + stepY[direction] * field->width + stepX[direction];
+            if (field->seen[next] != field->stamp) {
+                field->seen[next] = field->stamp;
+                field->distance[next] = field->distance[index] + 1;
+                field->queue[field->tail++] = next;
+            }
+        }
+    }
+    return field->seen[goal] == field->stamp ? field->distance[goal] : -1;
+}
+
+// One step from (y, x) towards the field's target. Every neighbour one step
+// closer was reached before (y, x) was, so it is already in the field.
+static int descendField(DistanceField* field, const Maze* maze, int y, int x) {
+    int distance = fieldDistance(field, maze, y, x);
+    if (distance <= 0) {
+        return ACTION_END_TURN; // Already there, or cut off from it
+    }
+
+    int open = mazeOpenNeighbors(maze, y, x);
+    for (int direction = UP; direction <= RIGHT; direction++) {
+        if (!(open & DIR_BIT(direction))) {
+            continue;
+        }
+        int next = (y + stepY[direction]) * field->width + x + stepX[direction];
+        if (field->seen[next] == field->stamp && field->distance[next] == distance - 1) {
+            return direction;
+        }
+    }
+    return ACTION_END_TURN;
+}
+
+// One step from (y, x) along a plan to the target, made again if there is
+// none for this target yet or (y, x) has strayed from it
+static int followPlan(Bot* bot, PathPlan* plan, const Maze* maze, int y, int x, int targetY, int targetX) {
+    if (y == targetY && x == targetX) {
+        return ACTION_END_TURN;
+    }
+    if (plan->targetY == targetY && plan->targetX == targetX) {
+        int direction = pathStep(&bot->graph, plan, maze, y, x);
+        if (direction >= 0) {
+            return direction;
+        }
+    }
+    if (planPath(&bot->graph, plan, maze, y, x, targetY, targetX) < 0) {
+        return ACTION_END_TURN; // Cut off from it
+    }
+    int direction = pathStep(&bot->graph, plan, maze, y, x);
+    return direction >= 0 ? direction : ACTION_END_TURN;
+}
+
+void initBot(Bot* bot) {
+    memset(bot, 0, sizeof(*bot));
+    initPathGraph(&bot->graph);
+    initPathPlan(&bot->exitPlan);
+    initPathPlan(&bot->chasePlan);
+    resetBot(bot);
+}
+
+// Forget the fields' targets and the cached clusters; call before every new
+// game, since a new maze of the same size reuses the same buffers
+void resetBot(Bot* bot) {
+    bot->exitField.targetY = -1;
+    bot->exitField.targetX = -1;
+    bot->chaseField.targetY = -1;
+    bot->chaseField.targetX = -1;
+    resetPathGraph(&bot->graph);
+    bot->exitPlan.targetY = -1;
+    bot->exitPlan.targetX = -1;
+    bot->chasePlan.targetY = -1;
+    bot->chasePlan.targetX = -1;
+}
+
+// Next action for whoever's turn it is in the game
+int botAction(Bot* bot, Game* game) {
+    Maze* maze = &game->maze;
+
+    if ((long)maze->height * maze->width >= BOT_PATH_MIN_CELLS) {
+        if (game->currentTurn == SURVIVOR_TURN) {
+            return followPlan(bot, &bot->exitPlan, maze, game->survivorY, game->survivorX,
+                              maze->exitY, maze->exitX);
+        }
+        return followPlan(bot, &bot->chasePlan, maze, game->killerY, game->killerX,
+                          game->survivorY, game->survivorX);
+    }
+
+    if (game->currentTurn == SURVIVOR_TURN) {
+        DistanceField* field = &bot->exitField;
+        if (sizeField(field, maze) < 0) {
+            return ACTION_END_TURN;
+        }
+        if (field->targetY != maze->exitY || field->targetX != maze->exitX) {
+            startField(field, maze->exitY, maze->exitX);
+        }
+        return descendField(field, maze, game->survivorY, game->survivorX);
+    }
+
+    DistanceField* field = &bot->chaseField;
+    if (sizeField(field, maze) < 0) {
+        return ACTION_END_TURN;
+    }
+    if (field->targetY != game->survivorY || field->targetX != game->survivorX) {
+        startField(field, game->survivorY, game->survivorX);
+    }
+    return descendField(field, maze, game->killerY, game->killerX);
+}
+
+void freeBot(Bot* bot) {
+    freeField(&bot->exitField);
+    freeField(&bot->chaseField);
+    freePathGraph(&bot->graph);
+    freePathPlan(&bot->exitPlan);
+    freePathPlan(&bot->chasePlan);
+}
@@ -0,0 +1,45 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include "engine.h"
+#include "path.h"
+
+// Breadth-first distances from one target cell. The search stops as soon as
+// the cell asked about is reached and resumes from its saved frontier when a
+// farther cell is asked about later, so a field is built at most once per
+// target. Cells belong to the current search only when their stamp matches,
+// so starting a new search never clears the arrays.
+typedef struct {
+    int height, width;
+    int targetY, targetX;   // -1 when no search has been started
+    unsigned int stamp;     // Current search
+    unsigned int* seen;     // Search that last reached each cell
+    int* distance;          // Steps from the target, valid when seen matches stamp
+    int* queue;             // Cell indices in BFS order
+    int head, tail;         // Saved frontier
+} DistanceField;
+
+// Mazes with at least this many cells are searched through clusters (path.h)
+// rather than with whole-maze distance fields
+#define BOT_PATH_MIN_CELLS (256 * 256)
+
+// A computer player. The survivor follows a field from the exit, rebuilt only
+// when relocateExit() moves it; the killer follows a field from the survivor,
+// rebuilt once per turn since the survivor cannot move during it. Every step
+// is then a lookup of at most four neighbours. On large mazes the fields
+// become plans over cached clusters, made at the same moments.
+typedef struct {
+    DistanceField exitField;
+    DistanceField chaseField;
+    PathGraph graph;
+    PathPlan exitPlan;
+    PathPlan chasePlan;
+} Bot;
+
+// Function declarations for computer players
+void initBot(Bot* bot);
+void resetBot(Bot* bot);
+int botAction(Bot* bot, Game* game);
+void freeBot(Bot* bot);
+
+#endif // BOT_H
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include "udp.h"
+#include "metrics.h"
+
+// Loopback check of the UDP link under simulated loss, run by `make check`.
+//
+//   deja_check [port]
+//
+// The process forks: the parent hosts a link on the port and the child joins
+// it, both dropping DEJA_UDP_LOSS percent of their outgoing datagrams
+// (CHECK_LOSS_PERCENT unless the environment says otherwise). The child
+// sends CHECK_RECORDS records in turn-sized bursts: moves that are left to
+// the next datagram, turn ends that are resent until acked, and hashes that
+// number the stream. The parent must read every one, in order and once,
+// and nothing after them; then it says so with one last record. The exit
+// status is 1 if anything went missing, came twice or out of order, took
+// longer than CHECK_SECONDS, or needed more than CHECK_MAX_RESEND_RUN
+// resends in a row on either side; a link that never comes up is killed
+// by an alarm.
+
+#define CHECK_PORT 8093
+#define CHECK_LOSS_PERCENT "25"
+#define CHECK_RECORDS 2000
+#define CHECK_BURST 8               // Records sent before a pause, like the moves of a turn
+#define CHECK_BURST_GAP_MS 2
+#define CHECK_QUIET_MS 500          // How long the receiver waits for a stray duplicate
+#define CHECK_SECONDS 60
+#define CHECK_MAX_RESEND_RUN 12
+#define CHECK_DONE 0xD0E            // Hash value of the receiver's last record
+
+// Record number i of the stream: mostly moves, every sixteenth a turn end,
+// and every fifth a hash carrying its own number
+static void expectedRecord(int i, Record* record) {
+    memset(record, 0, sizeof(*record));
+    if (i % 5 == 4) {
+        record->type = RECORD_HASH;
+        record->value = (uint32_t)i;
+    } else {
+        record->type = RECORD_INPUT;
+        record->action = i % 4;
+        record->dice = (i % 16 == 0) ? 2 + i % 11 : 0;
+    }
+}
+
+static bool sameRecord(const Record* a, const Record* b) {
+    if (a->type != b->type) {
+        return false;
+    }
+    if (a->type == RECORD_HASH) {
+        return a->value == b->value;
+    }
+    return a->action == b->action && a->dice == b->dice;
+}
+
+static uint64_t elapsedMs(uint64_t start) {
+    return (metricsNow() - start) / 1000000u;
+}
+
+// Wait up to timeoutMs for the next record; returns 0 if none came
+static int receiveWithin(int fd, Record* record, int timeoutMs) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, timeoutMs) <= 0) {
+        return 0;
+    }
+    return udpReceiveRecord(record);
+}
+
+// Send the stream, then wait for the receiver to confirm it
+static int runSender(int port) {
+    int fd = udpJoin("127.0.0.1", port);
+    if (fd < 0) {
+        return 1;
+    }
+    uint64_t start = metricsNow();
+    int failed = 0;
+    for (int i = 0; i < CHECK_RECORDS && !failed; i++) {
+        Record record;
+        expectedRecord(i, &record);
+        // A full window means the receiver has not acked yet; wait for it
+        while (udpSendRecord(&record) < 0) {
+            if (elapsedMs(start) > CHECK_SECONDS * 1000u) {
+                fprintf(stderr, "sender: record %d could not be sent\n", i);
+                failed = 1;
+                break;
+            }
+            usleep(1000);
+        }
+        if (i % CHECK_BURST == CHECK_BURST - 1) {
+            usleep(CHECK_BURST_GAP_MS * 1000);
+        }
+    }
+
+    Record done;
+    if (!failed) {
+        int left = CHECK_SECONDS * 1000 - (int)elapsedMs(start);
+        if (receiveWithin(fd, &done, left > 0 ? left : 0) <= 0 || done.type != RECORD_HASH ||
+            done.value != CHECK_DONE) {
+            fprintf(stderr, "sender: no confirmation from the receiver\n");
+            failed = 1;
+        }
+    }
+    int run = udpLongestResendRun();
+    if (run > CHECK_MAX_RESEND_RUN) {
+        fprintf(stderr, "sender: %d resends in a row\n", run);
+        failed = 1;
+    }
+    udpClose();
+    return failed;
+}
+
+// Read the stream and check every record against the one expected
+static int runReceiver(int port) {
+    int fd = udpHost(port);
+    if (fd < 0) {
+        return 1;
+    }
+    uint64_t start = metricsNow();
+    int failed = 0;
+    int received = 0;
+    while (received < CHECK_RECORDS && !failed) {
+        int left = CHECK_SECONDS * 1000 - (int)elapsedMs(start);
+        Record record, expected;
+        if (left <= 0 || receiveWithin(fd, &record, left) <= 0) {
+            fprintf(stderr, "receiver: stopped after %d of %d records\n", received, CHECK_RECORDS);
+            failed = 1;
+            break;
+        }
+        expectedRecord(received, &expected);
+        if (!sameRecord(&record, &expected)) {
+            fprintf(stderr, "receiver: record %d is not the one sent\n", received);
+            failed = 1;
+        }
+        received++;
+    }
+
+    // Anything more would be a duplicate
+    Record extra;
+    if (!failed && receiveWithin(fd, &extra, CHECK_QUIET_MS) > 0) {
+        fprintf(stderr, "receiver: a record arrived after the last one\n");
+        failed = 1;
+    }
+    uint64_t deliveredMs = elapsedMs(start);
+
+    if (!failed) {
+        Record done = { .type = RECORD_HASH, .value = CHECK_DONE };
+        udpSendRecord(&done);
+        // Stay until the sender has it, or has given up
+        while (receiveWithin(fd, &extra, CHECK_SECONDS * 1000) > 0) {
+        }
+    }
+    int run = udpLongestResendRun();
+    if (run > CHECK_MAX_RESEND_RUN) {
+        fprintf(stderr, "receiver: %d resends in a row\n", run);
+        failed = 1;
+    }
+    udpClose();
+    if (!failed) {
+        printf("%d records in order with %s%% loss in %llu ms\n", received, getenv(UDP_LOSS_ENV),
+               (unsigned long long)deliveredMs);
+    }
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    int port = argc > 1 ? atoi(argv[1]) : CHECK_PORT;
+    if (port <= 0 || port > 65535) {
+        fprintf(stderr, "Usage: %s [port]\n", argv[0]);
+        return 1;
+    }
+    setenv(UDP_LOSS_ENV, CHECK_LOSS_PERCENT, 0);
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    pid_t child = fork();
+    if (child < 0) {
+        perror("Fork failed");
+        return 1;
+    }
+    if (child == 0) {
+        // The link's own progress messages would only clutter the result
+        if (freopen("/dev/null", "w", stdout) == NULL) {
+            return 1;
+        }
+        _exit(runSender(port));
+    }
+
+    // The host waits for a hello as long as it takes; a joiner that never
+    // gets through must not hang the check
+    alarm(2 * CHECK_SECONDS);
+    int failed = runReceiver(port);
+    int status;
+    if (waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        failed = 1;
+    }
+    printf("%s\n", failed ? "FAIL" : "ok");
+    return failed;
+}
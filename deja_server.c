@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include "network.h"
+#include "metrics.h"
+#include "server.h"
+
+// The server normally runs until it is killed; take the metrics socket file with it
+static void stopOnSignal(int signal) {
+    unlink(metricsSocketPath());
+    _exit(128 + signal);
+}
+
+// Headless entry point: deja_server [port] [HEIGHTxWIDTH] [bot wait seconds]
+int main(int argc, char** argv) {
+    int port = PORT;
+    int height = DEFAULT_HEIGHT;
+    int width = DEFAULT_WIDTH;
+    int botWait = BOT_WAIT_SECONDS;
+
+    if (argc > 1) {
+        port = atoi(argv[1]);
+    }
+    if (argc > 3) {
+        botWait = atoi(argv[3]);
+    }
+    // The spectator and resume listeners sit just above the game port
+    if (port <= 0 || port > 65535 - RESUME_PORT_OFFSET || (argc > 2 && !parseMazeSize(argv[2], &height, &width)) || botWait < 0) {
+        fprintf(stderr, "Usage: %s [port] [HEIGHTxWIDTH] [bot wait seconds, 0 for never]\n", argv[0]);
+        return 1;
+    }
+
+    if (height > MAX_MAZE_SIZE) {
+        // Clients are sent the whole bitboard, so the server cannot stream
+        fprintf(stderr, "The server's maze height is limited to %d\n", MAX_MAZE_SIZE);
+        return 1;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0); // Keep the log readable when redirected
+    signal(SIGINT, stopOnSignal);
+    signal(SIGTERM, stopOnSignal);
+
+    return runServer(port, height, width, botWait) < 0 ? 1 : 0;
+}
@@ -0,0 +1,129 @@
+#include "engine.h"
+#include "flood.h"
+#include "metrics.h"
+#include "stream.h"
+
+// Tell a streaming maze which rows the players are between, so its window
+// keeps them and carves on below them
+void keepPlayerRows(Game* game) {
+    bool survivorAbove = game->survivorY < game->killerY;
+    keepMazeRows(&game->maze, survivorAbove ? game->survivorY : game->killerY,
+                 survivorAbove ? game->killerY : game->survivorY);
+}
+
+// Build a new game from a seed; the same seed builds the same game on any
+// machine, which is what keeps lockstep peers in sync. Returns -1 if the maze
+// could not be allocated.
+int setupGame(Game* game, int height, int width, uint64_t seed) {
+    uint64_t start = metricsNow();
+    game->relocateInterval = RELOCATE_INTERVAL;
+    game->seed = seed;
+    rngSeed(&game->rng, seed);
+
+    // Initialize maze
+    game->maze.cells = NULL;
+    game->maze.links = NULL;
+    game->maze.stream = NULL;
+    game->maze.flood = NULL;
+    if (initializeMaze(&game->maze, height, width, &game->rng) < 0) {
+        freeMaze(&game->maze);
+        return -1;
+    }
+    
+    // Initialize player positions
+    game->survivorY = game->maze.startY;
+    game->survivorX = game->maze.startX;
+    
+    // Place killer at a random valid position far from survivor
+    placeKiller(&game->maze, game->survivorY, game->survivorX, &game->killerY, &game->killerX, &game->rng);
+    game->spawnDistance = mazeDistance(&game->maze, game->survivorY, game->survivorX, game->killerY, game->killerX);
+    keepPlayerRows(game);
+    
+    // Initial dice rolls
+    game->survivorMovesLeft = rollDice(&game->rng);
+    game->killerMovesLeft = rollDice(&game->rng);
+
+    game->currentTurn = SURVIVOR_TURN; // Survivor goes first
+    game->gameOver = false;
+    game->survivorWon = false;
+    
+    // Reset turn counter
+    game->turnCounter = 0;
+    game->lastRelocatedTurn = -game->relocateInterval;
+    metricsRecord(METRIC_MAZE_GENERATION, start);
+    return 0;
+}
+
+// Apply one action for the player whose turn it is. Returns the dice rolled
+// for the next player when the action ended the turn, otherwise 0.
+int applyAction(Game* game, int action) {
+    bool survivorTurn = (game->currentTurn == SURVIVOR_TURN);
+    int* playerY = survivorTurn ? &game->survivorY : &game->killerY;
+    int* playerX = survivorTurn ? &game->survivorX : &game->killerX;
+    int* movesLeft = survivorTurn ? &game->survivorMovesLeft : &game->killerMovesLeft;
+
+    if (action <= ACTION_RIGHT) {
+        if (*movesLeft > 0) {
+            if (movePlayer(&game->maze, playerY, playerX, action, movesLeft)) {
+                keepPlayerRows(game);
+            }
+        }
+    } else if (action == ACTION_END_TURN) {
+        // End turn, forfeiting remaining moves
+        *movesLeft = 0;
+    } else if (action == ACTION_QUIT) {
+        game->gameOver = true;
+        return 0;
+    }
+
+    // Check if survivor reached the exit or the killer caught the survivor
+    if (survivorTurn && game->survivorY == game->maze.exitY && game->survivorX == game->maze.exitX) {
+        game->gameOver = true;
+        game->survivorWon = true;
+        return 0;
+    }
+    if (!survivorTurn && game->killerY == game->survivorY && game->killerX == game->survivorX) {
+        game->gameOver = true;
+        game->survivorWon = false;
+        return 0;
+    }
+
+    if (*movesLeft > 0) {
+        return 0;
+    }
+
+    // Switch turns and roll dice for the next player
+    int dice = rollDice(&game->rng);
+    if (survivorTurn) {
+        game->currentTurn = KILLER_TURN;
+        game->killerMovesLeft = dice;
+    } else {
+        game->currentTurn = SURVIVOR_TURN;
+        game->survivorMovesLeft = dice;
+    }
+    game->turnCounter++;
+
+    // The exit moves every relocateInterval turns
+    if (game->relocateInterval > 0 && game->turnCounter % game->relocateInterval == 0 &&
+        game->turnCounter != game->lastRelocatedTurn) {
+        relocateExit(&game->maze, &game->rng);
+        game->lastRelocatedTurn = game->turnCounter;
+    }
+    return dice;
+}
+
+// FNV-1a hash over everything the peers must agree on
+unsigned int hashGame(const Game* game) {
+    int fields[] = {
+        game->survivorY, game->survivorX, game->killerY, game->killerX,
+        game->survivorMovesLeft, game->killerMovesLeft, game->currentTurn,
+        game->maze.exitY, game->maze.exitX, game->turnCounter,
+        (int)game->rng.s[0], (int)game->rng.s[1], (int)game->rng.s[2], (int)game->rng.s[3]
+    };
+    const unsigned char* bytes = (const unsigned char*)fields;
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(fields); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,42 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+#include "maze.h"
+
+// Player actions (sent as one byte to a dedicated server or a lockstep peer)
+#define ACTION_UP 0        // Same values as the UP/DOWN/LEFT/RIGHT directions
+#define ACTION_DOWN 1
+#define ACTION_LEFT 2
+#define ACTION_RIGHT 3
+#define ACTION_END_TURN 4
+#define ACTION_QUIT 5
+
+// Turns between exit relocations
+#define RELOCATE_INTERVAL 10
+
+// The rules of one game, with no terminal or network I/O. Lockstep peers,
+// the dedicated server and the simulator all drive games through applyAction().
+typedef struct {
+    Maze maze;
+    int survivorY, survivorX;
+    int killerY, killerX;
+    int spawnDistance;      // Steps between where the survivor and the killer started
+    int survivorMovesLeft, killerMovesLeft;
+    int currentTurn;
+    int turnCounter;
+    int lastRelocatedTurn;
+    int relocateInterval;   // RELOCATE_INTERVAL unless tuned after setupGame(); 0 never relocates
+    bool gameOver;
+    bool survivorWon;
+    uint64_t seed;          // Seed the game was built from
+    Rng rng;                // Every random choice of the game comes from here
+} Game;
+
+// Function declarations for the game engine
+int setupGame(Game* game, int height, int width, uint64_t seed);
+int applyAction(Game* game, int action);
+unsigned int hashGame(const Game* game);
+void keepPlayerRows(Game* game);
+
+#endif // ENGINE_H
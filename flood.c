@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <string.h>
+#include "flood.h"
+
+// Newly reached cells of one word
+typedef struct {
+    int y, w;
+    uint64_t bits;
+} FrontierWord;
+
+// Scratch space of the search, kept with the maze between searches
+struct MazeFlood {
+    uint64_t* visited;      // One bit per cell, all clear between searches
+    size_t visitedWords;
+    FrontierWord* current;
+    FrontierWord* next;
+    int capacity;           // Entries each list has room for
+    int nextCount;
+};
+
+// Make sure the visited bitboard covers the rows the maze holds; like the
+// maze's, it is a window of rows on a streaming maze
+static int prepareFlood(Maze* maze) {
+    size_t words = (size_t)mazeBufferRows(maze) * maze->stride;
+    if (maze->flood == NULL) {
+        maze->flood = calloc(1, sizeof(MazeFlood));
+        if (maze->flood == NULL) {
+            return -1;
+        }
+    }
+    MazeFlood* flood = maze->flood;
+    if (flood->visitedWords != words) {
+        free(flood->visited);
+        flood->visited = calloc(words, sizeof(uint64_t));
+        flood->visitedWords = flood->visited != NULL ? words : 0;
+        if (flood->visited == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Room for every entry the next step can add: at most five per frontier word
+static int reserveFrontier(MazeFlood* flood, int count) {
+    int needed = 5 * count + 1;
+    if (needed <= flood->capacity) {
+        return 0;
+    }
+    int capacity = flood->capacity > 0 ? flood->capacity : 64;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    FrontierWord* current = realloc(flood->current, capacity * sizeof(FrontierWord));
+    if (current == NULL) {
+        return -1;
+    }
+    flood->current = current;
+    FrontierWord* next = realloc(flood->next, capacity * sizeof(FrontierWord));
+    if (next == NULL) {
+        return -1;
+    }
+    flood->next = next;
+    flood->capacity = capacity;
+    return 0;
+}
+
+// Add the open, unvisited cells among bits of word w of row y to the next
+// frontier, which has room for them
+static inline void reach(const Maze* maze, MazeFlood* flood, int y, int w, uint64_t bits) {
+    size_t index = (size_t)(y & maze->rowMask) * maze->stride + w;
+    bits &= maze->cells[index] & ~flood->visited[index];
+    if (bits != 0) {
+        flood->visited[index] |= bits;
+        flood->next[flood->nextCount++] = (FrontierWord){ y, w, bits };
+    }
+}
+
+// Steps along open cells from one cell to another; -1 if there is no path or
+// no memory for the search
+int mazeDistance(Maze* maze, int fromY, int fromX, int toY, int toX) {
+    if (!mazeIsOpen(maze, fromY, fromX) || !mazeIsOpen(maze, toY, toX) ||
+        prepareFlood(maze) < 0 || reserveFrontier(maze->flood, 1) < 0) {
+        return -1;
+    }
+    MazeFlood* flood = maze->flood;
+    int stride = maze->stride;
+    int rows = maze->generatedRows;
+    size_t target = (size_t)(toY & maze->rowMask) * stride + (toX >> 6);
+    uint64_t targetBit = (uint64_t)1 << (toX & 63);
+    int minRow = fromY, maxRow = fromY;
+
+    flood->nextCount = 0;
+    reach(maze, flood, fromY, fromX >> 6, (uint64_t)1 << (fromX & 63));
+    int distance = -1;
+    for (int step = 0; flood->nextCount > 0; step++) {
+        if (flood->visited[target] & targetBit) {
+            distance = step;
+            break;
+        }
+        int count = flood->nextCount;
+        if (reserveFrontier(flood, count) < 0) {
+            break;
+        }
+        FrontierWord* swap = flood->current;
+        flood->current = flood->next;
+        flood->next = swap;
+        flood->nextCount = 0;
+
+        for (int i = 0; i < count; i++) {
+            FrontierWord word = flood->current[i];
+            reach(maze, flood, word.y, word.w, (word.bits << 1) | (word.bits >> 1));
+            if ((word.bits & 1) && word.w > 0) {
+                reach(maze, flood, word.y, word.w - 1, word.bits << 63);
+            }
+            if ((word.bits >> 63) && word.w + 1 < stride) {
+                reach(maze, flood, word.y, word.w + 1, word.bits >> 63);
+            }
+            if (word.y > maze->firstRow) {
+                reach(maze, flood, word.y - 1, word.w, word.bits);
+                if (word.y - 1 < minRow) {
+                    minRow = word.y - 1;
+                }
+            }
+            if (word.y + 1 < rows) {
+                reach(maze, flood, word.y + 1, word.w, word.bits);
+                if (word.y + 1 > maxRow) {
+                    maxRow = word.y + 1;
+                }
+            }
+        }
+    }
+
+    // Leave the visited bitboard clear for the next search
+    for (int y = minRow; y <= maxRow; y++) {
+        memset(flood->visited + (size_t)(y & maze->rowMask) * stride, 0, stride * sizeof(uint64_t));
+    }
+    return distance;
+}
+
+// Open cells with exactly one open neighbour, not counting the exit. Each row
+// is compared with its neighbours a word at a time: the four neighbour masks
+// are summed bitwise, and a cell is a dead end where the sum is exactly one.
+int mazeDeadEnds(const Maze* maze) {
+    int stride = maze->stride;
+    int deadEnds = 0;
+    for (int y = maze->firstRow; y < maze->generatedRows; y++) {
+        const uint64_t* row = MAZE_ROW(maze, y);
+        const uint64_t* above = y > maze->firstRow ? MAZE_ROW(maze, y - 1) : NULL;
+        const uint64_t* below = y + 1 < maze->generatedRows ? MAZE_ROW(maze, y + 1) : NULL;
+        for (int w = 0; w < stride; w++) {
+            uint64_t open = row[w];
+            uint64_t up = above != NULL ? above[w] : 0;
+            uint64_t down = below != NULL ? below[w] : 0;
+            uint64_t left = (open << 1) | (w > 0 ? row[w - 1] >> 63 : 0);
+            uint64_t right = (open >> 1) | (w + 1 < stride ? row[w + 1] << 63 : 0);
+            uint64_t odd = up ^ down ^ left ^ right;
+            uint64_t twoOrMore = (up & down) | (left & right) | ((up ^ down) & (left ^ right));
+            deadEnds += __builtin_popcountll(open & odd & ~twoOrMore);
+        }
+    }
+    if (mazeIsOpen(maze, maze->exitY, maze->exitX) &&
+        __builtin_popcount(mazeOpenNeighbors(maze, maze->exitY, maze->exitX)) == 1) {
+        deadEnds--;
+    }
+    return deadEnds;
+}
+
+// Work out how hard a freshly generated maze is. A streaming maze has not
+// carved most of its rows, its exit included, so it is left unscored.
+void scoreMaze(Maze* maze) {
+    if (maze->stream != NULL) {
+        maze->score.exitDistance = -1;
+        maze->score.deadEnds = -1;
+        return;
+    }
+    maze->score.exitDistance = mazeDistance(maze, maze->startY, maze->startX, maze->exitY, maze->exitX);
+    maze->score.deadEnds = mazeDeadEnds(maze);
+}
+
+void freeMazeFlood(Maze* maze) {
+    if (maze->flood != NULL) {
+        free(maze->flood->visited);
+        free(maze->flood->current);
+        free(maze->flood->next);
+        free(maze->flood);
+        maze->flood = NULL;
+    }
+}
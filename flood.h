@@ -0,0 +1,22 @@
+#ifndef FLOOD_H
+#define FLOOD_H
+
+#include "maze.h"
+
+// Breadth-first search over the bitboard, a 64-cell word at a time. The
+// frontier is a list of (row, word, bits) entries; a step shifts each entry's
+// bits one cell left and right, carrying across into the neighbouring words,
+// copies them to the same word of the rows above and below, masks each result
+// with the open cells not yet visited, and keeps the words that gained any.
+// The work per step is a few shifts and masks per frontier word instead of
+// per frontier cell, and there is no queue of coordinates. The visited
+// bitboard and frontier lists live with the maze and are reused, and only
+// the rows a search touched are cleared afterwards.
+
+// Function declarations for the flood fill
+int mazeDistance(Maze* maze, int fromY, int fromX, int toY, int toX);
+int mazeDeadEnds(const Maze* maze);
+void scoreMaze(Maze* maze);
+void freeMazeFlood(Maze* maze);
+
+#endif // FLOOD_H
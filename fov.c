@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fov.h"
+
+// Is fog of war switched on for this process?
+bool fogEnabled() {
+    const char* value = getenv(FOG_ENV);
+    return value != NULL && value[0] != '\0' && strcmp(value, "0") != 0;
+}
+
+// Size the view for a maze, nothing seen yet. On a streaming maze it holds
+// the same window of rows as the maze, and forgets rows as the maze drops them.
+int initFov(Fov* fov, const Maze* maze) {
+    memset(fov, 0, sizeof(*fov));
+    fov->stride = maze->stride;
+    fov->rows = mazeBufferRows(maze);
+    fov->visible = calloc((size_t)fov->rows * fov->stride, sizeof(uint64_t));
+    fov->seen = calloc((size_t)fov->rows * fov->stride, sizeof(uint64_t));
+    if (fov->visible == NULL || fov->seen == NULL) {
+        freeFov(fov);
+        return -1;
+    }
+    fov->height = maze->height;
+    fov->width = maze->width;
+    fov->rowMask = maze->rowMask;
+    fov->firstRow = maze->firstRow;
+    fov->originY = -1;
+    fov->originX = -1;
+    return 0;
+}
+
+void freeFov(Fov* fov) {
+    free(fov->visible);
+    free(fov->seen);
+    fov->visible = NULL;
+    fov->seen = NULL;
+    fov->height = 0;
+    fov->width = 0;
+}
+
+static inline void markVisible(Fov* fov, int y, int x) {
+    long word = fovWord(fov, y, x);
+    if (word >= 0) {
+        uint64_t bit = (uint64_t)1 << (x & 63);
+        fov->visible[word] |= bit;
+        fov->seen[word] |= bit;
+    }
+}
+
+// Forget what was in sight: only the square around the last origin can hold any of it
+static void clearView(Fov* fov) {
+    if (fov->originY < 0) {
+        return;
+    }
+    for (int y = fov->originY - FOV_RADIUS; y <= fov->originY + FOV_RADIUS; y++) {
+        if (fovWord(fov, y, 0) < 0) {
+            continue;
+        }
+        uint64_t* row = fov->visible + (size_t)(y & fov->rowMask) * fov->stride;
+        int left = fov->originX - FOV_RADIUS < 0 ? 0 : fov->originX - FOV_RADIUS;
+        int right = fov->originX + FOV_RADIUS >= fov->width ? fov->width - 1 : fov->originX + FOV_RADIUS;
+        for (int x = left; x <= right; x++) {
+            row[x >> 6] &= ~((uint64_t)1 << (x & 63));
+        }
+    }
+}
+
+// Forget the rows a streaming maze has dropped since, so their places in
+// the window start unseen when later rows take them
+static void dropRows(Fov* fov, const Maze* maze) {
+    int end = maze->firstRow < fov->firstRow + fov->rows ? maze->firstRow : fov->firstRow + fov->rows;
+    for (int y = fov->firstRow; y < end; y++) {
+        size_t row = (size_t)(y & fov->rowMask) * fov->stride;
+        memset(fov->visible + row, 0, fov->stride * sizeof(uint64_t));
+        memset(fov->seen + row, 0, fov->stride * sizeof(uint64_t));
+    }
+    if (maze->firstRow > fov->firstRow) {
+        fov->firstRow = maze->firstRow;
+    }
+}
+
+// Light one octant from row on, between the slopes start and end. The
+// multipliers turn the octant's (column, row) into maze offsets.
+static void castLight(Fov* fov, const Maze* maze, int originY, int originX, int row, double start, double end,
+                      int xx, int xy, int yx, int yy) {
+    if (start < end) {
+        return;
+    }
+    double nextStart = start;
+    for (int distance = row; distance <= FOV_RADIUS; distance++) {
+        bool blocked = false;
+        int deltaY = -distance;
+        for (int deltaX = -distance; deltaX <= 0; deltaX++) {
+            double leftSlope = (deltaX - 0.5) / (deltaY + 0.5);
+            double rightSlope = (deltaX + 0.5) / (deltaY - 0.5);
+            if (start < rightSlope) {
+                continue;
+            }
+            if (end > leftSlope) {
+                break;
+            }
+
+            int y = originY + deltaX * yx + deltaY * yy;
+            int x = originX + deltaX * xx + deltaY * xy;
+            if (deltaX * deltaX + deltaY * deltaY <= FOV_RADIUS * (FOV_RADIUS + 1)) {
+                markVisible(fov, y, x);
+            }
+
+            // Walls are seen but hide what is behind them
+            bool wall = !mazeIsOpen(maze, y, x);
+            if (blocked) {
+                if (wall) {
+                    nextStart = rightSlope;
+                    continue;
+                }
+                blocked = false;
+                start = nextStart;
+            } else if (wall && distance < FOV_RADIUS) {
+                blocked = true;
+                castLight(fov, maze, originY, originX, distance + 1, start, leftSlope, xx, xy, yx, yy);
+                nextStart = rightSlope;
+            }
+        }
+        if (blocked) {
+            break;
+        }
+    }
+}
+
+// Cast the view from (y, x) unless it is already cast from there over the
+// same rows. Returns true if it was cast again.
+bool updateFov(Fov* fov, const Maze* maze, int y, int x) {
+    static const int multipliers[4][8] = {
+        {1, 0, 0, -1, -1, 0, 0, 1},
+        {0, 1, -1, 0, 0, -1, 1, 0},
+        {0, 1, 1, 0, 0, -1, -1, 0},
+        {1, 0, 0, 1, -1, 0, 0, -1},
+    };
+    if (y == fov->originY && x == fov->originX && maze->generatedRows == fov->generatedRows) {
+        return false;
+    }
+
+    clearView(fov);
+    dropRows(fov, maze);
+    fov->originY = y;
+    fov->originX = x;
+    fov->generatedRows = maze->generatedRows;
+    markVisible(fov, y, x);
+    for (int octant = 0; octant < 8; octant++) {
+        castLight(fov, maze, y, x, 1, 1.0, 0.0, multipliers[0][octant], multipliers[1][octant],
+                  multipliers[2][octant], multipliers[3][octant]);
+    }
+    fov->version++;
+    return true;
+}
+
+// Pack the cells in view, and which of them are open, for the wire
+void encodeFogView(const Fov* fov, const Maze* maze, FogView* view) {
+    memset(view, 0, sizeof(*view));
+    view->top = fov->originY - FOV_RADIUS;
+    view->left = fov->originX - FOV_RADIUS;
+    for (int i = 0; i < FOV_SPAN; i++) {
+        for (int j = 0; j < FOV_SPAN; j++) {
+            int y = view->top + i;
+            int x = view->left + j;
+            if (fovVisible(fov, y, x)) {
+                view->visible[i] |= (uint32_t)1 << j;
+                if (mazeIsOpen(maze, y, x)) {
+                    view->open[i] |= (uint32_t)1 << j;
+                }
+            }
+        }
+    }
+}
+
+// Take in a view from the server: it replaces what is in sight, and its open
+// cells are carved into the maze, which starts as all wall. Cells outside
+// the maze are ignored.
+void applyFogView(Fov* fov, Maze* maze, const FogView* view) {
+    clearView(fov);
+    fov->originY = view->top + FOV_RADIUS;
+    fov->originX = view->left + FOV_RADIUS;
+    for (int i = 0; i < FOV_SPAN; i++) {
+        for (int j = 0; j < FOV_SPAN; j++) {
+            int y = view->top + i;
+            int x = view->left + j;
+            if ((view->visible[i] >> j) & 1) {
+                markVisible(fov, y, x);
+                if (((view->open[i] >> j) & 1) && (unsigned)y < (unsigned)maze->height &&
+                    (unsigned)x < (unsigned)maze->width) {
+                    mazeOpenCell(maze, y, x);
+                }
+            }
+        }
+    }
+    fov->version++;
+}
@@ -0,0 +1,74 @@
+#ifndef FOV_H
+#define FOV_H
+
+#include <stdint.h>
+#include "maze.h"
+
+// Fog of war. With FOG_ENV set, each player sees only the cells in line of
+// sight within FOV_RADIUS and remembers the walls of every cell it has seen;
+// the opponent and the exit show only while in sight.
+//
+// Sight is found by recursive shadowcasting: each of the eight octants is
+// swept outwards a row at a time, and every run of walls narrows the slopes
+// the rows beyond it are seen through. A view is cast again only when the
+// viewer moves or a streaming maze carves rows. Clearing the last view and
+// casting the new one touch only the FOV_SPAN square around the viewer, so a
+// move costs the same on any size of maze. The exit is not an obstacle: its
+// moving changes what is drawn and sent, never what is in sight.
+//
+// A dedicated server casts each player's view and sends it only the cells in
+// it, as a FogView, and only when the view changed.
+
+#define FOV_RADIUS 10
+#define FOV_SPAN (2 * FOV_RADIUS + 1)   // Fits the 32-bit rows of a FogView
+#define FOG_ENV "DEJA_FOG"              // Set to 1 to play with fog of war
+
+typedef struct {
+    int height, width;
+    int stride;                 // 64-bit words per row, as in the maze
+    int rows;                   // Rows held: the maze's height, or its window while streaming
+    int rowMask;                // Row y is held in row y & rowMask, as in the maze
+    int firstRow;               // Rows above it were dropped with the maze's
+    uint64_t* visible;          // Cells in sight now
+    uint64_t* seen;             // Cells ever in sight
+    int originY, originX;       // Where the view was cast from, -1 before the first
+    int generatedRows;          // maze->generatedRows when it was cast
+    unsigned int version;       // Bumped whenever the view changes
+} Fov;
+
+// The cells in one view as sent on the wire: bit j of row i is the cell at
+// (top + i, left + j). Only cells in sight have their open bit set.
+typedef struct {
+    int32_t top, left;
+    uint32_t visible[FOV_SPAN];
+    uint32_t open[FOV_SPAN];
+} FogView;
+
+// Word of (y, x) in the bitboards, or -1 outside the maze or the rows held
+static inline long fovWord(const Fov* fov, int y, int x) {
+    if ((unsigned)y >= (unsigned)fov->height || (unsigned)(y - fov->firstRow) >= (unsigned)fov->rows ||
+        (unsigned)x >= (unsigned)fov->width) {
+        return -1;
+    }
+    return (long)(y & fov->rowMask) * fov->stride + (x >> 6);
+}
+
+static inline bool fovVisible(const Fov* fov, int y, int x) {
+    long word = fovWord(fov, y, x);
+    return word >= 0 && ((fov->visible[word] >> (x & 63)) & 1);
+}
+
+static inline bool fovSeen(const Fov* fov, int y, int x) {
+    long word = fovWord(fov, y, x);
+    return word >= 0 && ((fov->seen[word] >> (x & 63)) & 1);
+}
+
+// Function declarations for fog of war
+bool fogEnabled();
+int initFov(Fov* fov, const Maze* maze);
+void freeFov(Fov* fov);
+bool updateFov(Fov* fov, const Maze* maze, int y, int x);
+void encodeFogView(const Fov* fov, const Maze* maze, FogView* view);
+void applyFogView(Fov* fov, Maze* maze, const FogView* view);
+
+#endif // FOV_H
@@ -15,6 +15,8 @@ void runGame();
 
 // Function declarations for title screen
 void bg_music();
+void stopMusic();
+void initScreen();
 void showTitleScreen();
 void startGame();
 void showInstructions();
@@ -22,4 +24,8 @@ void showInstructions();
 // Global state variable
 extern int currentState;
 
+// Maze size chosen at startup (HEIGHTxWIDTH on the command line)
+extern int mazeHeight;
+extern int mazeWidth;
+
 #endif /* GAME_H */
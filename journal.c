@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "journal.h"
+
+#define MAGIC_LENGTH 4
+
+// Append one LEB128 varint to the game being recorded
+static void pushVarint(JournalWriter* writer, uint64_t value) {
+    if (writer->failed) {
+        return;
+    }
+    if (writer->length + 10 > writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity * 2 : 64;
+        unsigned char* data = realloc(writer->data, capacity);
+        if (data == NULL) {
+            writer->failed = true;
+            return;
+        }
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+    while (value >= 0x80) {
+        writer->data[writer->length++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    writer->data[writer->length++] = (unsigned char)value;
+}
+
+// Write out the pending run of repeated actions
+static void flushRun(JournalWriter* writer) {
+    if (writer->runLength > 0) {
+        pushVarint(writer, (uint64_t)writer->runLength << 3 | writer->runAction);
+    }
+    writer->runAction = -1;
+    writer->runLength = 0;
+}
+
+// Begin recording a game that setupGame() has just built
+void journalStart(JournalWriter* writer, const Game* game) {
+    memset(writer, 0, sizeof(*writer));
+    writer->runAction = -1;
+    pushVarint(writer, game->seed);
+    pushVarint(writer, game->maze.height);
+    pushVarint(writer, game->maze.width);
+    pushVarint(writer, game->relocateInterval);
+}
+
+// Record an action just passed to applyAction(); anything the engine does
+// not understand has no effect and is not recorded
+void journalAction(JournalWriter* writer, int action) {
+    if (action < 0 || action > ACTION_QUIT) {
+        return;
+    }
+    if (action != writer->runAction) {
+        flushRun(writer);
+        writer->runAction = action;
+    }
+    writer->runLength++;
+}
+
+// Carry on recording a game from a buffer saved with its snapshot: the
+// bytes so far and the pending run. An empty buffer, or one that cannot be
+// copied, leaves the game unrecorded.
+void journalResume(JournalWriter* writer, const void* data, size_t length, int runAction, unsigned int runLength) {
+    memset(writer, 0, sizeof(*writer));
+    writer->runAction = -1;
+    writer->data = length > 0 ? malloc(length) : NULL;
+    if (writer->data == NULL || runAction < -1 || runAction > ACTION_QUIT || (runAction < 0 && runLength > 0)) {
+        free(writer->data);
+        writer->data = NULL;
+        writer->failed = true;
+        return;
+    }
+    memcpy(writer->data, data, length);
+    writer->length = length;
+    writer->capacity = length;
+    writer->runAction = runAction;
+    writer->runLength = runLength;
+}
+
+// Drop the game being recorded without writing it
+void journalDiscard(JournalWriter* writer) {
+    free(writer->data);
+    memset(writer, 0, sizeof(*writer));
+    writer->runAction = -1;
+}
+
+// Close the game and append it to the journal at path. The buffer is
+// released either way. Returns -1 if the game could not be written.
+int journalFinish(JournalWriter* writer, const Game* game, const char* path) {
+    flushRun(writer);
+    int outcome = (game->gameOver ? JOURNAL_GAME_OVER : 0) | (game->survivorWon ? JOURNAL_SURVIVOR_WON : 0);
+    pushVarint(writer, (uint64_t)outcome << 3 | JOURNAL_END);
+    pushVarint(writer, hashGame(game));
+
+    int result = -1;
+    int fd = writer->failed ? -1 : open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd >= 0) {
+        // A new journal starts with its magic, written together with the first game
+        struct stat info;
+        struct iovec parts[2];
+        int count = 0;
+        if (fstat(fd, &info) == 0 && info.st_size == 0) {
+            parts[count].iov_base = JOURNAL_MAGIC;
+            parts[count].iov_len = MAGIC_LENGTH;
+            count++;
+        }
+        parts[count].iov_base = writer->data;
+        parts[count].iov_len = writer->length;
+        count++;
+
+        ssize_t expected = (ssize_t)writer->length + (count == 2 ? MAGIC_LENGTH : 0);
+        if (writev(fd, parts, count) == expected) {
+            result = 0;
+        }
+        close(fd);
+    }
+
+    free(writer->data);
+    memset(writer, 0, sizeof(*writer));
+    writer->runAction = -1;
+    return result;
+}
+
+// Map a journal for reading. Returns -1 if it cannot be opened or is not a journal.
+int journalOpen(JournalReader* reader, const char* path) {
+    memset(reader, 0, sizeof(*reader));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Cannot open journal");
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size < MAGIC_LENGTH) {
+        fprintf(stderr, "%s is not a journal\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Cannot map journal");
+        return -1;
+    }
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+    if (memcmp(data, JOURNAL_MAGIC, MAGIC_LENGTH) != 0) {
+        fprintf(stderr, "%s is not a journal\n", path);
+        munmap(data, info.st_size);
+        return -1;
+    }
+    reader->data = data;
+    reader->length = info.st_size;
+    reader->offset = MAGIC_LENGTH;
+    return 0;
+}
+
+void journalClose(JournalReader* reader) {
+    if (reader->data != NULL) {
+        munmap((void*)reader->data, reader->length);
+    }
+    memset(reader, 0, sizeof(*reader));
+}
+
+// Read one varint; returns -1 if it is cut off or too long
+static int readVarint(JournalReader* reader, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->offset >= reader->length) {
+            return -1;
+        }
+        unsigned char byte = reader->data[reader->offset++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Move to the next game, skipping whatever is left of the current one.
+// Returns 1 with its header filled in, 0 at the end of the journal, or -1
+// if the journal is corrupt.
+int journalNextGame(JournalReader* reader, JournalGame* header) {
+    while (reader->inGame) {
+        int action = journalNextAction(reader);
+        if (action < 0) {
+            return -1;
+        }
+    }
+    if (reader->offset >= reader->length) {
+        return 0;
+    }
+
+    uint64_t fields[4];
+    for (int i = 0; i < 4; i++) {
+        if (readVarint(reader, &fields[i]) < 0) {
+            return -1;
+        }
+    }
+    if (fields[1] < MIN_MAZE_SIZE || fields[1] > MAX_STREAM_HEIGHT ||
+        fields[2] < MIN_MAZE_SIZE || fields[2] > MAX_MAZE_SIZE || fields[3] > INT32_MAX) {
+        return -1;
+    }
+    header->seed = fields[0];
+    header->height = (int)fields[1];
+    header->width = (int)fields[2];
+    header->relocateInterval = (int)fields[3];
+
+    reader->inGame = true;
+    reader->runLeft = 0;
+    return 1;
+}
+
+// Next action of the current game, JOURNAL_END once it is over (outcome and
+// hash are then set), or -1 if the journal is corrupt
+int journalNextAction(JournalReader* reader) {
+    if (!reader->inGame) {
+        return JOURNAL_END;
+    }
+    if (reader->runLeft > 0) {
+        reader->runLeft--;
+        return reader->runAction;
+    }
+
+    uint64_t value;
+    if (readVarint(reader, &value) < 0) {
+        return -1;
+    }
+    int action = value & 7;
+    uint64_t count = value >> 3;
+
+    if (action == JOURNAL_END) {
+        uint64_t hash;
+        if (readVarint(reader, &hash) < 0) {
+            return -1;
+        }
+        reader->outcome = (int)count;
+        reader->hash = (unsigned int)hash;
+        reader->inGame = false;
+        return JOURNAL_END;
+    }
+    if (action > ACTION_QUIT || count == 0 || count > UINT32_MAX) {
+        return -1;
+    }
+    reader->runAction = action;
+    reader->runLeft = (unsigned int)(count - 1);
+    return action;
+}
+
+// Play the current game through the engine at full speed. Returns 0 if it
+// ends exactly as recorded, 1 if it diverged, or -1 if it could not be
+// replayed. The caller frees the game's maze unless -1 is returned.
+int journalReplayGame(JournalReader* reader, const JournalGame* header, Game* game) {
+    if (setupGame(game, header->height, header->width, header->seed) < 0) {
+        return -1;
+    }
+    game->relocateInterval = header->relocateInterval;
+
+    int action;
+    while ((action = journalNextAction(reader)) != JOURNAL_END) {
+        if (action < 0) {
+            freeMaze(&game->maze);
+            return -1;
+        }
+        applyAction(game, action);
+    }
+
+    int outcome = (game->gameOver ? JOURNAL_GAME_OVER : 0) | (game->survivorWon ? JOURNAL_SURVIVOR_WON : 0);
+    return outcome == reader->outcome && hashGame(game) == reader->hash ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "engine.h"
+
+// Replay journal. A game is fully determined by its seed and the actions
+// applied to it, so that is all a journal stores:
+//
+//   file:  "DEJ2" game*
+//   game:  varint seed, height, width, relocateInterval
+//          varint (runLength << 3 | action)*      runs of one repeated action
+//          varint (outcome << 3 | JOURNAL_END), varint hashGame() at the end
+//
+// Each game is buffered while it is played and appended with one write when
+// it ends, so concurrent matches never interleave and a crash mid-game cannot
+// leave a torn record behind. A snapshot keeps the buffer of its game, so a
+// game resumed after a quit or restart is still journaled whole.
+
+#define JOURNAL_FILE "deja.journal"
+#define JOURNAL_MAGIC "DEJ2"        // Bumped when a seed no longer builds the same game
+#define JOURNAL_END 7               // Action code that closes a game
+
+// Outcome bits recorded with JOURNAL_END
+#define JOURNAL_GAME_OVER 1
+#define JOURNAL_SURVIVOR_WON 2
+
+// A game being recorded
+typedef struct {
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+    int runAction;          // Action repeated by the pending run, or -1
+    unsigned int runLength;
+    bool failed;            // Out of memory; the game is not written
+} JournalWriter;
+
+// Header of a recorded game
+typedef struct {
+    uint64_t seed;
+    int height, width;
+    int relocateInterval;
+} JournalGame;
+
+// A journal mapped into memory for playback
+typedef struct {
+    const unsigned char* data;
+    size_t length;
+    size_t offset;
+    bool inGame;            // Between a game's header and its end marker
+    int runAction;
+    unsigned int runLeft;   // Repeats of runAction still to hand out
+    int outcome;            // JOURNAL_ outcome bits, valid after JOURNAL_END
+    unsigned int hash;      // Recorded hashGame(), valid after JOURNAL_END
+} JournalReader;
+
+// Function declarations for recording games
+void journalStart(JournalWriter* writer, const Game* game);
+void journalAction(JournalWriter* writer, int action);
+int journalFinish(JournalWriter* writer, const Game* game, const char* path);
+void journalResume(JournalWriter* writer, const void* data, size_t length, int runAction, unsigned int runLength);
+void journalDiscard(JournalWriter* writer);
+
+// Function declarations for playing them back
+int journalOpen(JournalReader* reader, const char* path);
+void journalClose(JournalReader* reader);
+int journalNextGame(JournalReader* reader, JournalGame* header);
+int journalNextAction(JournalReader* reader);
+int journalReplayGame(JournalReader* reader, const JournalGame* header, Game* game);
+
+#endif // JOURNAL_H
@@ -0,0 +1,505 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/tcp.h>
+#include "network.h"
+#include "metrics.h"
+
+// Load generator and soak test for the dedicated server: thousands of
+// scripted players over loopback, or against any address.
+//
+//   deja_load [-c clients] [-j threads] [-t seconds] [-g games] [-r connects/s] [host] [port]
+//
+// Each thread drives its share of the clients from one epoll loop. A client
+// connects, moves at random the moment it is its turn, and reconnects for
+// another match when one ends, until the time runs out or it has played -g
+// games. The server pairs clients with each other as they arrive, so every
+// match exercises two connections. A line of throughput figures is printed
+// every second and latency percentiles at the end; the exit status is 1 if
+// any connection failed or broke off mid-match.
+
+#define LOAD_MAX_EVENTS 256
+#define LOAD_READ_BYTES 65536
+#define LOAD_END_TURN_ODDS 8        // One action in this many ends the turn early
+#define LOAD_RAMP_TICK_MS 10        // Wake-up period while clients are still being started
+
+// Where a client is in its connection's life
+#define CLIENT_IDLE 0               // Not connected; waiting for its start or done
+#define CLIENT_CONNECTING 1
+#define CLIENT_CONNECTED 2
+
+typedef struct {
+    int fd;
+    int phase;                      // One of the CLIENT_ constants
+    int games;                      // Matches finished
+    uint64_t connectStart;          // metricsNow() when connect() was called
+    uint64_t actionSent;            // When the action the server has yet to answer went out, or 0
+    bool firstState;                // Nothing received yet on this connection
+    unsigned char header[sizeof(GameState)];
+    size_t headerLength;
+    size_t bodyLeft;                // Maze or view bytes of the current state still to skip
+} LoadClient;
+
+// One thread's clients
+typedef struct {
+    LoadClient* clients;
+    int count;
+    int started;                    // Clients connected at least once, for the ramp
+    int epollFd;
+    Rng rng;
+    pthread_t thread;
+} LoadWorker;
+
+// Settings shared by every worker
+typedef struct {
+    struct sockaddr_in address;
+    int gamesPerClient;             // 0 plays until the deadline
+    double connectRate;             // Per worker; 0 starts every client at once
+    uint64_t start, deadline;       // metricsNow() readings; deadline 0 means none
+} LoadConfig;
+
+// Totals across all workers, updated with relaxed atomics and read once a
+// second for the progress line
+typedef struct {
+    uint64_t connects;
+    uint64_t connectFailures;
+    uint64_t open;
+    uint64_t games;
+    uint64_t aborted;               // Matches the server ended with STATUS_ABORTED
+    uint64_t disconnects;           // Connections lost before the match ended
+    uint64_t protocolErrors;
+    uint64_t states;
+    uint64_t actions;
+    uint64_t bytes;
+} LoadTotals;
+
+static LoadConfig config;
+static LoadTotals totals;
+static Histogram connectTime;       // connect() until the handshake completes
+static Histogram firstStateTime;    // connect() until the server's first message
+static Histogram roundTrip;         // Action sent until the state it caused arrives
+static volatile bool stopping = false;
+static int runningWorkers = 0;
+static uint64_t finishedAt;         // When the last worker stopped
+
+static void count(uint64_t* counter, int64_t delta) {
+    __atomic_fetch_add(counter, (uint64_t)delta, __ATOMIC_RELAXED);
+}
+
+static uint64_t counted(const uint64_t* counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+// Whether this client should play another match
+static bool wantsAnotherGame(const LoadClient* client) {
+    if (stopping || (config.deadline != 0 && metricsNow() >= config.deadline)) {
+        return false;
+    }
+    return config.gamesPerClient == 0 || client->games < config.gamesPerClient;
+}
+
+static void closeClient(LoadClient* client) {
+    if (client->fd >= 0) {
+        close(client->fd);
+        count(&totals.open, -1);
+    }
+    client->fd = -1;
+    client->phase = CLIENT_IDLE;
+}
+
+// Start a nonblocking connect; failures are counted and the client retires
+static void connectClient(LoadWorker* worker, LoadClient* client) {
+    client->connectStart = metricsNow();
+    client->actionSent = 0;
+    client->firstState = true;
+    client->headerLength = 0;
+    client->bodyLeft = 0;
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        count(&totals.connectFailures, 1);
+        return;
+    }
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    if (connect(fd, (struct sockaddr*)&config.address, sizeof(config.address)) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        count(&totals.connectFailures, 1);
+        return;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.ptr = client;
+    if (epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        close(fd);
+        count(&totals.connectFailures, 1);
+        return;
+    }
+    client->fd = fd;
+    client->phase = CLIENT_CONNECTING;
+    count(&totals.open, 1);
+}
+
+// The handshake finished, one way or the other
+static void finishConnect(LoadWorker* worker, LoadClient* client) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+        closeClient(client);
+        count(&totals.connectFailures, 1);
+        return;
+    }
+    histogramRecord(&connectTime, metricsNow() - client->connectStart);
+    count(&totals.connects, 1);
+    client->phase = CLIENT_CONNECTED;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = client;
+    epoll_ctl(worker->epollFd, EPOLL_CTL_MOD, client->fd, &ev);
+}
+
+// Scripted play: a random direction, now and then ending the turn early
+static int chooseAction(LoadWorker* worker) {
+    if (rngRange(&worker->rng, LOAD_END_TURN_ODDS) == 0) {
+        return ACTION_END_TURN;
+    }
+    return rngRange(&worker->rng, 4);
+}
+
+// React to one complete state; returns false once the connection is finished with
+static bool handleState(LoadWorker* worker, LoadClient* client, const GameState* state) {
+    uint64_t now = metricsNow();
+    count(&totals.states, 1);
+    if (client->firstState) {
+        histogramRecord(&firstStateTime, now - client->connectStart);
+        client->firstState = false;
+    }
+    if (client->actionSent != 0) {
+        histogramRecord(&roundTrip, now - client->actionSent);
+        client->actionSent = 0;
+    }
+
+    if (state->status == STATUS_WAITING) {
+        return true;
+    }
+    if (state->status != STATUS_PLAYING) {
+        // Both players see the end; the survivor seat is never the bot's, so it counts the match
+        client->games++;
+        if (state->role == SURVIVOR_TURN) {
+            count(&totals.games, 1);
+            if (state->status == STATUS_ABORTED) {
+                count(&totals.aborted, 1);
+            }
+        }
+        return false;
+    }
+
+    if (state->currentTurn == state->role) {
+        unsigned char action = (unsigned char)chooseAction(worker);
+        if (send(client->fd, &action, 1, MSG_NOSIGNAL) != 1) {
+            count(&totals.disconnects, 1);
+            return false;
+        }
+        client->actionSent = now;
+        count(&totals.actions, 1);
+    }
+    return true;
+}
+
+// Split what arrived into states: a header, then the maze it announces,
+// which is skipped. Returns false once the connection is finished with.
+static bool consumeInput(LoadWorker* worker, LoadClient* client, const unsigned char* data, size_t length) {
+    while (length > 0) {
+        if (client->bodyLeft > 0) {
+            size_t skip = length < client->bodyLeft ? length : client->bodyLeft;
+            client->bodyLeft -= skip;
+            data += skip;
+            length -= skip;
+        } else {
+            size_t take = sizeof(GameState) - client->headerLength;
+            if (take > length) {
+                take = length;
+            }
+            memcpy(client->header + client->headerLength, data, take);
+            client->headerLength += take;
+            data += take;
+            length -= take;
+            if (client->headerLength < sizeof(GameState)) {
+                break;
+            }
+
+            GameState* state = (GameState*)client->header;
+            if (state->height != 0 || state->width != 0) {
+                if (state->height < MIN_MAZE_SIZE || state->width < MIN_MAZE_SIZE ||
+                    state->height > MAX_MAZE_SIZE || state->width > MAX_MAZE_SIZE) {
+                    count(&totals.protocolErrors, 1);
+                    return false;
+                }
+            }
+            client->bodyLeft = stateBodyBytes(state);
+        }
+
+        // A header with its whole maze is a complete state
+        if (client->headerLength == sizeof(GameState) && client->bodyLeft == 0) {
+            client->headerLength = 0;
+            if (!handleState(worker, client, (GameState*)client->header)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void readClient(LoadWorker* worker, LoadClient* client, unsigned char* buffer) {
+    while (1) {
+        ssize_t received = recv(client->fd, buffer, LOAD_READ_BYTES, 0);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (received <= 0) {
+            // The server closes a match's connections only after its final state
+            count(&totals.disconnects, 1);
+            closeClient(client);
+            break;
+        }
+        count(&totals.bytes, received);
+        if (!consumeInput(worker, client, buffer, received)) {
+            closeClient(client);
+            break;
+        }
+    }
+    if (wantsAnotherGame(client)) {
+        connectClient(worker, client);
+    }
+}
+
+// Clients the ramp lets this worker have started by now
+static int rampAllowance(LoadWorker* worker) {
+    if (config.connectRate <= 0) {
+        return worker->count;
+    }
+    double seconds = (metricsNow() - config.start) / 1e9;
+    int allowed = 1 + (int)(seconds * config.connectRate);
+    return allowed < worker->count ? allowed : worker->count;
+}
+
+static void* runWorker(void* arg) {
+    LoadWorker* worker = arg;
+    unsigned char* buffer = malloc(LOAD_READ_BYTES);
+    struct epoll_event events[LOAD_MAX_EVENTS];
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    while (1) {
+        for (int allowed = rampAllowance(worker); worker->started < allowed; worker->started++) {
+            connectClient(worker, &worker->clients[worker->started]);
+        }
+
+        // Done once every client is started and none is connected
+        bool active = worker->started < worker->count;
+        for (int i = 0; i < worker->count && !active; i++) {
+            active = worker->clients[i].phase != CLIENT_IDLE;
+        }
+        if (!active || stopping || (config.deadline != 0 && metricsNow() >= config.deadline)) {
+            break;
+        }
+
+        int timeoutMs = worker->started < worker->count ? LOAD_RAMP_TICK_MS : 100;
+        int ready = epoll_wait(worker->epollFd, events, LOAD_MAX_EVENTS, timeoutMs);
+        for (int i = 0; i < ready; i++) {
+            LoadClient* client = events[i].data.ptr;
+            if (client->phase == CLIENT_CONNECTING) {
+                finishConnect(worker, client);
+            }
+            if (client->phase == CLIENT_CONNECTED && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+                readClient(worker, client, buffer);
+            }
+        }
+    }
+
+    // Matches still running at the deadline are left unfinished, not failed
+    for (int i = 0; i < worker->count; i++) {
+        closeClient(&worker->clients[i]);
+    }
+    free(buffer);
+    __atomic_store_n(&finishedAt, metricsNow(), __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&runningWorkers, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void printLatency(const char* name, const Histogram* histogram) {
+    printf("%-12s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", name,
+           (unsigned long long)histogram->count,
+           histogramPercentile(histogram, 0.5) / 1e3, histogramPercentile(histogram, 0.9) / 1e3,
+           histogramPercentile(histogram, 0.99) / 1e3, histogramPercentile(histogram, 0.999) / 1e3,
+           histogram->max / 1e3);
+}
+
+// Make room for one descriptor per client
+static void raiseDescriptorLimit(int clients) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t)clients + 16) {
+        fprintf(stderr, "Warning: only %llu file descriptors for %d clients\n",
+                (unsigned long long)limit.rlim_cur, clients);
+    }
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-c clients] [-j threads] [-t seconds] [-g games per client] "
+                    "[-r connects per second] [host] [port]\n", program);
+}
+
+int main(int argc, char** argv) {
+    int clients = 1000;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    double seconds = 10;
+    double connectRate = 0;
+    const char* host = "127.0.0.1";
+    int port = PORT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:j:t:g:r:")) != -1) {
+        switch (opt) {
+            case 'c':
+                clients = atoi(optarg);
+                break;
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 't':
+                seconds = atof(optarg);
+                break;
+            case 'g':
+                config.gamesPerClient = atoi(optarg);
+                break;
+            case 'r':
+                connectRate = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind < argc) {
+        host = argv[optind++];
+    }
+    if (optind < argc) {
+        port = atoi(argv[optind++]);
+    }
+    if (clients <= 0 || threads <= 0 || seconds < 0 || config.gamesPerClient < 0 || connectRate < 0 ||
+        port <= 0 || port > 65535 || (seconds == 0 && config.gamesPerClient == 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threads > clients) {
+        threads = clients;
+    }
+
+    config.address.sin_family = AF_INET;
+    config.address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &config.address.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid address: %s\n", host);
+        return 1;
+    }
+    raiseDescriptorLimit(clients);
+
+    LoadWorker* workers = calloc(threads, sizeof(LoadWorker));
+    LoadClient* clientSlots = calloc(clients, sizeof(LoadClient));
+    if (workers == NULL || clientSlots == NULL) {
+        fprintf(stderr, "Not enough memory for %d clients\n", clients);
+        return 1;
+    }
+    config.connectRate = connectRate / threads;
+    config.start = metricsNow();
+    config.deadline = seconds > 0 ? config.start + (uint64_t)(seconds * 1e9) : 0;
+
+    printf("%d clients on %d threads against %s:%d", clients, threads, host, port);
+    if (seconds > 0) {
+        printf(" for %.0f s", seconds);
+    }
+    if (config.gamesPerClient > 0) {
+        printf(", %d games each", config.gamesPerClient);
+    }
+    printf("\n%6s %8s %10s %10s %10s %10s %8s %8s\n",
+           "time", "open", "connects", "games", "games/s", "states/s", "MB/s", "errors");
+    fflush(stdout);
+
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        LoadWorker* worker = &workers[i];
+        worker->clients = clientSlots + (long)clients * i / threads;
+        worker->count = (int)((long)clients * (i + 1) / threads - (long)clients * i / threads);
+        for (int j = 0; j < worker->count; j++) {
+            worker->clients[j].fd = -1;
+        }
+        rngSeed(&worker->rng, config.start + i);
+        worker->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        __atomic_fetch_add(&runningWorkers, 1, __ATOMIC_RELAXED);
+        if (worker->epollFd < 0 || pthread_create(&worker->thread, NULL, runWorker, worker) != 0) {
+            perror("Worker start failed");
+            __atomic_fetch_sub(&runningWorkers, 1, __ATOMIC_RELAXED);
+            stopping = true;
+            break;
+        }
+        started++;
+    }
+
+    // Progress once a second until every worker has finished
+    uint64_t lastGames = 0, lastStates = 0, lastBytes = 0;
+    for (int tick = 1; started == threads; tick++) {
+        sleep(1);
+        uint64_t games = counted(&totals.games);
+        uint64_t states = counted(&totals.states);
+        uint64_t bytes = counted(&totals.bytes);
+        uint64_t errors = counted(&totals.connectFailures) + counted(&totals.disconnects) +
+                          counted(&totals.protocolErrors);
+        printf("%5ds %8llu %10llu %10llu %10llu %10llu %8.2f %8llu\n", tick,
+               (unsigned long long)counted(&totals.open), (unsigned long long)counted(&totals.connects),
+               (unsigned long long)games, (unsigned long long)(games - lastGames),
+               (unsigned long long)(states - lastStates), (bytes - lastBytes) / 1e6,
+               (unsigned long long)errors);
+        fflush(stdout);
+        lastGames = games;
+        lastStates = states;
+        lastBytes = bytes;
+        if (__atomic_load_n(&runningWorkers, __ATOMIC_ACQUIRE) == 0) {
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].epollFd);
+    }
+
+    double elapsed = (finishedAt - config.start) / 1e9;
+    printf("\n%llu connects, %llu failed; %llu games, %llu aborted by the server; "
+           "%llu connections lost, %llu protocol errors\n",
+           (unsigned long long)totals.connects, (unsigned long long)totals.connectFailures,
+           (unsigned long long)totals.games, (unsigned long long)totals.aborted,
+           (unsigned long long)totals.disconnects, (unsigned long long)totals.protocolErrors);
+    printf("%.1f games/s, %.0f actions/s, %.0f states/s, %.2f MB/s received over %.1f s\n",
+           totals.games / elapsed, totals.actions / elapsed, totals.states / elapsed,
+           totals.bytes / 1e6 / elapsed, elapsed);
+    printf("\n%-12s %10s %10s %10s %10s %10s %10s\n",
+           "latency", "count", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+    printLatency("connect", &connectTime);
+    printLatency("first state", &firstStateTime);
+    printLatency("round trip", &roundTrip);
+
+    free(workers);
+    free(clientSlots);
+    return totals.connectFailures + totals.disconnects + totals.protocolErrors > 0 || started < threads ? 1 : 0;
+}
@@ -1,228 +1,39 @@
 #include <ncurses.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <stdbool.h>
+#include <poll.h>
 #include "game.h"
 #include "network.h"
-
-// Game constants
-#define WALL '#'
-#define SURVIVOR 'S'
-#define KILLER 'K'
-#define EXIT 'E'
-#define EMPTY ' '
-
-// Maze dimensions
-#define HEIGHT 10
-#define WIDTH 25
-
-// Direction constants for player movement
-#define UP 0
-#define DOWN 1
-#define LEFT 2
-#define RIGHT 3
-
-// Player turn constants
-#define SURVIVOR_TURN 0
-#define KILLER_TURN 1
-
-//Turn Counter
-int turnCounter = 0; 
-int lastRelocatedTurn = -10;
-
-// Maze structure
-typedef struct {
-    char grid[HEIGHT][WIDTH];
-    int startX, startY;
-    int exitX, exitY;
-} Maze;
-
-// Check if a coordinate is valid
-bool isValid(int y, int x) {
-    return y >= 0 && y < HEIGHT && x >= 0 && x < WIDTH;
-}
-
-// Swap two integers
-void swap(int* a, int* b) {
-    int temp = *a;
-    *a = *b;
-    *b = temp;
-}
-
-// Generate maze using randomized DFS
-void generateMazeRecursive(Maze* maze, int y, int x) {
-    // Mark current cell as visited
-    maze->grid[y][x] = EMPTY;
-    
-    // Directions: up, right, down, left
-    int dy[4] = {-2, 0, 2, 0};
-    int dx[4] = {0, 2, 0, -2};
-    
-    // Shuffle directions
-    for (int i = 0; i < 4; i++) {
-        int r = rand() % 4;
-        swap(&dy[i], &dy[r]);
-        swap(&dx[i], &dx[r]);
-    }
-    
-    // Explore in each direction
-    for (int i = 0; i < 4; i++) {
-        int ny = y + dy[i];
-        int nx = x + dx[i];
-        
-        if (isValid(ny, nx) && maze->grid[ny][nx] == WALL) {
-            // Create passage
-            maze->grid[y + dy[i]/2][x + dx[i]/2] = EMPTY;
-            generateMazeRecursive(maze, ny, nx);
-        }
-    }
-}
-
-// Initialize and generate a new maze
-void initializeMaze(Maze* maze) {
-    // Fill maze with walls
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            maze->grid[y][x] = WALL;
-        }
-    }
-    
-    // Set start position
-    maze->startY = 1;
-    maze->startX = 1;
-    
-    // Generate maze
-    generateMazeRecursive(maze, maze->startY, maze->startX);
-    
-    // Place exit at a random position on the edge
-    do {
-        int side = rand() % 4;
-        switch (side) {
-            case 0: // Top
-                maze->exitY = 0;
-                maze->exitX = 1 + 2 * (rand() % ((WIDTH-1)/2));
-                break;
-            case 1: // Right
-                maze->exitY = 1 + 2 * (rand() % ((HEIGHT-1)/2));
-                maze->exitX = WIDTH - 1;
-                break;
-            case 2: // Bottom
-                maze->exitY = HEIGHT - 1;
-                maze->exitX = 1 + 2 * (rand() % ((WIDTH-1)/2));
-                break;
-            case 3: // Left
-                maze->exitY = 1 + 2 * (rand() % ((HEIGHT-1)/2));
-                maze->exitX = 0;
-                break;
-        }
-    } while (maze->grid[maze->exitY][maze->exitX] == WALL);
-    
-    // Mark the exit
-    maze->grid[maze->exitY][maze->exitX] = EXIT;
-}
-
-// Try to move player in a direction
-bool movePlayer(Maze* maze, int* playerY, int* playerX, int direction, int* movesLeft) {
-    int newY = *playerY;
-    int newX = *playerX;
-    
-    switch (direction) {
-        case UP:    newY--; break;
-        case DOWN:  newY++; break;
-        case LEFT:  newX--; break;
-        case RIGHT: newX++; break;
-    }
-    
-    if (!isValid(newY, newX) || maze->grid[newY][newX] == WALL) {
-        return false;
-    }
-    
-    // Update player position
-    *playerY = newY;
-    *playerX = newX;
-    
-    (*movesLeft)--; // Decrement remaining moves
-    return true;
-}
-
-// Roll dice to determine moves
-int rollDice() {
-    int die1 = rand() % 6 + 1;
-    int die2 = rand() % 6 + 1;
-    return die1 + die2;
-}
-
-// Draw the entire maze
-void drawMaze(Maze* maze, int survivorY, int survivorX, int killerY, int killerX,
-              int survivorMovesLeft, int killerMovesLeft, int currentTurn) {
-    clear();
-    
-    // Display maze
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            char cell = maze->grid[y][x];
-            
-            if (y == survivorY && x == survivorX) {
-                attron(A_BOLD | COLOR_PAIR(1));
-                mvaddch(y, x, SURVIVOR);
-                attroff(A_BOLD | COLOR_PAIR(1));
-            } else if (y == killerY && x == killerX) {
-                attron(A_BOLD | COLOR_PAIR(3));
-                mvaddch(y, x, KILLER);
-                attroff(A_BOLD | COLOR_PAIR(3));
-            } else if (cell == EXIT) {
-                attron(COLOR_PAIR(2));
-                mvaddch(y, x, EXIT);
-                attroff(COLOR_PAIR(2));
-            } else if (cell == WALL) {
-                attron(COLOR_PAIR(4));
-                mvaddch(y, x, cell);
-                attroff(COLOR_PAIR(4));
-            } else {
-                mvaddch(y, x, cell);
-            }
-        }
-    }
-    
-    // Display status info
-    attron(COLOR_PAIR(5));
-    if (currentTurn == SURVIVOR_TURN) {
-        attron(COLOR_PAIR(1) | A_BOLD);
-        mvprintw(HEIGHT + 1, 0, "SURVIVOR'S TURN");
-        attroff(COLOR_PAIR(1) | A_BOLD);
-        attron(COLOR_PAIR(5));
-        mvprintw(HEIGHT + 1, 17, " (Use arrow keys) - Moves left: %d", survivorMovesLeft);
-    } else {
-        attron(COLOR_PAIR(3) | A_BOLD);
-        mvprintw(HEIGHT + 1, 0, "KILLER'S TURN");
-        attroff(COLOR_PAIR(3) | A_BOLD);
-        attron(COLOR_PAIR(5));
-        mvprintw(HEIGHT + 1, 14, " (Use WASD keys) - Moves left: %d", killerMovesLeft);
-    }
-    
-    mvprintw(HEIGHT + 2, 0, "Survivor: Arrow keys | Killer: WASD | End Turn: Space | Quit: q");
-    attroff(COLOR_PAIR(5));
-    
-    refresh();
-}
+#include "udp.h"
+#include "maze.h"
+#include "render.h"
+#include "engine.h"
+#include "bot.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "pool.h"
+#include "metrics.h"
 
 // Display game over message and wait for input
 bool gameOverScreen(bool survivorWon) {
     clear();
+    invalidateMazeView();
     
     if (survivorWon) {
         attron(COLOR_PAIR(1) | A_BOLD);
-        mvprintw(HEIGHT/2 - 1, WIDTH/2 - 10, "SURVIVOR ESCAPED!");
+        mvprintw(DEFAULT_HEIGHT/2 - 1, DEFAULT_WIDTH/2 - 10, "SURVIVOR ESCAPED!");
         attroff(COLOR_PAIR(1) | A_BOLD);
     } else {
         attron(COLOR_PAIR(3) | A_BOLD);
-        mvprintw(HEIGHT/2 - 1, WIDTH/2 - 8, "KILLER WINS!");
+        mvprintw(DEFAULT_HEIGHT/2 - 1, DEFAULT_WIDTH/2 - 8, "KILLER WINS!");
         attroff(COLOR_PAIR(3) | A_BOLD);
     }
     
     attron(COLOR_PAIR(5));
-    mvprintw(HEIGHT/2 + 1, WIDTH/2 - 13, "Press 'P' to play again");
-    mvprintw(HEIGHT/2 + 2, WIDTH/2 - 13, "Press any other key to exit");
+    mvprintw(DEFAULT_HEIGHT/2 + 1, DEFAULT_WIDTH/2 - 13, "Press 'P' to play again");
+    mvprintw(DEFAULT_HEIGHT/2 + 2, DEFAULT_WIDTH/2 - 13, "Press any other key to exit");
     attroff(COLOR_PAIR(5));
     
     refresh();
@@ -234,49 +45,81 @@ bool gameOverScreen(bool survivorWon) {
 // Display waiting message during opponent's turn
 void displayTurnChange(int newTurn) {
     clear();
+    invalidateMazeView();
     if (newTurn == SURVIVOR_TURN) {
         attron(COLOR_PAIR(1) | A_BOLD);
-        mvprintw(HEIGHT/2, WIDTH/2 - 18, "SURVIVOR'S TURN - PRESS ANY KEY TO START");
+        mvprintw(DEFAULT_HEIGHT/2, DEFAULT_WIDTH/2 - 18, "SURVIVOR'S TURN - PRESS ANY KEY TO START");
         attroff(COLOR_PAIR(1) | A_BOLD);
     } else {
         attron(COLOR_PAIR(3) | A_BOLD);
-        mvprintw(HEIGHT/2, WIDTH/2 - 17, "KILLER'S TURN - PRESS ANY KEY TO START");
+        mvprintw(DEFAULT_HEIGHT/2, DEFAULT_WIDTH/2 - 17, "KILLER'S TURN - PRESS ANY KEY TO START");
         attroff(COLOR_PAIR(3) | A_BOLD);
     }
     refresh();
     getch(); // Wait for key press
 }
 
-// Relocates the Exit every 5 rounds
-void relocateExit(Maze* maze) {
-    // Remove the old exit if it's still marked
-    if (maze->grid[maze->exitY][maze->exitX] == EXIT) {
-        maze->grid[maze->exitY][maze->exitX] = EMPTY;
-    }
-
-    // Pick a new random empty location anywhere in the maze 
-    do {
-        maze->exitY = rand() % HEIGHT;
-        maze->exitX = rand() % WIDTH;
-    } while (maze->grid[maze->exitY][maze->exitX] != EMPTY ||
-             (maze->exitY == maze->startY && maze->exitX == maze->startX));
-
-    maze->grid[maze->exitY][maze->exitX] = EXIT;
-}
-
 // Add these new functions for network play
 bool isNetworkMode = false;
 int networkSocket = -1;
 bool isServer = false;
+bool isDedicatedMode = false;
+bool isSpectatorMode = false;
+char dedicatedServerIP[16];
+int dedicatedServerPort = PORT; // Game port of the dedicated server; spectating and resuming use offsets from it
+int botRole = -1;           // Role played by the computer in local play, or -1
+
+// Games the background pool keeps ready for a rematch
+#define CLIENT_POOL_GAMES 2
+
+// Pause between computer moves so they can be followed on screen
+#define BOT_STEP_DELAY_MS 150
+
+// Ask which transport a lockstep game runs over; UDP keeps a lost packet
+// from stalling every move behind it
+bool chooseUdp(int row) {
+    mvprintw(row, 0, "Transport: (T)CP or (U)DP? ");
+    refresh();
+    int transport = getch();
+    return transport == 'u' || transport == 'U';
+}
+
+// Split "IP" or "IP:port" into dedicatedServerIP and dedicatedServerPort
+bool parseServerAddress(const char* address) {
+    const char* colon = strchr(address, ':');
+    size_t length = colon != NULL ? (size_t)(colon - address) : strlen(address);
+    if (length >= sizeof(dedicatedServerIP)) {
+        return false;
+    }
+    memcpy(dedicatedServerIP, address, length);
+    dedicatedServerIP[length] = '\0';
+    dedicatedServerPort = PORT;
+    if (colon != NULL) {
+        char* end;
+        long port = strtol(colon + 1, &end, 10);
+        if (*end != '\0' || port <= 0 || port > 65535 - RESUME_PORT_OFFSET) {
+            return false;
+        }
+        dedicatedServerPort = (int)port;
+    }
+    return true;
+}
 
 void initializeNetworkMode() {
     char choice;
+    isNetworkMode = false;
+    isDedicatedMode = false;
+    isSpectatorMode = false;
+    botRole = -1;
     clear();
     mvprintw(0, 0, "Select network mode:");
     mvprintw(1, 0, "1. Host game (Server)");
     mvprintw(2, 0, "2. Join game (Client)");
     mvprintw(3, 0, "3. Local play");
-    mvprintw(4, 0, "Enter choice (1-3): ");
+    mvprintw(4, 0, "4. Join dedicated server");
+    mvprintw(5, 0, "5. Play against the computer");
+    mvprintw(6, 0, "6. Watch dedicated server matches");
+    mvprintw(7, 0, "Enter choice (1-6): ");
     refresh();
     
     choice = getch();
@@ -284,287 +127,653 @@ void initializeNetworkMode() {
         case '1':
             isServer = true;
             isNetworkMode = true;
-            networkSocket = createServer();
+            networkSocket = chooseUdp(8) ? udpHost(PORT) : createServer();
             if (networkSocket < 0) {
-                mvprintw(5, 0, "Failed to create server. Press any key to exit.");
+                mvprintw(9, 0, "Failed to create server. Press any key to exit.");
                 getch();
                 endwin();
                 exit(1);
             }
             break;
-        case '2':
+        case '2': {
             isServer = false;
             isNetworkMode = true;
+            bool udp = chooseUdp(8);
             char ip[16];
-            mvprintw(5, 0, "Enter server IP: ");
+            mvprintw(9, 0, "Enter server IP: ");
             echo();
-            getstr(ip);
+            getnstr(ip, sizeof(ip) - 1);
             noecho();
-            networkSocket = connectToServer(ip);
+            networkSocket = udp ? udpJoin(ip, PORT) : connectToServer(ip);
             if (networkSocket < 0) {
-                mvprintw(6, 0, "Failed to connect to server. Press any key to exit.");
+                mvprintw(10, 0, "Failed to connect to server. Press any key to exit.");
                 getch();
                 endwin();
                 exit(1);
             }
             break;
+        }
+        case '4':
+        case '6':
+            isDedicatedMode = (choice == '4');
+            isSpectatorMode = (choice == '6');
+            mvprintw(8, 0, "Enter server IP[:port]: ");
+            echo();
+            char address[32];
+            getnstr(address, sizeof(address) - 1);
+            noecho();
+            if (!parseServerAddress(address)) {
+                mvprintw(9, 0, "Invalid server address. Press any key to exit.");
+                getch();
+                endwin();
+                exit(1);
+            }
+            networkSocket = connectToServerPort(dedicatedServerIP, dedicatedServerPort +
+                                                (isSpectatorMode ? SPECTATOR_PORT_OFFSET : 0));
+            if (networkSocket < 0) {
+                mvprintw(9, 0, "Failed to connect to server. Press any key to exit.");
+                getch();
+                endwin();
+                exit(1);
+            }
+            break;
+        case '5': {
+            mvprintw(8, 0, "Play as (S)urvivor or (K)iller? ");
+            refresh();
+            int side = getch();
+            botRole = (side == 'k' || side == 'K') ? SURVIVOR_TURN : KILLER_TURN;
+            break;
+        }
         default:
             isNetworkMode = false;
             break;
     }
 }
 
+// Map a key to a dedicated-server action for the given role, or -1
+int keyToAction(int ch, int role) {
+    if (ch == 'q' || ch == 'Q') return ACTION_QUIT;
+    if (ch == ' ') return ACTION_END_TURN;
+
+    if (role == SURVIVOR_TURN) {
+        switch (ch) {
+            case KEY_UP:    return ACTION_UP;
+            case KEY_DOWN:  return ACTION_DOWN;
+            case KEY_LEFT:  return ACTION_LEFT;
+            case KEY_RIGHT: return ACTION_RIGHT;
+        }
+    } else {
+        switch (ch) {
+            case 'w': case 'W': return ACTION_UP;
+            case 's': case 'S': return ACTION_DOWN;
+            case 'a': case 'A': return ACTION_LEFT;
+            case 'd': case 'D': return ACTION_RIGHT;
+        }
+    }
+    return -1;
+}
+
+// What woke waitForEvent()
+#define EVENT_ERROR -1
+#define EVENT_TIMEOUT 0
+#define EVENT_KEY 1
+#define EVENT_SOCKET 2
+
+// Refresh period of the "waiting" line while the opponent moves
+#define WAIT_TICK_MS 1000
+
+long nowMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+// Wait for a key press or data on the socket, whichever comes first, for at
+// most timeoutMs (-1 waits forever). Keys ncurses has already buffered count
+// as pressed. The key is stored in *key for EVENT_KEY.
+int waitForEvent(int socket, int timeoutMs, int* key) {
+    timeout(0);
+    *key = getch();
+    if (*key == ERR) {
+        struct pollfd fds[2];
+        fds[0].fd = STDIN_FILENO;
+        fds[0].events = POLLIN;
+        fds[1].fd = socket;
+        fds[1].events = POLLIN;
+
+        int ready = poll(fds, 2, timeoutMs);
+        if (ready < 0 && errno != EINTR) {
+            timeout(-1);
+            return EVENT_ERROR;
+        }
+        if (ready > 0 && fds[1].revents != 0) {
+            timeout(-1);
+            return EVENT_SOCKET;
+        }
+        if (ready > 0 && fds[0].revents != 0) {
+            *key = getch();
+        }
+    }
+    timeout(-1);
+    return *key == ERR ? EVENT_TIMEOUT : EVENT_KEY;
+}
+
+// Pause between attempts to get a match back after the connection dropped
+#define RESUME_RETRY_MS 500
+
+// The connection to the dedicated server dropped mid-match: ask for the match
+// back until the server takes us or its grace period is over; 'q' gives up.
+// Returns true with networkSocket connected again.
+bool rejoinMatch(Maze* maze, const ResumeRequest* resume) {
+    closeConnection(networkSocket);
+    networkSocket = -1;
+    if (resume->session[0] == 0 && resume->session[1] == 0) {
+        return false; // Not in a match yet, there is nothing to resume
+    }
+
+    showMazeMessage(maze, "Connection lost, reconnecting... (q gives up)");
+    long deadline = nowMs() + RESUME_GRACE_SECONDS * 1000L;
+    while (nowMs() < deadline) {
+        long attempt = nowMs();
+        networkSocket = resumeSession(dedicatedServerIP, dedicatedServerPort, resume, RESUME_RETRY_MS);
+        if (networkSocket >= 0) {
+            return true;
+        }
+        long left = attempt + RESUME_RETRY_MS - nowMs();
+        timeout(left > 0 ? (int)left : 0);
+        int key = getch();
+        timeout(-1);
+        if (key == 'q' || key == 'Q') {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Play one match on a dedicated server; returns the final STATUS_ value or -1 on network error
+int playDedicatedMatch() {
+    GameState state = {0};
+    Maze maze = {0};
+    Fov fov = {0};              // What we have seen, if the server plays with fog of war
+    bool fogged = false;
+    int result = -1;
+
+    bool haveState = false;
+    uint64_t actionSent = 0;    // When the last move went out, until the server answers
+    ResumeRequest resume;       // Gets the match back if the connection drops
+    memset(&resume, 0, sizeof(resume));
+    bool lost = false;
+
+    while (1) {
+        if (lost) {
+            if (!rejoinMatch(&maze, &resume)) {
+                break;
+            }
+            lost = false;
+            actionSent = 0;
+            // Repaint over anything printed about the lost connection
+            clearok(curscr, TRUE);
+            invalidateMazeView();
+            drawMaze(&maze, state.survivorY, state.survivorX, state.killerY, state.killerX,
+                     state.survivorMovesLeft, state.killerMovesLeft, state.currentTurn);
+            showMazeMessage(&maze, state.currentTurn == state.role ? "" : "Waiting for opponent's move...");
+        }
+
+        int key;
+        int event = waitForEvent(networkSocket, -1, &key);
+        if (event == EVENT_ERROR) {
+            lost = true;
+            continue;
+        }
+
+        if (event == EVENT_KEY) {
+            int action = keyToAction(key, haveState ? state.role : SURVIVOR_TURN);
+            if (key == KEY_RESIZE && haveState) {
+                invalidateMazeView();
+                drawMaze(&maze, state.survivorY, state.survivorX, state.killerY, state.killerX,
+                         state.survivorMovesLeft, state.killerMovesLeft, state.currentTurn);
+            }
+            // Quitting is allowed at any time, moves only on our turn
+            if (action == ACTION_QUIT || (action >= 0 && haveState && state.currentTurn == state.role)) {
+                actionSent = metricsNow();
+                if (sendAction(networkSocket, action) < 0 && action != ACTION_QUIT) {
+                    lost = true;
+                    continue;
+                }
+                if (action == ACTION_QUIT) {
+                    result = STATUS_ABORTED;
+                    break;
+                }
+            }
+            continue;
+        }
+        if (event != EVENT_SOCKET) {
+            continue;
+        }
+
+        GameState received;
+        if (receiveGameState(networkSocket, &received, &maze, &fov) <= 0) {
+            lost = true;
+            continue;
+        }
+        state = received;
+        if (state.session[0] != 0 || state.session[1] != 0) {
+            memcpy(resume.session, state.session, sizeof(resume.session));
+            resume.sequence = state.sequence;
+        }
+        if (actionSent != 0) {
+            metricsRecord(METRIC_ROUND_TRIP, actionSent);
+        }
+        if (state.status == STATUS_WAITING) {
+            clear();
+            invalidateMazeView();
+            attron(COLOR_PAIR(5));
+            mvprintw(0, 0, "Waiting for an opponent...");
+            attroff(COLOR_PAIR(5));
+            refresh();
+            continue;
+        }
+        if (state.status != STATUS_PLAYING) {
+            result = state.status;
+            break;
+        }
+
+        // The server is authoritative; draw exactly what it sent
+        haveState = true;
+        if (state.view != VIEW_UNCHANGED) {
+            fogged = (state.view == VIEW_FOG);
+        }
+        setMazeFog(fogged ? &fov : NULL);
+        drawMaze(&maze, state.survivorY, state.survivorX, state.killerY, state.killerX,
+                 state.survivorMovesLeft, state.killerMovesLeft, state.currentTurn);
+        if (actionSent != 0) {
+            metricsRecord(METRIC_KEY_TO_RENDER, actionSent);
+            actionSent = 0;
+        }
+        showMazeMessage(&maze, state.currentTurn == state.role ? "" : "Waiting for opponent's move...");
+    }
+
+    setMazeFog(NULL);
+    freeFov(&fov);
+    freeMaze(&maze);
+    return result;
+}
+
+// Apply a local action in a lockstep game and send it to the peer. Returns
+// a message that ends the game, or NULL to keep playing.
+const char* playLocalAction(Game* game, JournalWriter* journal, int action) {
+    int previousTurn = game->currentTurn;
+
+    Record record;
+    record.type = RECORD_INPUT;
+    record.action = action;
+    journalAction(journal, action);
+    record.dice = applyAction(game, action);
+
+    bool sent = sendRecord(networkSocket, &record) >= 0;
+
+    // A hash at every turn end lets the peer detect a desync
+    if (sent && game->currentTurn != previousTurn) {
+        record.type = RECORD_HASH;
+        record.value = hashGame(game);
+        sent = sendRecord(networkSocket, &record) >= 0;
+    }
+    if (!sent) {
+        return "Network error. Game will exit.";
+    }
+    return action == ACTION_QUIT ? "You left the game." : NULL;
+}
+
+// Read one record from the peer and replay its action through the same rules.
+// Returns a message that ends the game, or NULL to keep playing.
+const char* playRemoteRecord(Game* game, JournalWriter* journal, bool localTurn) {
+    int previousTurn = game->currentTurn;
+
+    Record record;
+    if (receiveRecord(networkSocket, &record) <= 0) {
+        return "Opponent left the game.";
+    }
+    if (record.type != RECORD_INPUT) {
+        return NULL;
+    }
+    journalAction(journal, record.action);
+    if (record.action == ACTION_QUIT) {
+        return "Opponent left the game.";
+    }
+    if (localTurn || applyAction(game, record.action) != record.dice) {
+        return "Game out of sync with opponent. Game will exit.";
+    }
+    if (game->currentTurn != previousTurn) {
+        // Every turn end is followed by the sender's state hash
+        if (receiveRecord(networkSocket, &record) <= 0) {
+            return "Opponent left the game.";
+        }
+        if (record.type != RECORD_HASH || record.value != hashGame(game)) {
+            return "Game out of sync with opponent. Game will exit.";
+        }
+    }
+    return NULL;
+}
+
+// Watch a dedicated server's matches one after another until q is pressed
+void watchDedicatedMatches() {
+    GameState state;
+    Maze maze = {0};
+    bool newMatch = true;   // The next state starts a match we have not drawn yet
+
+    clear();
+    attron(COLOR_PAIR(5));
+    mvprintw(0, 0, "Waiting for a match to start... (q to stop watching)");
+    attroff(COLOR_PAIR(5));
+    refresh();
+
+    while (1) {
+        int key;
+        int event = waitForEvent(networkSocket, -1, &key);
+        if (event == EVENT_ERROR || (event == EVENT_KEY && (key == 'q' || key == 'Q'))) {
+            break;
+        }
+        if (event == EVENT_KEY && key == KEY_RESIZE) {
+            newMatch = true;
+        }
+        if (event != EVENT_SOCKET) {
+            continue;
+        }
+        if (receiveGameState(networkSocket, &state, &maze, NULL) <= 0) {
+            break;
+        }
+
+        if (newMatch) {
+            invalidateMazeView();
+        }
+        drawMaze(&maze, state.survivorY, state.survivorX, state.killerY, state.killerX,
+                 state.survivorMovesLeft, state.killerMovesLeft, state.currentTurn);
+
+        newMatch = (state.status != STATUS_PLAYING);
+        if (state.status == STATUS_SURVIVOR_WON) {
+            showMazeMessage(&maze, "Survivor escaped! Waiting for the next match... (q to stop)");
+        } else if (state.status == STATUS_KILLER_WON) {
+            showMazeMessage(&maze, "Killer wins! Waiting for the next match... (q to stop)");
+        } else if (state.status != STATUS_PLAYING) {
+            showMazeMessage(&maze, "Match abandoned. Waiting for the next match... (q to stop)");
+        } else {
+            showMazeMessage(&maze, "Spectating (q to stop)");
+        }
+    }
+
+    freeMaze(&maze);
+}
+
+// Offer to resume the local match a quit or crash left behind. Returns true
+// with the game and its journal rebuilt from its snapshot if the player takes it.
+bool offerSnapshot(Game* game, JournalWriter* journal) {
+    if (loadSnapshot(game, NULL, journal, SNAPSHOT_FILE) < 0) {
+        return false;
+    }
+    clear();
+    attron(COLOR_PAIR(5));
+    mvprintw(0, 0, "An unfinished %dx%d game was saved at turn %d.", game->maze.height, game->maze.width,
+             game->turnCounter);
+    mvprintw(1, 0, "Resume it? (y/n) ");
+    attroff(COLOR_PAIR(5));
+    refresh();
+    int answer = getch();
+    if (answer == 'y' || answer == 'Y') {
+        return true;
+    }
+    freeMaze(&game->maze);
+    journalDiscard(journal);
+    unlink(SNAPSHOT_FILE);
+    return false;
+}
+
 // Modify the runGame function to handle network play
 void runGame() {
     bool playAgain = true;
     
-    // Initialize ncurses
-    initscr();
-    cbreak();
-    noecho();
-    keypad(stdscr, TRUE);
-    curs_set(0); // Hide cursor
-    
-    // Initialize colors if terminal supports them
-    if (has_colors()) {
-        start_color();
-        use_default_colors(); // Use terminal default colors
-        
-        init_pair(1, COLOR_GREEN, COLOR_BLACK);  // Survivor
-        init_pair(2, COLOR_CYAN, COLOR_BLACK);   // Exit
-        init_pair(3, COLOR_RED, COLOR_BLACK);    // Killer
-        init_pair(4, COLOR_WHITE, COLOR_BLACK);  // Wall
-        init_pair(5, COLOR_YELLOW, COLOR_BLACK); // Status text
-    }
-    
+    // The screen was set up once by initScreen() and stays up between sessions
     initializeNetworkMode();
 
+    // Seeds for the games of this session; each game gets its own
+    Rng seedRng;
+    rngSeed(&seedRng, ((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid());
+
+    // Whoever picks the seed builds the next games in the background, so a
+    // rematch starts at once; a lockstep client follows the host's seed
+    GamePool pool;
+    bool usePool = !isDedicatedMode && !isSpectatorMode && (!isNetworkMode || isServer);
+    if (usePool) {
+        startGamePool(&pool, CLIENT_POOL_GAMES, mazeHeight, mazeWidth, rngNext(&seedRng));
+    }
+
     while (playAgain) {
-        Maze maze;
-        int survivorY, survivorX;
-        int killerY, killerX;
-        bool gameOver = false;
-        int survivorMovesLeft = 0;
-        int killerMovesLeft = 0;
-        bool survivorWon = false;
-        int currentTurn = SURVIVOR_TURN; // Survivor goes first
-        
-        // Initialize maze
-        initializeMaze(&maze);
-        
-        // Initialize player positions
-        survivorY = maze.startY;
-        survivorX = maze.startX;
-        
-        // Place killer at a random valid position far from survivor
-        do {
-            killerY = 1 + 2 * (rand() % ((HEIGHT-1)/2));
-            killerX = 1 + 2 * (rand() % ((WIDTH-1)/2));
-        } while (maze.grid[killerY][killerX] == WALL || 
-                (abs(killerY - survivorY) + abs(killerX - survivorX) < 10));
-        
-        // Initial dice rolls
-        survivorMovesLeft = rollDice();
-        killerMovesLeft = rollDice();
-        
-        // Reset turn counter
-        turnCounter = 0;
-        lastRelocatedTurn = -10;
-                
+        if (isSpectatorMode) {
+            watchDedicatedMatches();
+            closeConnection(networkSocket);
+            networkSocket = -1;
+            break;
+        }
+        if (isDedicatedMode) {
+            int status = playDedicatedMatch();
+            closeConnection(networkSocket);
+            networkSocket = -1;
+            dumpMetrics(METRICS_FILE, "dedicated server match");
+
+            if (status == STATUS_SURVIVOR_WON || status == STATUS_KILLER_WON) {
+                playAgain = gameOverScreen(status == STATUS_SURVIVOR_WON);
+            } else {
+                clear();
+                attron(COLOR_PAIR(5));
+                mvprintw(0, 0, status < 0 ? "Network error. Game will exit." : "The match was abandoned.");
+                attroff(COLOR_PAIR(5));
+                refresh();
+                getch();
+                playAgain = false;
+            }
+
+            // Each match is a fresh connection to the server
+            if (playAgain) {
+                networkSocket = connectToServerPort(dedicatedServerIP, dedicatedServerPort);
+                playAgain = (networkSocket >= 0);
+            }
+            continue;
+        }
+
+        Game game;
+        Bot bot;
+        JournalWriter journal;
+        int localRole = isServer ? SURVIVOR_TURN : KILLER_TURN;
+        const char* networkMessage = NULL;
+        int height = mazeHeight;
+        int width = mazeWidth;
+        unsigned int seed = rngNext(&seedRng);
+
+        // Local matches are snapshotted at every turn end, so one cut short
+        // can be picked up again; lockstep peers would have to resume together
+        bool saving = !isNetworkMode;
+        bool resumed = saving && offerSnapshot(&game, &journal);
+        bool quit = false;
+        bool pooled = !resumed && usePool && takePooledGame(&pool, &game);
+        if (pooled) {
+            seed = (unsigned int)game.seed;
+        }
+
+        // Peers agree on a seed so they generate identical mazes, spawns and rolls
+        if (isNetworkMode) {
+            Record record;
+            if (isServer) {
+                record.type = RECORD_SEED;
+                record.value = seed;
+                record.height = height;
+                record.width = width;
+                if (sendRecord(networkSocket, &record) < 0) {
+                    networkMessage = "Network error. Game will exit.";
+                }
+            } else if (receiveRecord(networkSocket, &record) <= 0 || record.type != RECORD_SEED) {
+                networkMessage = "Opponent left the game.";
+            } else {
+                // The host decides the seed and the maze size
+                seed = record.value;
+                height = record.height;
+                width = record.width;
+                if (height < MIN_MAZE_SIZE || width < MIN_MAZE_SIZE ||
+                    height > MAX_STREAM_HEIGHT || width > MAX_MAZE_SIZE) {
+                    networkMessage = "Opponent sent an invalid maze size.";
+                }
+            }
+            if (networkMessage != NULL) {
+                if (pooled) {
+                    freeMaze(&game.maze);
+                }
+                clear();
+                mvprintw(0, 0, "%s", networkMessage);
+                getch();
+                break;
+            }
+        }
+
+        if (!resumed && !pooled && setupGame(&game, height, width, seed) < 0) {
+            clear();
+            mvprintw(0, 0, "Not enough memory for a %dx%d maze.", height, width);
+            getch();
+            break;
+        }
+        invalidateMazeView();
+        initBot(&bot);
+        if (!resumed) {
+            journalStart(&journal, &game);
+        }
+
+        // Under fog of war each side has its own view; the screen shows the
+        // local player's, or in a shared-keyboard game whoever's turn it is
+        Fov views[2];
+        bool fog = fogEnabled();
+        if (fog && (initFov(&views[SURVIVOR_TURN], &game.maze) < 0 ||
+                    initFov(&views[KILLER_TURN], &game.maze) < 0)) {
+            freeFov(&views[SURVIVOR_TURN]);
+            fog = false;
+        }
+
+        long turnStartMs = nowMs();
+        uint64_t keyPressed = 0;    // When the key behind the next frame was read, or 0
+
         // Announce first turn
-        displayTurnChange(currentTurn);
+        if ((!isNetworkMode || game.currentTurn == localRole) && game.currentTurn != botRole) {
+            displayTurnChange(game.currentTurn);
+        }
         
         // Game loop
-        while (!gameOver) {
-            drawMaze(&maze, survivorY, survivorX, killerY, killerX, 
-                    survivorMovesLeft, killerMovesLeft, currentTurn);
-                    
-            // Checks if turn counter is multiple by 10 or greater than 10 and if turn counter is not equal to lastRelocatedTurn        
-            if (turnCounter > 0 && turnCounter % 10 == 0 && turnCounter != lastRelocatedTurn) {
-                relocateExit(&maze);
-                lastRelocatedTurn = turnCounter;
+        while (!game.gameOver) {
+            if (fog) {
+                int viewer = botRole >= 0 ? 1 - botRole : isNetworkMode ? localRole : game.currentTurn;
+                updateFov(&views[viewer], &game.maze, viewer == SURVIVOR_TURN ? game.survivorY : game.killerY,
+                          viewer == SURVIVOR_TURN ? game.survivorX : game.killerX);
+                setMazeFog(&views[viewer]);
             }
-                        
-            int ch = getch();
-            
-            // Handle input based on whose turn it is
-            if (currentTurn == SURVIVOR_TURN) {
-                // Survivor's turn - process survivor controls
-                switch (ch) {
-                    case KEY_UP:
-                        if (survivorMovesLeft > 0) {
-                            movePlayer(&maze, &survivorY, &survivorX, UP, &survivorMovesLeft);
-                        }
-                        break;
-                    case KEY_DOWN:
-                        if (survivorMovesLeft > 0) {
-                            movePlayer(&maze, &survivorY, &survivorX, DOWN, &survivorMovesLeft);
-                        }
-                        break;
-                    case KEY_LEFT:
-                        if (survivorMovesLeft > 0) {
-                            movePlayer(&maze, &survivorY, &survivorX, LEFT, &survivorMovesLeft);
-                        }
-                        break;
-                    case KEY_RIGHT:
-                        if (survivorMovesLeft > 0) {
-                            movePlayer(&maze, &survivorY, &survivorX, RIGHT, &survivorMovesLeft);
-                        }
-                        break;
-                    case ' ': // End turn manually with spacebar
-                        if (survivorMovesLeft > 0) {
-                            // End turn, forfeiting remaining moves
-                            survivorMovesLeft = 0;
-                        }
-                        break;
-                    case 'q':
-                    case 'Q':
-                        gameOver = true;
-                        playAgain = false;
-                        break;
-                }
-                
-                // Check if survivor reached the exit
-                if (survivorY == maze.exitY && survivorX == maze.exitX) {
-                    gameOver = true;
-                    survivorWon = true;
+            drawMaze(&game.maze, game.survivorY, game.survivorX, game.killerY, game.killerX, 
+                    game.survivorMovesLeft, game.killerMovesLeft, game.currentTurn);
+            if (keyPressed != 0) {
+                metricsRecord(METRIC_KEY_TO_RENDER, keyPressed);
+                keyPressed = 0;
+            }
+
+            int previousTurn = game.currentTurn;
+
+            if (game.currentTurn == botRole) {
+                // Computer move, one step at a time so it can be watched
+                refresh();
+                napms(BOT_STEP_DELAY_MS);
+                int action = botAction(&bot, &game);
+                journalAction(&journal, action);
+                applyAction(&game, action);
+            } else if (!isNetworkMode) {
+                // Local play: both players share the keyboard
+                int action = keyToAction(getch(), game.currentTurn);
+                if (action < 0) {
                     continue;
                 }
-                
-                // Check if survivor's turn is over
-                if (survivorMovesLeft <= 0 || (ch == ' ')) {
-                    // Switch to killer's turn
-                    currentTurn = KILLER_TURN;
-                    // Roll dice for killer's new turn
-                    killerMovesLeft = rollDice();
-                    // Announce killer's turn
-                    displayTurnChange(currentTurn);
-                    turnCounter++; //Increment turn counter
+                keyPressed = metricsNow();
+                if (action == ACTION_QUIT) {
+                    // Keep the moves of the turn so far for the next run
+                    saveSnapshot(&game, NULL, &journal, SNAPSHOT_FILE);
+                    quit = true;
+                    playAgain = false;
                 }
+                journalAction(&journal, action);
+                applyAction(&game, action);
             } else {
-                // Killer's turn - process killer controls
-                switch (ch) {
-                    case 'w':
-                    case 'W':
-                        if (killerMovesLeft > 0) {
-                            movePlayer(&maze, &killerY, &killerX, UP, &killerMovesLeft);
-                        }
-                        break;
-                    case 's':
-                    case 'S':
-                        if (killerMovesLeft > 0) {
-                            movePlayer(&maze, &killerY, &killerX, DOWN, &killerMovesLeft);
-                        }
-                        break;
-                    case 'a':
-                    case 'A':
-                        if (killerMovesLeft > 0) {
-                            movePlayer(&maze, &killerY, &killerX, LEFT, &killerMovesLeft);
-                        }
-                        break;
-                    case 'd':
-                    case 'D':
-                        if (killerMovesLeft > 0) {
-                            movePlayer(&maze, &killerY, &killerX, RIGHT, &killerMovesLeft);
-                        }
-                        break;
-                    case ' ': // End turn manually with spacebar
-                        if (killerMovesLeft > 0) {
-                            // End turn, forfeiting remaining moves
-                            killerMovesLeft = 0;
-                        }
-                        break;
-                    case 'q':
-                    case 'Q':
-                        gameOver = true;
-                        playAgain = false;
-                        break;
-                }
-                
-                // Check if killer caught survivor
-                if (killerY == survivorY && killerX == survivorX) {
-                    gameOver = true;
-                    survivorWon = false;
-                    continue;
-                }
-                
-                // Check if killer's turn is over
-                if (killerMovesLeft <= 0 || (ch == ' ')) {
-                    // Switch to survivor's turn
-                    currentTurn = SURVIVOR_TURN;
-                    // Roll dice for survivor's new turn
-                    survivorMovesLeft = rollDice();
-                    // Announce survivor's turn
-                    displayTurnChange(currentTurn);
-                    turnCounter++; //Increment Turn
+                // Network play: whichever of a key press or a peer record comes
+                // first is handled, so a quiet peer never freezes the screen
+                bool localTurn = (game.currentTurn == localRole);
+                if (localTurn) {
+                    showMazeMessage(&game.maze, "");
+                } else {
+                    char waiting[64];
+                    snprintf(waiting, sizeof(waiting), "Waiting for opponent's move... %lds",
+                             (nowMs() - turnStartMs) / 1000);
+                    showMazeMessage(&game.maze, waiting);
                 }
-            }
 
-            // Network synchronization after each move or turn change
-            if (isNetworkMode) {
-                GameState state;
-                if (isServer) {
-                    // Server sends state first
-                    state.survivorY = survivorY;
-                    state.survivorX = survivorX;
-                    state.killerY = killerY;
-                    state.killerX = killerX;
-                    state.currentTurn = currentTurn;
-                    state.survivorMovesLeft = survivorMovesLeft;
-                    state.killerMovesLeft = killerMovesLeft;
-                    memcpy(state.maze, maze.grid, sizeof(maze.grid));
-                    
-                    if (sendGameState(networkSocket, &state) < 0) {
-                        mvprintw(HEIGHT + 3, 0, "Network error. Game will exit.");
-                        getch();
-                        gameOver = true;
-                        playAgain = false;
-                        break;
-                    }
-                    
-                    // Receive client's state
-                    if (receiveGameState(networkSocket, &state) < 0) {
-                        mvprintw(HEIGHT + 3, 0, "Network error. Game will exit.");
-                        getch();
-                        gameOver = true;
-                        playAgain = false;
-                        break;
-                    }
-                } else {
-                    // Client receives state first
-                    if (receiveGameState(networkSocket, &state) < 0) {
-                        mvprintw(HEIGHT + 3, 0, "Network error. Game will exit.");
-                        getch();
-                        gameOver = true;
-                        playAgain = false;
-                        break;
+                int key;
+                int event = waitForEvent(networkSocket, localTurn ? -1 : WAIT_TICK_MS, &key);
+                if (event == EVENT_KEY) {
+                    int action = keyToAction(key, localRole);
+                    if (key == KEY_RESIZE) {
+                        invalidateMazeView();
                     }
-                    
-                    // Update local state
-                    survivorY = state.survivorY;
-                    survivorX = state.survivorX;
-                    killerY = state.killerY;
-                    killerX = state.killerX;
-                    currentTurn = state.currentTurn;
-                    survivorMovesLeft = state.survivorMovesLeft;
-                    killerMovesLeft = state.killerMovesLeft;
-                    memcpy(maze.grid, state.maze, sizeof(maze.grid));
-                    
-                    // Send updated state back
-                    if (sendGameState(networkSocket, &state) < 0) {
-                        mvprintw(HEIGHT + 3, 0, "Network error. Game will exit.");
-                        getch();
-                        gameOver = true;
-                        playAgain = false;
-                        break;
+                    // Quitting is allowed at any time, moves only on our turn
+                    if (action == ACTION_QUIT || (action >= 0 && localTurn)) {
+                        keyPressed = metricsNow();
+                        networkMessage = playLocalAction(&game, &journal, action);
                     }
+                } else if (event == EVENT_SOCKET) {
+                    networkMessage = playRemoteRecord(&game, &journal, localTurn);
+                } else if (event == EVENT_ERROR) {
+                    networkMessage = "Network error. Game will exit.";
                 }
             }
+
+            if (networkMessage != NULL) {
+                showMazeMessage(&game.maze, networkMessage);
+                getch();
+                playAgain = false;
+                break;
+            }
+
+            if (game.currentTurn != previousTurn) {
+                turnStartMs = nowMs();
+                if (saving && !game.gameOver) {
+                    saveSnapshot(&game, NULL, &journal, SNAPSHOT_FILE);
+                }
+            }
+
+            // Announce the new turn to whoever plays it
+            if (!game.gameOver && game.currentTurn != previousTurn && game.currentTurn != botRole &&
+                (!isNetworkMode || game.currentTurn == localRole)) {
+                displayTurnChange(game.currentTurn);
+                keyPressed = 0; // The frame after the announcement waited on another key
+            }
+        }
+
+        // Every game, finished or not, is appended to the replay journal and
+        // the latency figures so far to the metrics file
+        journalFinish(&journal, &game, JOURNAL_FILE);
+        dumpMetrics(METRICS_FILE, isNetworkMode ? "lockstep game" : "local game");
+        freeBot(&bot);
+        freeMaze(&game.maze);
+        if (fog) {
+            setMazeFog(NULL);
+            freeFov(&views[SURVIVOR_TURN]);
+            freeFov(&views[KILLER_TURN]);
+        }
+
+        if (saving && game.gameOver && !quit) {
+            unlink(SNAPSHOT_FILE);
         }
 
-        if (gameOver) {
+        if (game.gameOver && networkMessage == NULL) {
             // Show game over screen and check if player wants to play again
-            playAgain = gameOverScreen(survivorWon);
+            playAgain = gameOverScreen(game.survivorWon);
             
             // If player doesn't want to play again, exit game mode
             if (!playAgain) {
@@ -573,9 +782,10 @@ void runGame() {
         }
     }
     
-    // Clean up ncurses before returning to title screen
-    endwin();
-    
+    if (usePool) {
+        stopGamePool(&pool);
+    }
+
     // Set state back to title screen
     currentState = STATE_TITLE;
 
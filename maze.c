@@ -0,0 +1,409 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "maze.h"
+#include "stream.h"
+#include "flood.h"
+
+// Check if a coordinate is valid
+bool isValid(Maze* maze, int y, int x) {
+    return y >= 0 && y < maze->height && x >= 0 && x < maze->width;
+}
+
+// Parse a "HEIGHTxWIDTH" size such as "99x301"; tall heights stream
+bool parseMazeSize(const char* text, int* height, int* width) {
+    int h, w;
+    if (sscanf(text, "%dx%d", &h, &w) != 2 ||
+        h < MIN_MAZE_SIZE || w < MIN_MAZE_SIZE || h > MAX_STREAM_HEIGHT || w > MAX_MAZE_SIZE) {
+        return false;
+    }
+    *height = h;
+    *width = w;
+    return true;
+}
+
+// Give the maze an all-wall bitboard of the requested size, reusing the
+// current allocation when the size is unchanged
+int allocateMaze(Maze* maze, int height, int width) {
+    int stride = (width + 63) / 64;
+    if (maze->cells == NULL || maze->height != height || maze->width != width) {
+        uint64_t* cells = realloc(maze->cells, (size_t)height * stride * sizeof(uint64_t));
+        if (cells == NULL) {
+            return -1;
+        }
+        maze->cells = cells;
+        maze->height = height;
+        maze->width = width;
+        maze->stride = stride;
+    }
+    maze->generatedRows = height;
+    maze->firstRow = 0;
+    maze->rowMask = -1;
+    maze->score.exitDistance = -1;
+    maze->score.deadEnds = -1;
+    memset(maze->cells, 0, MAZE_BYTES(maze));
+    return 0;
+}
+
+// Release the maze bitboard, its open-cell index, any row generator and the
+// search scratch space
+void freeMaze(Maze* maze) {
+    freeMazeStream(maze);
+    freeMazeFlood(maze);
+    free(maze->cells);
+    free(maze->links);
+    maze->cells = NULL;
+    maze->links = NULL;
+}
+
+// Bitmask of the open neighbours of (y, x), one DIR_BIT per direction
+int mazeOpenNeighbors(const Maze* maze, int y, int x) {
+    int mask = 0;
+    if (mazeIsOpen(maze, y - 1, x)) mask |= DIR_BIT(UP);
+    if (mazeIsOpen(maze, y + 1, x)) mask |= DIR_BIT(DOWN);
+    if (mazeIsOpen(maze, y, x - 1)) mask |= DIR_BIT(LEFT);
+    if (mazeIsOpen(maze, y, x + 1)) mask |= DIR_BIT(RIGHT);
+    return mask;
+}
+
+// Character for drawing a cell (players are drawn on top by the caller)
+char mazeCellChar(const Maze* maze, int y, int x) {
+    if (y == maze->exitY && x == maze->exitX) {
+        return EXIT;
+    }
+    return mazeIsOpen(maze, y, x) ? EMPTY : WALL;
+}
+
+// Steps between rooms, in the order up, right, down, left, so the opposite
+// of direction d is (d + 2) % 4. Halved, they lead to the passage between.
+static const int dy[4] = {-2, 0, 2, 0};
+static const int dx[4] = {0, 2, 0, -2};
+
+// Rooms are numbered row by row from the start room at (1, 1), or from the
+// first room row still held by a streaming maze's window
+static inline int roomCols(const Maze* maze) {
+    return maze->width / 2;
+}
+
+static inline int roomCount(const Maze* maze) {
+    return (maze->generatedRows / 2 - maze->firstRow / 2) * (maze->width / 2);
+}
+
+static inline int roomAt(const Maze* maze, int y, int x) {
+    return (y / 2 - maze->firstRow / 2) * roomCols(maze) + x / 2;
+}
+
+static inline int roomY(const Maze* maze, int room) {
+    return 1 + 2 * (room / roomCols(maze) + maze->firstRow / 2);
+}
+
+// Direction from a room to the room the generator reached it from
+static inline int roomLink(const Maze* maze, int room) {
+    return (maze->links[room >> 2] >> ((room & 3) * 2)) & 3;
+}
+
+static inline void setRoomLink(Maze* maze, int room, int direction) {
+    maze->links[room >> 2] |= (uint8_t)(direction << ((room & 3) * 2));
+}
+
+// Direction from an open cell one step towards the start along the
+// generator's tree: a room leads to its parent room, a passage to whichever
+// of its two rooms is the other's parent, and the exit's door to its room.
+// -1 for the start, or when the maze has no links.
+int mazeParentDirection(const Maze* maze, int y, int x) {
+    static const int linkDirection[4] = {UP, RIGHT, DOWN, LEFT};
+    if (maze->links == NULL || (y == maze->startY && x == maze->startX)) {
+        return -1;
+    }
+    if (y & x & 1) {
+        return linkDirection[roomLink(maze, roomAt(maze, y, x))];
+    }
+    if (y & 1) {
+        // Between the rooms to its left and right, unless it is a door in the border
+        if (x == 0 || x + 1 >= maze->width) {
+            return x == 0 ? RIGHT : LEFT;
+        }
+        return roomLink(maze, roomAt(maze, y, x + 1)) == 3 ? LEFT : RIGHT;
+    }
+    if (y == 0 || y + 1 >= maze->height) {
+        return y == 0 ? DOWN : UP;
+    }
+    return roomLink(maze, roomAt(maze, y + 1, x)) == 0 ? UP : DOWN;
+}
+
+// Generate maze using randomized DFS with an explicit stack, so large mazes
+// cannot overflow the call stack
+static int generateMaze(Maze* maze, Rng* rng) {
+    // Every odd/odd cell is pushed at most once
+    size_t capacity = (size_t)((maze->height + 1) / 2) * ((maze->width + 1) / 2);
+    int* stack = malloc(capacity * 2 * sizeof(int));
+    if (stack == NULL) {
+        return -1;
+    }
+
+    size_t top = 0;
+    stack[0] = maze->startY;
+    stack[1] = maze->startX;
+    top = 1;
+    mazeOpenCell(maze, maze->startY, maze->startX);
+
+    while (top > 0) {
+        int y = stack[2 * (top - 1)];
+        int x = stack[2 * (top - 1) + 1];
+
+        // Collect unvisited neighbours two cells away
+        int candidates[4];
+        int count = 0;
+        for (int i = 0; i < 4; i++) {
+            int ny = y + dy[i];
+            int nx = x + dx[i];
+            if (isValid(maze, ny, nx) && !mazeIsOpen(maze, ny, nx)) {
+                candidates[count++] = i;
+            }
+        }
+
+        // Dead end: backtrack
+        if (count == 0) {
+            top--;
+            continue;
+        }
+
+        // Create passage to a random neighbour and continue from there
+        int i = candidates[rngRange(rng, count)];
+        mazeOpenCell(maze, y + dy[i]/2, x + dx[i]/2);
+        mazeOpenCell(maze, y + dy[i], x + dx[i]);
+        setRoomLink(maze, roomAt(maze, y + dy[i], x + dx[i]), (i + 2) % 4);
+        stack[2 * top] = y + dy[i];
+        stack[2 * top + 1] = x + dx[i];
+        top++;
+    }
+
+    free(stack);
+    return 0;
+}
+
+// Initialize and generate a new maze; returns -1 if it could not be allocated
+int initializeMaze(Maze* maze, int height, int width, Rng* rng) {
+    if (height > MAX_MAZE_SIZE) {
+        if (initializeStreamingMaze(maze, height, width, rng) < 0) {
+            return -1;
+        }
+        scoreMaze(maze);
+        return 0;
+    }
+    freeMazeStream(maze);
+
+    // Room links are reused like the bitboard when the size is unchanged
+    size_t linkBytes = ((size_t)(height / 2) * (width / 2) + 3) / 4;
+    if (maze->links == NULL || maze->height != height || maze->width != width) {
+        uint8_t* links = realloc(maze->links, linkBytes);
+        if (links == NULL) {
+            return -1;
+        }
+        maze->links = links;
+    }
+
+    // Fill maze with walls
+    if (allocateMaze(maze, height, width) < 0) {
+        return -1;
+    }
+    memset(maze->links, 0, linkBytes);
+    
+    // Set start position
+    maze->startY = 1;
+    maze->startX = 1;
+    
+    // Generate maze
+    if (generateMaze(maze, rng) < 0) {
+        return -1;
+    }
+    
+    // Place exit at a random position on the edge, opening the border wall
+    // next to a carved cell if needed
+    int oddRows = height / 2;
+    int oddCols = width / 2;
+    switch (rngRange(rng, 4)) {
+        case 0: // Top
+            maze->exitY = 0;
+            maze->exitX = 1 + 2 * rngRange(rng, oddCols);
+            break;
+        case 1: // Right
+            maze->exitY = 1 + 2 * rngRange(rng, oddRows);
+            maze->exitX = width - 1;
+            break;
+        case 2: // Bottom
+            maze->exitY = height - 1;
+            maze->exitX = 1 + 2 * rngRange(rng, oddCols);
+            break;
+        case 3: // Left
+            maze->exitY = 1 + 2 * rngRange(rng, oddRows);
+            maze->exitX = 0;
+            break;
+    }
+    
+    // Open the exit cell
+    mazeOpenCell(maze, maze->exitY, maze->exitX);
+    scoreMaze(maze);
+    return 0;
+}
+
+// Try to move player in a direction
+bool movePlayer(Maze* maze, int* playerY, int* playerX, int direction, int* movesLeft) {
+    int newY = *playerY;
+    int newX = *playerX;
+    
+    switch (direction) {
+        case UP:    newY--; break;
+        case DOWN:  newY++; break;
+        case LEFT:  newX--; break;
+        case RIGHT: newX++; break;
+    }
+    
+    if (!mazeIsOpen(maze, newY, newX)) {
+        return false;
+    }
+    
+    // Update player position
+    *playerY = newY;
+    *playerX = newX;
+    if (maze->stream != NULL) {
+        extendMazeStream(maze, newY);
+    }
+    
+    (*movesLeft)--; // Decrement remaining moves
+    return true;
+}
+
+// Roll dice to determine moves
+int rollDice(Rng* rng) {
+    int die1 = rngRange(rng, 6) + 1;
+    int die2 = rngRange(rng, 6) + 1;
+    return die1 + die2;
+}
+
+// Open cell number k of mazeOpenCount(): rooms first, then the passage from
+// each room but the start towards its parent
+static void openCellAt(const Maze* maze, int k, int* y, int* x) {
+    int rooms = roomCount(maze);
+    int room = k < rooms ? k : k - rooms + 1;
+    *y = roomY(maze, room);
+    *x = 1 + 2 * (room % roomCols(maze));
+    if (k >= rooms) {
+        int direction = roomLink(maze, room);
+        *y += dy[direction] / 2;
+        *x += dx[direction] / 2;
+    }
+}
+
+// Number of indexed open cells; the exit's door in the border is not one
+int mazeOpenCount(const Maze* maze) {
+    return maze->links != NULL ? 2 * roomCount(maze) - 1 : roomCount(maze);
+}
+
+// Uniformly random open cell other than the start, in O(1)
+void mazeSampleOpenCell(const Maze* maze, Rng* rng, int* y, int* x) {
+    openCellAt(maze, 1 + rngRange(rng, mazeOpenCount(maze) - 1), y, x);
+}
+
+// Append to a growable array of cell numbers
+static int pushCell(int** items, int* count, int* capacity, int value) {
+    if (*count == *capacity) {
+        int newCapacity = *capacity ? 2 * *capacity : 64;
+        int* grown = realloc(*items, newCapacity * sizeof(int));
+        if (grown == NULL) {
+            return -1;
+        }
+        *items = grown;
+        *capacity = newCapacity;
+    }
+    (*items)[(*count)++] = value;
+    return 0;
+}
+
+static int compareCells(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+// Uniformly random open cell at least minSteps along the maze from the room
+// (fromY, fromX). The maze is a tree, so a BFS cut off at minSteps finds the
+// few cells that are too close without marking anything visited; a random
+// number over the remaining cells is then stepped past them. When every cell
+// is too close, the farthest one is used. Returns -1 if out of memory.
+int mazeSampleFarCell(const Maze* maze, int fromY, int fromX, int minSteps, Rng* rng, int* y, int* x) {
+    int rooms = roomCount(maze);
+    int source = roomAt(maze, fromY, fromX);
+    int* near = NULL;           // Cell numbers closer than minSteps
+    int* queue = NULL;          // room << 3 | direction back to its BFS parent, 4 for none
+    int nearCount = 0, nearCapacity = 0;
+    int queueCount = 0, queueCapacity = 0;
+    int failed = pushCell(&near, &nearCount, &nearCapacity, source) |
+                 pushCell(&queue, &queueCount, &queueCapacity, source << 3 | 4);
+
+    // Rooms of one BFS level are `steps` away; passages on from them are one
+    // step further and the rooms beyond them two
+    int head = 0;
+    for (int steps = 0; !failed && head < queueCount && steps + 1 < minSteps; steps += 2) {
+        int levelEnd = queueCount;
+        for (; head < levelEnd && !failed; head++) {
+            int room = queue[head] >> 3;
+            int back = queue[head] & 7;
+            int fromRoomY = roomY(maze, room);
+            int roomX = 1 + 2 * (room % roomCols(maze));
+            for (int direction = 0; direction < 4; direction++) {
+                int nextY = fromRoomY + dy[direction];
+                int nextX = roomX + dx[direction];
+                if (direction == back || !mazeIsOpen(maze, fromRoomY + dy[direction] / 2, roomX + dx[direction] / 2) ||
+                    !mazeIsOpen(maze, nextY, nextX)) {
+                    continue;
+                }
+                // The passage is numbered after whichever room is the child in the generator's tree
+                int next = roomAt(maze, nextY, nextX);
+                if (maze->links != NULL) {
+                    int child = (roomLink(maze, next) == (direction + 2) % 4) ? next : room;
+                    failed |= pushCell(&near, &nearCount, &nearCapacity, rooms - 1 + child);
+                }
+                if (steps + 2 < minSteps) {
+                    failed |= pushCell(&near, &nearCount, &nearCapacity, next);
+                    failed |= pushCell(&queue, &queueCount, &queueCapacity, next << 3 | (direction + 2) % 4);
+                }
+            }
+        }
+    }
+    free(queue);
+
+    if (failed) {
+        free(near);
+        return -1;
+    }
+    int far = mazeOpenCount(maze) - nearCount;
+    if (far <= 0) {
+        openCellAt(maze, near[nearCount - 1], y, x);
+    } else {
+        qsort(near, nearCount, sizeof(int), compareCells);
+        int k = rngRange(rng, far);
+        for (int i = 0; i < nearCount && near[i] <= k; i++) {
+            k++;
+        }
+        openCellAt(maze, k, y, x);
+    }
+    free(near);
+    return 0;
+}
+
+// Place killer at least KILLER_MIN_STEPS along the maze from the survivor,
+// or as far as a small maze allows
+void placeKiller(Maze* maze, int survivorY, int survivorX, int* killerY, int* killerX, Rng* rng) {
+    if (mazeSampleFarCell(maze, survivorY, survivorX, KILLER_MIN_STEPS, rng, killerY, killerX) < 0) {
+        mazeSampleOpenCell(maze, rng, killerY, killerX);
+    }
+}
+
+// Relocates the Exit every few rounds
+void relocateExit(Maze* maze, Rng* rng) {
+    // Pick a new random open location anywhere in the maze but the start; the
+    // old exit cell simply stays open
+    mazeSampleOpenCell(maze, rng, &maze->exitY, &maze->exitX);
+    if (maze->stream == NULL) {
+        maze->score.exitDistance = mazeDistance(maze, maze->startY, maze->startX, maze->exitY, maze->exitX);
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef MAZE_H
+#define MAZE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rng.h"
+
+// Game constants
+#define WALL '#'
+#define SURVIVOR 'S'
+#define KILLER 'K'
+#define EXIT 'E'
+#define EMPTY ' '
+
+// Maze dimensions, chosen at startup
+#define DEFAULT_HEIGHT 10
+#define DEFAULT_WIDTH 25
+#define MIN_MAZE_SIZE 5
+#define MAX_MAZE_SIZE 16383
+#define MAX_STREAM_HEIGHT 1000000   // Taller than MAX_MAZE_SIZE is carved as it is played (stream.h)
+
+// Direction constants for player movement
+#define UP 0
+#define DOWN 1
+#define LEFT 2
+#define RIGHT 3
+
+// Shortest walk from the survivor to where the killer starts
+#define KILLER_MIN_STEPS 10
+
+// Player turn constants
+#define SURVIVOR_TURN 0
+#define KILLER_TURN 1
+
+// Maze structure. Walls live in a bitboard: one bit per cell, set when the
+// cell is open, rows packed into 64-bit words. The exit is an open cell
+// identified by exitY/exitX.
+//
+// Generated mazes also carry an index of their open cells. The generator
+// visits every odd/odd cell (a "room") and opens exactly one passage from
+// each room but the start back to the room it came from, so recording that
+// direction per room is enough to number every open cell: rooms first, then
+// passages. Mazes received over the network have no index, and streaming
+// mazes index only their rooms.
+typedef struct MazeStream MazeStream;
+typedef struct MazeFlood MazeFlood;
+
+// How hard a generated maze is, from scoreMaze() (flood.h); -1 where unknown
+typedef struct {
+    int exitDistance;   // Steps from the start to the exit
+    int deadEnds;       // Open cells with a single open neighbour, the exit aside
+} MazeScore;
+
+typedef struct {
+    int height, width;
+    int stride;         // 64-bit words per row
+    uint64_t* cells;    // height * stride words in one allocation, or a window of rows (stream.h)
+    uint8_t* links;     // 2 bits per room: direction to its parent, or NULL
+    int generatedRows;  // Rows carved so far; below height only while streaming
+    int firstRow;       // Rows above it have been dropped from a streaming maze's window
+    int rowMask;        // Row y is held in row y & rowMask of cells; -1 unless streaming
+    MazeStream* stream; // Row generator of a streaming maze, or NULL
+    MazeFlood* flood;   // Search scratch space of mazeDistance(), or NULL
+    MazeScore score;
+    int startX, startY;
+    int exitX, exitY;
+} Maze;
+
+// Direction bits returned by mazeOpenNeighbors()
+#define DIR_BIT(direction) (1 << (direction))
+
+// Words of row y
+#define MAZE_ROW(maze, y) ((maze)->cells + (size_t)((y) & (maze)->rowMask) * (maze)->stride)
+
+// Bytes of the bitboard, as sent on the wire
+#define MAZE_BYTES(maze) ((size_t)(maze)->height * (maze)->stride * sizeof(uint64_t))
+
+// Rows of cells: the whole maze, or the window of a streaming one
+static inline int mazeBufferRows(const Maze* maze) {
+    return maze->rowMask >= 0 ? maze->rowMask + 1 : maze->height;
+}
+
+// Is (y, x) inside the rows held and open? One unsigned compare per axis, one word load.
+static inline bool mazeIsOpen(const Maze* maze, int y, int x) {
+    if ((unsigned)(y - maze->firstRow) >= (unsigned)(maze->generatedRows - maze->firstRow) ||
+        (unsigned)x >= (unsigned)maze->width) {
+        return false;
+    }
+    return (MAZE_ROW(maze, y)[x >> 6] >> (x & 63)) & 1;
+}
+
+// Carve (y, x) open; the caller guarantees it is inside the maze
+static inline void mazeOpenCell(Maze* maze, int y, int x) {
+    MAZE_ROW(maze, y)[x >> 6] |= (uint64_t)1 << (x & 63);
+}
+
+// Function declarations for maze logic (no ncurses, shared with the server)
+bool isValid(Maze* maze, int y, int x);
+int mazeOpenNeighbors(const Maze* maze, int y, int x);
+int mazeParentDirection(const Maze* maze, int y, int x);
+char mazeCellChar(const Maze* maze, int y, int x);
+bool parseMazeSize(const char* text, int* height, int* width);
+int allocateMaze(Maze* maze, int height, int width);
+int initializeMaze(Maze* maze, int height, int width, Rng* rng);
+void freeMaze(Maze* maze);
+void placeKiller(Maze* maze, int survivorY, int survivorX, int* killerY, int* killerX, Rng* rng);
+bool movePlayer(Maze* maze, int* playerY, int* playerX, int direction, int* movesLeft);
+int rollDice(Rng* rng);
+void relocateExit(Maze* maze, Rng* rng);
+int mazeOpenCount(const Maze* maze);
+void mazeSampleOpenCell(const Maze* maze, Rng* rng, int* y, int* x);
+int mazeSampleFarCell(const Maze* maze, int fromY, int fromX, int minSteps, Rng* rng, int* y, int* x);
+
+#endif // MAZE_H
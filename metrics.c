@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "metrics.h"
+
+Histogram metrics[METRIC_COUNT];
+
+static const char* metricNames[METRIC_COUNT] = {
+    "key_to_render", "send_state", "receive_state", "round_trip", "maze_generation"
+};
+
+static int metricsFd = -1;
+static char metricsPath[sizeof(((struct sockaddr_un*)0)->sun_path)];
+static pthread_t metricsThread;
+
+// Largest value that lands in a bucket
+static uint64_t bucketCeiling(int bucket) {
+    if (bucket < (1 << HISTOGRAM_SUB_BITS)) {
+        return bucket;
+    }
+    int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t mantissa = (1u << HISTOGRAM_SUB_BITS) + (bucket & ((1u << HISTOGRAM_SUB_BITS) - 1));
+    return ((mantissa + 1) << shift) - 1;
+}
+
+// Value at or below which the given fraction of recorded values fall; 0 if
+// nothing has been recorded
+uint64_t histogramPercentile(const Histogram* histogram, double fraction) {
+    uint64_t count = __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+    uint64_t rank = (uint64_t)(fraction * count);
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS && count > 0; bucket++) {
+        seen += __atomic_load_n(&histogram->buckets[bucket], __ATOMIC_RELAXED);
+        if (seen > rank) {
+            uint64_t ceiling = bucketCeiling(bucket);
+            return ceiling < max ? ceiling : max;
+        }
+    }
+    return max;
+}
+
+// Print every metric in microseconds, as a table or as one JSON object
+void writeMetrics(FILE* out, bool json) {
+    static const double percentiles[3] = { 0.5, 0.9, 0.99 };
+    if (json) {
+        fprintf(out, "{");
+    } else {
+        fprintf(out, "%-16s %10s %10s %10s %10s %10s %10s\n",
+                "metric", "count", "p50 us", "p90 us", "p99 us", "max us", "mean us");
+    }
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        const Histogram* histogram = &metrics[i];
+        uint64_t count = __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+        uint64_t sum = __atomic_load_n(&histogram->sum, __ATOMIC_RELAXED);
+        double values[3];
+        for (int p = 0; p < 3; p++) {
+            values[p] = histogramPercentile(histogram, percentiles[p]) / 1e3;
+        }
+        double max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED) / 1e3;
+        double mean = count > 0 ? (double)sum / count / 1e3 : 0.0;
+
+        if (json) {
+            fprintf(out, "%s\"%s\": {\"count\": %llu, \"p50_us\": %.1f, \"p90_us\": %.1f, "
+                         "\"p99_us\": %.1f, \"max_us\": %.1f, \"mean_us\": %.1f}",
+                    i > 0 ? ", " : "", metricNames[i], (unsigned long long)count,
+                    values[0], values[1], values[2], max, mean);
+        } else {
+            fprintf(out, "%-16s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", metricNames[i],
+                    (unsigned long long)count, values[0], values[1], values[2], max, mean);
+        }
+    }
+    if (json) {
+        fprintf(out, "}\n");
+    }
+}
+
+// Append a labelled table of every metric to the file at path
+int dumpMetrics(const char* path, const char* label) {
+    FILE* out = fopen(path, "a");
+    if (out == NULL) {
+        return -1;
+    }
+    time_t now = time(NULL);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    fprintf(out, "# %s, %s, pid %d\n", stamp, label, (int)getpid());
+    writeMetrics(out, false);
+    fprintf(out, "\n");
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+// Answer each connection with a snapshot and close it. A client that sends
+// "json" within METRICS_REQUEST_MS gets JSON, anyone else a table.
+static void* serveMetrics(void* arg) {
+    (void)arg;
+    while (1) {
+        int fd = accept(metricsFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break; // Shut down by stopMetricsSocket()
+        }
+
+        char request[16] = "";
+        struct pollfd readable = { fd, POLLIN, 0 };
+        if (poll(&readable, 1, METRICS_REQUEST_MS) > 0) {
+            ssize_t received = recv(fd, request, sizeof(request) - 1, 0);
+            request[received > 0 ? received : 0] = '\0';
+        }
+
+        char* text = NULL;
+        size_t length = 0;
+        FILE* out = open_memstream(&text, &length);
+        if (out != NULL) {
+            writeMetrics(out, strncmp(request, "json", 4) == 0);
+            fclose(out);
+            send(fd, text, length, MSG_NOSIGNAL);
+            free(text);
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+// Serve snapshots on a Unix-domain socket named after the program and pid,
+// from a thread of its own. Returns -1 if the socket cannot be set up.
+int startMetricsSocket(const char* program) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(metricsPath, sizeof(metricsPath), METRICS_SOCKET_FORMAT, program, (int)getpid());
+    memcpy(address.sun_path, metricsPath, sizeof(address.sun_path));
+    unlink(metricsPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 8) < 0) {
+        perror("Metrics socket failed");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    metricsFd = fd;
+    if (pthread_create(&metricsThread, NULL, serveMetrics, NULL) != 0) {
+        perror("Metrics thread failed");
+        close(fd);
+        unlink(metricsPath);
+        metricsFd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+const char* metricsSocketPath(void) {
+    return metricsPath;
+}
+
+// Stop serving and remove the socket file
+void stopMetricsSocket(void) {
+    if (metricsFd < 0) {
+        return;
+    }
+    shutdown(metricsFd, SHUT_RDWR); // Wakes the thread's accept()
+    pthread_join(metricsThread, NULL);
+    close(metricsFd);
+    unlink(metricsPath);
+    metricsFd = -1;
+}
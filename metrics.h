@@ -0,0 +1,80 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Latency histograms for the hot paths. Values are nanoseconds, bucketed the
+// HDR way: exact below 8, then 8 buckets per power of two, so percentiles
+// are reported within 12.5% from a fixed 2.5 KB per histogram. Recording is
+// a count-leading-zeros and a few relaxed atomic adds, safe from any thread.
+
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_MAX_EXPONENT 40   // About 18 minutes; anything longer lands in the last bucket
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BITS + 2) << HISTOGRAM_SUB_BITS)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+// Process-wide metrics
+#define METRIC_KEY_TO_RENDER 0      // Key press until the frame it caused is on screen
+#define METRIC_SEND_STATE 1         // sendGameState(), or queueing a state on the server
+#define METRIC_RECEIVE_STATE 2      // receiveGameState() once the socket is readable
+#define METRIC_ROUND_TRIP 3         // Action sent until the server answers; the kernel's RTT on the server
+#define METRIC_MAZE_GENERATION 4    // setupGame(): maze, killer and first dice
+#define METRIC_COUNT 5
+
+#define METRICS_FILE "deja.metrics"                 // Appended to at the end of every game
+#define METRICS_SOCKET_FORMAT "/tmp/deja-%s-%d.sock" // Program name and pid
+#define METRICS_REQUEST_MS 100      // How long a socket client may take to ask for "json"
+
+extern Histogram metrics[METRIC_COUNT];
+
+static inline uint64_t metricsNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+static inline int histogramBucket(uint64_t value) {
+    if (value < (1u << HISTOGRAM_SUB_BITS)) {
+        return (int)value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > HISTOGRAM_MAX_EXPONENT) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    int shift = exponent - HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + (int)((value >> shift) & ((1u << HISTOGRAM_SUB_BITS) - 1));
+}
+
+static inline void histogramRecord(Histogram* histogram, uint64_t value) {
+    __atomic_fetch_add(&histogram->buckets[histogramBucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum, value, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+    while (value > max && !__atomic_compare_exchange_n(&histogram->max, &max, value, true,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Record the time since start, a metricsNow() reading
+static inline void metricsRecord(int metric, uint64_t start) {
+    histogramRecord(&metrics[metric], metricsNow() - start);
+}
+
+// Function declarations for reading metrics
+uint64_t histogramPercentile(const Histogram* histogram, double fraction);
+void writeMetrics(FILE* out, bool json);
+int dumpMetrics(const char* path, const char* label);
+int startMetricsSocket(const char* program);
+const char* metricsSocketPath(void);
+void stopMetricsSocket(void);
+
+#endif // METRICS_H
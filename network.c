@@ -1,4 +1,10 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
 #include "network.h"
+#include "metrics.h"
+#include "udp.h"
 
 int createServer() {
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -44,10 +50,58 @@ int createServer() {
 
     printf("Client connected!\n");
     close(server_fd); // Close the listening socket
+    enableKeepalive(client_socket);
     return client_socket;
 }
 
+// Create a non-blocking listening socket for the dedicated server
+int createListener(int port) {
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    int opt = 1;
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        perror("Setsockopt failed");
+        close(server_fd);
+        return -1;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        perror("Bind failed");
+        close(server_fd);
+        return -1;
+    }
+
+    // Keep a full backlog so bursts of players are not refused
+    if (listen(server_fd, SOMAXCONN) < 0) {
+        perror("Listen failed");
+        close(server_fd);
+        return -1;
+    }
+
+    if (fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+        perror("Fcntl failed");
+        close(server_fd);
+        return -1;
+    }
+
+    return server_fd;
+}
+
 int connectToServer(const char* serverIP) {
+    return connectToServerPort(serverIP, PORT);
+}
+
+int connectToServerPort(const char* serverIP, int port) {
     int sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock < 0) {
         perror("Socket creation failed");
@@ -57,7 +111,7 @@ int connectToServer(const char* serverIP) {
     struct sockaddr_in serv_addr;
     memset(&serv_addr, 0, sizeof(serv_addr));
     serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(PORT);
+    serv_addr.sin_port = htons(port);
 
     if (inet_pton(AF_INET, serverIP, &serv_addr.sin_addr) <= 0) {
         perror("Invalid address");
@@ -65,7 +119,7 @@ int connectToServer(const char* serverIP) {
         return -1;
     }
 
-    printf("Connecting to server at %s:%d...\n", serverIP, PORT);
+    printf("Connecting to server at %s:%d...\n", serverIP, port);
     if (connect(sock, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
         perror("Connection failed");
         close(sock);
@@ -73,27 +127,250 @@ int connectToServer(const char* serverIP) {
     }
 
     printf("Connected to server!\n");
+    enableKeepalive(sock);
+    return sock;
+}
+
+// Have the kernel probe an idle peer so one that vanished without closing
+// the connection is noticed by poll() and recv()
+void enableKeepalive(int socket) {
+    int opt = 1;
+    int idle = KEEPALIVE_IDLE;
+    int interval = KEEPALIVE_INTERVAL;
+    int probes = KEEPALIVE_PROBES;
+    setsockopt(socket, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt));
+    setsockopt(socket, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(socket, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(socket, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+}
+
+// Reconnect to a dedicated server's resume port and ask for a match back.
+// The request goes out with the first segment after the handshake, so the
+// missed states arrive one round trip later. Gives up silently after
+// timeoutMs, as it is retried while the maze is on screen. port is the game
+// port the match was joined on. Returns the socket, or -1.
+int resumeSession(const char* serverIP, int port, const ResumeRequest* request, int timeoutMs) {
+    struct sockaddr_in serv_addr;
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port + RESUME_PORT_OFFSET);
+    if (inet_pton(AF_INET, serverIP, &serv_addr.sin_addr) <= 0) {
+        return -1;
+    }
+
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
+        struct pollfd pfd = { sock, POLLOUT, 0 };
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (errno != EINPROGRESS || poll(&pfd, 1, timeoutMs) <= 0 ||
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+            close(sock);
+            return -1;
+        }
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~O_NONBLOCK);
+
+    int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    enableKeepalive(sock);
+    if (send(sock, request, sizeof(*request), MSG_NOSIGNAL) != (ssize_t)sizeof(*request)) {
+        close(sock);
+        return -1;
+    }
     return sock;
 }
 
-int sendGameState(int socket, GameState* state) {
-    ssize_t sent = send(socket, state, sizeof(GameState), 0);
+// Send the state header followed by the maze bitboard in one call
+int sendGameState(int socket, GameState* state, Maze* maze) {
+    uint64_t start = metricsNow();
+    state->height = maze->height;
+    state->width = maze->width;
+    state->exitY = maze->exitY;
+    state->exitX = maze->exitX;
+    state->view = VIEW_MAZE;
+
+    struct iovec parts[2];
+    parts[0].iov_base = state;
+    parts[0].iov_len = sizeof(GameState);
+    parts[1].iov_base = maze->cells;
+    parts[1].iov_len = MAZE_BYTES(maze);
+
+    ssize_t sent = writev(socket, parts, 2);
+    if (sent < 0) {
+        perror("Send failed");
+    }
+    metricsRecord(METRIC_SEND_STATE, start);
+    return sent;
+}
+
+// Receive a state header and its maze, resizing the maze to the sender's
+// dimensions. Under fog of war the maze starts as all wall, sized with fov,
+// and each FogView received carves in what the player sees.
+int receiveGameState(int socket, GameState* state, Maze* maze, Fov* fov) {
+    uint64_t start = metricsNow();
+    // Wait for the whole header; a dedicated server may split it across segments
+    ssize_t received = recv(socket, state, sizeof(GameState), MSG_WAITALL);
+    if (received <= 0) {
+        if (received < 0) {
+            perror("Receive failed");
+        }
+        return received;
+    }
+    if (received < (ssize_t)sizeof(GameState)) {
+        return 0;
+    }
+
+    if (state->height == 0 && state->width == 0) {
+        return received; // Header-only message such as STATUS_WAITING
+    }
+    bool fogged = (state->view == VIEW_FOG || state->view == VIEW_UNCHANGED);
+    bool resized = (maze->cells == NULL || maze->height != state->height || maze->width != state->width);
+    bool valid = state->height >= MIN_MAZE_SIZE && state->width >= MIN_MAZE_SIZE &&
+                 state->height <= MAX_MAZE_SIZE && state->width <= MAX_MAZE_SIZE && (!fogged || fov != NULL);
+    // A maze of the same size is received over in place, so one cut off
+    // halfway still holds the match's maze
+    if (valid && resized) {
+        valid = (allocateMaze(maze, state->height, state->width) == 0);
+    }
+    if (valid && fogged && resized) {
+        freeFov(fov);
+        valid = (initFov(fov, maze) == 0);
+    }
+    if (!valid) {
+        fprintf(stderr, "Receive failed: bad maze size %dx%d\n", state->height, state->width);
+        return -1;
+    }
+
+    FogView view;
+    void* body = fogged ? (void*)&view : (void*)maze->cells;
+    ssize_t bodyBytes = stateBodyBytes(state);
+    ssize_t bodyReceived = bodyBytes > 0 ? recv(socket, body, bodyBytes, MSG_WAITALL) : 0;
+    if (bodyReceived < bodyBytes) {
+        if (bodyReceived < 0) {
+            perror("Receive failed");
+        }
+        return bodyReceived < 0 ? -1 : 0;
+    }
+    if (state->view == VIEW_FOG) {
+        applyFogView(fov, maze, &view);
+    }
+    maze->exitY = state->exitY;
+    maze->exitX = state->exitX;
+    metricsRecord(METRIC_RECEIVE_STATE, start);
+    return received + bodyReceived;
+}
+
+int sendAction(int socket, int action) {
+    unsigned char byte = (unsigned char)action;
+    ssize_t sent = send(socket, &byte, 1, 0);
     if (sent < 0) {
         perror("Send failed");
     }
     return sent;
 }
 
-int receiveGameState(int socket, GameState* state) {
-    ssize_t received = recv(socket, state, sizeof(GameState), 0);
-    if (received < 0) {
-        perror("Receive failed");
+// Payload bytes following the type byte of a lockstep record
+static size_t recordPayload(int type) {
+    switch (type) {
+        case RECORD_INPUT: return 1;
+        case RECORD_SEED:  return 8;
+        default:           return 4;
+    }
+}
+
+// Encode a lockstep record into buffer (RECORD_MAX_BYTES): 2 bytes for an
+// input, 5 for a hash, 9 for a seed. Returns the encoded length.
+size_t encodeRecord(const Record* record, unsigned char* buffer) {
+    buffer[0] = (unsigned char)record->type;
+    if (record->type == RECORD_INPUT) {
+        buffer[1] = (unsigned char)((record->action & 0x0F) | (record->dice << 4));
+    } else {
+        uint32_t value = htonl(record->value);
+        memcpy(buffer + 1, &value, sizeof(value));
+        if (record->type == RECORD_SEED) {
+            uint16_t height = htons((uint16_t)record->height);
+            uint16_t width = htons((uint16_t)record->width);
+            memcpy(buffer + 5, &height, sizeof(height));
+            memcpy(buffer + 7, &width, sizeof(width));
+        }
+    }
+    return 1 + recordPayload(record->type);
+}
+
+// Decode one record from the start of buffer; returns its length, or 0 if
+// fewer than that many bytes are available
+size_t decodeRecord(const unsigned char* buffer, size_t available, Record* record) {
+    if (available < 1 || available < 1 + recordPayload(buffer[0])) {
+        return 0;
+    }
+    record->type = buffer[0];
+    if (record->type == RECORD_INPUT) {
+        record->action = buffer[1] & 0x0F;
+        record->dice = buffer[1] >> 4;
+        record->value = 0;
+    } else {
+        uint32_t value;
+        memcpy(&value, buffer + 1, sizeof(value));
+        record->value = ntohl(value);
+        record->action = 0;
+        record->dice = 0;
+        if (record->type == RECORD_SEED) {
+            uint16_t height, width;
+            memcpy(&height, buffer + 5, sizeof(height));
+            memcpy(&width, buffer + 7, sizeof(width));
+            record->height = ntohs(height);
+            record->width = ntohs(width);
+        }
+    }
+    return 1 + recordPayload(record->type);
+}
+
+int sendRecord(int socket, const Record* record) {
+    if (udpIsLink(socket)) {
+        return udpSendRecord(record);
+    }
+    unsigned char buffer[RECORD_MAX_BYTES];
+    size_t length = encodeRecord(record, buffer);
+    ssize_t sent = send(socket, buffer, length, MSG_NOSIGNAL);
+    if (sent < 0) {
+        perror("Send failed");
+    }
+    return sent;
+}
+
+// Read the next lockstep record; returns 0 if the peer closed the connection
+int receiveRecord(int socket, Record* record) {
+    if (udpIsLink(socket)) {
+        return udpReceiveRecord(record);
+    }
+    unsigned char buffer[RECORD_MAX_BYTES];
+    ssize_t received = recv(socket, buffer, 1, MSG_WAITALL);
+    if (received <= 0) {
+        if (received < 0) {
+            perror("Receive failed");
+        }
+        return received;
+    }
+
+    size_t payload = recordPayload(buffer[0]);
+    received = recv(socket, buffer + 1, payload, MSG_WAITALL);
+    if (received < (ssize_t)payload) {
+        if (received < 0) {
+            perror("Receive failed");
+        }
+        return received < 0 ? -1 : 0;
     }
-    return received;
+    return decodeRecord(buffer, 1 + payload, record);
 }
 
 void closeConnection(int socket) {
-    if (socket >= 0) {
+    if (udpIsLink(socket)) {
+        udpClose();
+    } else if (socket >= 0) {
         close(socket);
     }
 } 
\ No newline at end of file
@@ -8,11 +8,61 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include "engine.h"
+#include "fov.h"
 
 #define PORT 8080
 #define BUFFER_SIZE 1024
 
-// Game state structure for network transmission
+// TCP keepalive for peer sockets: a silent peer is probed after KEEPALIVE_IDLE
+// seconds and given up on after KEEPALIVE_PROBES unanswered probes, so a dead
+// peer surfaces as a socket error within about eight seconds
+#define KEEPALIVE_IDLE 5
+#define KEEPALIVE_INTERVAL 1
+#define KEEPALIVE_PROBES 3
+
+// Match status carried in GameState.status
+#define STATUS_PLAYING 0
+#define STATUS_SURVIVOR_WON 1
+#define STATUS_KILLER_WON 2
+#define STATUS_ABORTED 3   // Opponent quit or disconnected
+#define STATUS_WAITING 4   // Dedicated server is still pairing us
+
+// Dedicated server spectators connect to the game port + SPECTATOR_PORT_OFFSET
+// and receive every state with this role
+#define SPECTATOR_PORT_OFFSET 1
+#define SPECTATOR_ROLE 2
+
+// A dedicated server keeps a match going RESUME_GRACE_SECONDS for a player
+// whose connection dropped. The player gets it back by connecting to the game
+// port + RESUME_PORT_OFFSET and sending a ResumeRequest with the session it
+// was given; the server answers with the states sent since the sequence in
+// the request, then play goes on as before.
+#define RESUME_PORT_OFFSET 2
+#define RESUME_GRACE_SECONDS 30
+
+
+// Lockstep record types; the type is the first byte of every peer-to-peer record
+#define RECORD_SEED 1    // 4-byte seed and 2-byte height and width: both peers generate the same game
+#define RECORD_INPUT 2   // 1 byte: action in the low nibble, dice it rolled in the high nibble
+#define RECORD_HASH 3    // 4-byte hash of the state after a turn ends
+#define RECORD_MAX_BYTES 9
+
+// One decoded lockstep record
+typedef struct {
+    int type;
+    int action;          // RECORD_INPUT only
+    int dice;            // RECORD_INPUT only, 0 when the action did not end the turn
+    unsigned int value;  // Seed or hash
+    int height, width;   // RECORD_SEED only
+} Record;
+
+// What follows a GameState header that carries a maze size (GameState.view)
+#define VIEW_MAZE 0         // The whole maze bitboard (MAZE_BYTES)
+#define VIEW_FOG 1          // A FogView of the cells the player sees, under fog of war
+#define VIEW_UNCHANGED 2    // Nothing: the player sees what the last FogView showed
+
+// Game state header for network transmission; stateBodyBytes() of maze follow it on the wire
 typedef struct {
     int survivorY;
     int survivorX;
@@ -21,14 +71,48 @@ typedef struct {
     int currentTurn;
     int survivorMovesLeft;
     int killerMovesLeft;
-    char maze[10][25];  // Using the same dimensions as the game
+    int height;
+    int width;
+    int exitY;
+    int exitX;
+    int role;           // SURVIVOR_TURN or KILLER_TURN, set per recipient by a dedicated server
+    int status;         // One of the STATUS_ constants
+    int view;           // One of the VIEW_ constants
+    unsigned int sequence;      // Counts the states a dedicated server sent this player in the match
+    unsigned int session[2];    // Token the player resumes the match with, zero outside a match
 } GameState;
 
+// The only message on the resume port
+typedef struct {
+    unsigned int session[2];    // GameState.session of the match to rejoin
+    unsigned int sequence;      // GameState.sequence of the last state received, 0 for none
+} ResumeRequest;
+
+// Bytes that follow a GameState header on the wire
+static inline size_t stateBodyBytes(const GameState* state) {
+    if ((state->height == 0 && state->width == 0) || state->view == VIEW_UNCHANGED) {
+        return 0;
+    }
+    if (state->view == VIEW_FOG) {
+        return sizeof(FogView);
+    }
+    return (size_t)state->height * ((state->width + 63) / 64) * sizeof(uint64_t);
+}
+
 // Function declarations
 int createServer();
+int createListener(int port);
 int connectToServer(const char* serverIP);
-int sendGameState(int socket, GameState* state);
-int receiveGameState(int socket, GameState* state);
+int connectToServerPort(const char* serverIP, int port);
+void enableKeepalive(int socket);
+int resumeSession(const char* serverIP, int port, const ResumeRequest* request, int timeoutMs);
+int sendGameState(int socket, GameState* state, Maze* maze);
+int receiveGameState(int socket, GameState* state, Maze* maze, Fov* fov);
+int sendAction(int socket, int action);
+size_t encodeRecord(const Record* record, unsigned char* buffer);
+size_t decodeRecord(const unsigned char* buffer, size_t available, Record* record);
+int sendRecord(int socket, const Record* record);
+int receiveRecord(int socket, Record* record);
 void closeConnection(int socket);
 
 #endif // NETWORK_H 
\ No newline at end of file
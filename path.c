@@ -0,0 +1,817 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "path.h"
+
+// Offsets for the UP, DOWN, LEFT and RIGHT directions
+static const int stepY[4] = {-1, 1, 0, 0};
+static const int stepX[4] = {0, 0, -1, 1};
+
+// A* bookkeeping of one entrance, valid when stamp matches the graph's
+typedef struct {
+    unsigned int stamp;
+    int cost;               // Steps from the start
+    bool closed;
+    long parent;            // Entrance it was reached from, -1 for the start's cluster
+} PathNode;
+
+struct PathCluster {
+    int rowsSeen;           // maze->generatedRows when built; 0 if never built
+    int firstRow;           // and maze->firstRow
+    int originY;            // Top row; clusters of a streaming maze's window reuse the slots of dropped ones
+    int count;              // Entrances
+    uint16_t* local;        // Cell of each entrance, as an index into the cluster
+    uint8_t* exits;         // DIR_BIT()s leading out of the cluster from each entrance
+    uint16_t* edgeStart;    // Entrance i reaches edges edgeStart[i] to edgeStart[i + 1] - 1
+    uint8_t* edgeTo;        // Other entrance reachable without leaving the cluster
+    uint16_t* edgeSteps;    // and the steps to it
+    PathNode* nodes;
+};
+
+// Open list entry; stale entries are skipped when popped
+struct PathHeapEntry {
+    int estimate;           // cost plus the distance left as the crow walks
+    int cost;
+    long node;              // cluster * PATH_MAX_ENTRANCES + entrance
+};
+
+#define PATH_MAX_ENTRANCES (4 * PATH_CLUSTER)
+
+// Entrance of a tree-shaped maze, from its walk from the start
+struct PathTreeEntrance {
+    uint32_t in;            // Preorder number of the entrance
+    uint32_t out;           // and the last one of the cells below it
+    uint32_t depth;         // Steps from the start
+    int above;              // Nearest entrance on the way to the start, -1 for none
+    int cluster;            // Cluster it belongs to
+};
+
+static void freeCluster(PathCluster* cluster) {
+    free(cluster->local);
+    free(cluster->exits);
+    free(cluster->edgeStart);
+    free(cluster->edgeTo);
+    free(cluster->edgeSteps);
+    free(cluster->nodes);
+    memset(cluster, 0, sizeof(*cluster));
+}
+
+static void freeTree(PathGraph* graph) {
+    free(graph->treeStart);
+    free(graph->treeLocal);
+    free(graph->tree);
+    graph->treeStart = NULL;
+    graph->treeLocal = NULL;
+    graph->tree = NULL;
+}
+
+void initPathGraph(PathGraph* graph) {
+    memset(graph, 0, sizeof(*graph));
+}
+
+// Forget every cluster; call before every new game, since a new maze of the
+// same size keeps the same cluster array
+void resetPathGraph(PathGraph* graph) {
+    for (long i = 0; i < graph->builtCount; i++) {
+        freeCluster(&graph->clusters[graph->built[i]]);
+    }
+    graph->builtCount = 0;
+    freeTree(graph);
+    graph->treeState = 0;
+}
+
+void freePathGraph(PathGraph* graph) {
+    resetPathGraph(graph);
+    free(graph->clusters);
+    free(graph->built);
+    free(graph->heap);
+    initPathGraph(graph);
+}
+
+// Make sure the cluster array covers the maze; returns -1 if it cannot be allocated
+static int sizeGraph(PathGraph* graph, const Maze* maze) {
+    if (graph->clusters != NULL && graph->height == maze->height && graph->width == maze->width) {
+        return 0;
+    }
+    resetPathGraph(graph);
+    free(graph->clusters);
+
+    // A streaming maze's window of rows can straddle one band of clusters
+    // more than it has rows for; the bands take slots in turn, like the rows
+    int rows = mazeBufferRows(maze) + (maze->rowMask >= 0 ? PATH_CLUSTER : 0);
+    graph->clusterRows = (rows + PATH_CLUSTER - 1) / PATH_CLUSTER;
+    graph->clusterCols = (maze->width + PATH_CLUSTER - 1) / PATH_CLUSTER;
+    graph->clusters = calloc((size_t)graph->clusterRows * graph->clusterCols, sizeof(PathCluster));
+    if (graph->clusters == NULL) {
+        graph->height = graph->width = 0;
+        return -1;
+    }
+    graph->height = maze->height;
+    graph->width = maze->width;
+    return 0;
+}
+
+static long clusterOf(const PathGraph* graph, int y, int x) {
+    return (long)(y / PATH_CLUSTER % graph->clusterRows) * graph->clusterCols + x / PATH_CLUSTER;
+}
+
+static int localIndex(int y, int x) {
+    return (y % PATH_CLUSTER) * PATH_CLUSTER + x % PATH_CLUSTER;
+}
+
+// Breadth-first steps from (y, x) to every cell of its cluster, without
+// leaving it. Cells that cannot be reached that way are PATH_UNREACHED.
+static void clusterField(const Maze* maze, int y, int x, uint16_t* field, uint16_t* queue) {
+    int originY = y - y % PATH_CLUSTER;
+    int originX = x - x % PATH_CLUSTER;
+    int rows = maze->generatedRows - originY < PATH_CLUSTER ? maze->generatedRows - originY : PATH_CLUSTER;
+    int cols = maze->width - originX < PATH_CLUSTER ? maze->width - originX : PATH_CLUSTER;
+
+    memset(field, 0xFF, PATH_CLUSTER_CELLS * sizeof(uint16_t));
+    int start = localIndex(y, x);
+    field[start] = 0;
+    queue[0] = start;
+    int head = 0, tail = 1;
+    while (head < tail) {
+        int index = queue[head++];
+        int localY = index / PATH_CLUSTER;
+        int localX = index % PATH_CLUSTER;
+        int open = mazeOpenNeighbors(maze, originY + localY, originX + localX);
+        for (int direction = UP; direction <= RIGHT; direction++) {
+            int nextY = localY + stepY[direction];
+            int nextX = localX + stepX[direction];
+            if (!(open & DIR_BIT(direction)) || (unsigned)nextY >= (unsigned)rows ||
+                (unsigned)nextX >= (unsigned)cols) {
+                continue;
+            }
+            int next = nextY * PATH_CLUSTER + nextX;
+            if (field[next] == PATH_UNREACHED) {
+                field[next] = field[index] + 1;
+                queue[tail++] = next;
+            }
+        }
+    }
+}
+
+// Open border cells of the cluster at (originY, originX) with an open
+// neighbour in another one, in row order, with the DIR_BIT()s leading out.
+// Rows not yet carved read as wall.
+static int findEntrances(const Maze* maze, int originY, int originX, uint16_t* local, uint8_t* exits) {
+    int rows = maze->generatedRows - originY < PATH_CLUSTER ? maze->generatedRows - originY : PATH_CLUSTER;
+    int cols = maze->width - originX < PATH_CLUSTER ? maze->width - originX : PATH_CLUSTER;
+    int count = 0;
+    for (int localY = 0; localY < rows; localY++) {
+        bool edgeRow = (localY == 0 || localY == PATH_CLUSTER - 1);
+        for (int localX = 0; localX < cols; localX = (edgeRow || localX > 0) ? localX + 1 : PATH_CLUSTER - 1) {
+            int y = originY + localY;
+            int x = originX + localX;
+            if (!mazeIsOpen(maze, y, x)) {
+                continue;
+            }
+            int outside = 0;
+            if (localY == 0 && mazeIsOpen(maze, y - 1, x)) {
+                outside |= DIR_BIT(UP);
+            }
+            if (localY == PATH_CLUSTER - 1 && y + 1 < maze->generatedRows && mazeIsOpen(maze, y + 1, x)) {
+                outside |= DIR_BIT(DOWN);
+            }
+            if (localX == 0 && mazeIsOpen(maze, y, x - 1)) {
+                outside |= DIR_BIT(LEFT);
+            }
+            if (localX == PATH_CLUSTER - 1 && mazeIsOpen(maze, y, x + 1)) {
+                outside |= DIR_BIT(RIGHT);
+            }
+            if (outside != 0) {
+                local[count] = localY * PATH_CLUSTER + localX;
+                exits[count] = outside;
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// Find the entrances of a cluster and the distances between them. The
+// crossing into rows not yet carved is left for the rebuild once they are.
+static int buildCluster(PathGraph* graph, const Maze* maze, long index, int originY) {
+    PathCluster* cluster = &graph->clusters[index];
+    freeCluster(cluster);
+
+    int originX = (int)(index % graph->clusterCols) * PATH_CLUSTER;
+    uint16_t local[PATH_MAX_ENTRANCES];
+    uint8_t exits[PATH_MAX_ENTRANCES];
+    int count = findEntrances(maze, originY, originX, local, exits);
+
+    // Steps between every pair of entrances, keeping only the pairs connected
+    // inside the cluster; in a perfect maze that is a few per entrance
+    uint16_t* steps = malloc(((size_t)count * count + 1) * sizeof(uint16_t));
+    cluster->local = malloc((count + 1) * sizeof(uint16_t));
+    cluster->exits = malloc(count + 1);
+    cluster->edgeStart = malloc((count + 1) * sizeof(uint16_t));
+    cluster->nodes = calloc(count + 1, sizeof(PathNode));
+    if (steps == NULL || cluster->local == NULL || cluster->exits == NULL || cluster->edgeStart == NULL ||
+        cluster->nodes == NULL) {
+        free(steps);
+        freeCluster(cluster);
+        return -1;
+    }
+    memcpy(cluster->local, local, count * sizeof(uint16_t));
+    memcpy(cluster->exits, exits, count);
+
+    int edges = 0;
+    for (int i = 0; i < count; i++) {
+        clusterField(maze, originY + local[i] / PATH_CLUSTER, originX + local[i] % PATH_CLUSTER,
+                     graph->startField, graph->queue);
+        for (int j = 0; j < count; j++) {
+            steps[i * count + j] = (i == j) ? PATH_UNREACHED : graph->startField[local[j]];
+            edges += (steps[i * count + j] != PATH_UNREACHED);
+        }
+    }
+    cluster->edgeTo = malloc(edges + 1);
+    cluster->edgeSteps = malloc((edges + 1) * sizeof(uint16_t));
+    if (cluster->edgeTo == NULL || cluster->edgeSteps == NULL) {
+        free(steps);
+        freeCluster(cluster);
+        return -1;
+    }
+    edges = 0;
+    for (int i = 0; i < count; i++) {
+        cluster->edgeStart[i] = edges;
+        for (int j = 0; j < count; j++) {
+            if (steps[i * count + j] != PATH_UNREACHED) {
+                cluster->edgeTo[edges] = j;
+                cluster->edgeSteps[edges] = steps[i * count + j];
+                edges++;
+            }
+        }
+    }
+    cluster->edgeStart[count] = edges;
+    free(steps);
+    cluster->count = count;
+    cluster->rowsSeen = maze->generatedRows > 0 ? maze->generatedRows : 1;
+    cluster->firstRow = maze->firstRow;
+    cluster->originY = originY;
+    return 0;
+}
+
+// The cluster from row originY, built if this is the first search to reach
+// it, if rows it needs have been carved or dropped since, or if its slot
+// holds a cluster a streaming maze has dropped
+static PathCluster* useCluster(PathGraph* graph, const Maze* maze, long index, int originY) {
+    PathCluster* cluster = &graph->clusters[index];
+    int needed = originY + PATH_CLUSTER + 1 < maze->height ? originY + PATH_CLUSTER + 1 : maze->height;
+    if (cluster->rowsSeen == 0) {
+        if (graph->builtCount == graph->builtCapacity) {
+            long capacity = graph->builtCapacity > 0 ? graph->builtCapacity * 2 : 256;
+            long* built = realloc(graph->built, capacity * sizeof(long));
+            if (built == NULL) {
+                return NULL;
+            }
+            graph->built = built;
+            graph->builtCapacity = capacity;
+        }
+        if (buildCluster(graph, maze, index, originY) < 0) {
+            return NULL;
+        }
+        graph->built[graph->builtCount++] = index;
+    } else if (cluster->originY != originY ||
+               (cluster->rowsSeen < needed && cluster->rowsSeen != maze->generatedRows) ||
+               (originY < maze->firstRow && cluster->firstRow != maze->firstRow)) {
+        if (buildCluster(graph, maze, index, originY) < 0) {
+            return NULL;
+        }
+    }
+    return cluster;
+}
+
+static int findEntrance(const PathCluster* cluster, int local) {
+    for (int i = 0; i < cluster->count; i++) {
+        if (cluster->local[i] == local) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int heapPush(PathGraph* graph, int estimate, int cost, long node) {
+    if (graph->heapCount == graph->heapCapacity) {
+        int capacity = graph->heapCapacity > 0 ? graph->heapCapacity * 2 : 256;
+        struct PathHeapEntry* heap = realloc(graph->heap, capacity * sizeof(*heap));
+        if (heap == NULL) {
+            return -1;
+        }
+        graph->heap = heap;
+        graph->heapCapacity = capacity;
+    }
+    int i = graph->heapCount++;
+    while (i > 0 && graph->heap[(i - 1) / 2].estimate > estimate) {
+        graph->heap[i] = graph->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    graph->heap[i] = (struct PathHeapEntry){ estimate, cost, node };
+    return 0;
+}
+
+static struct PathHeapEntry heapPop(PathGraph* graph) {
+    struct PathHeapEntry top = graph->heap[0];
+    struct PathHeapEntry last = graph->heap[--graph->heapCount];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= graph->heapCount) {
+            break;
+        }
+        if (child + 1 < graph->heapCount && graph->heap[child + 1].estimate < graph->heap[child].estimate) {
+            child++;
+        }
+        if (graph->heap[child].estimate >= last.estimate) {
+            break;
+        }
+        graph->heap[i] = graph->heap[child];
+        i = child;
+    }
+    graph->heap[i] = last;
+    return top;
+}
+
+// Record a cheaper way to an entrance and queue it
+static int relax(PathGraph* graph, PathCluster* cluster, long index, int entrance, int cost,
+                 long parent, int toY, int toX) {
+    PathNode* node = &cluster->nodes[entrance];
+    if (node->stamp == graph->stamp && (node->closed || node->cost <= cost)) {
+        return 0;
+    }
+    node->stamp = graph->stamp;
+    node->cost = cost;
+    node->closed = false;
+    node->parent = parent;
+
+    int local = cluster->local[entrance];
+    int y = cluster->originY + local / PATH_CLUSTER;
+    int x = (int)(index % graph->clusterCols) * PATH_CLUSTER + local % PATH_CLUSTER;
+    return heapPush(graph, cost + abs(y - toY) + abs(x - toX), cost, index * PATH_MAX_ENTRANCES + entrance);
+}
+
+// Start a new search; the old one is forgotten by bumping the stamp
+static void nextStamp(PathGraph* graph) {
+    if (++graph->stamp == 0) {
+        for (long i = 0; i < graph->builtCount; i++) {
+            PathCluster* cluster = &graph->clusters[graph->built[i]];
+            for (int j = 0; j < cluster->count; j++) {
+                cluster->nodes[j].stamp = 0;
+            }
+        }
+        graph->stamp = 1;
+    }
+    graph->heapCount = 0;
+}
+
+// Append a waypoint to the plan
+static int addWaypoint(PathPlan* plan, int y, int x) {
+    if (plan->count == plan->capacity) {
+        int capacity = plan->capacity > 0 ? plan->capacity * 2 : 64;
+        int* waypoints = realloc(plan->waypoints, 2 * capacity * sizeof(int));
+        if (waypoints == NULL) {
+            return -1;
+        }
+        plan->waypoints = waypoints;
+        plan->capacity = capacity;
+    }
+    plan->waypoints[2 * plan->count] = y;
+    plan->waypoints[2 * plan->count + 1] = x;
+    plan->count++;
+    return 0;
+}
+
+// Number of the entrance at (y, x), or -1 if it is not one
+static int treeEntrance(const PathGraph* graph, int y, int x) {
+    int localY = y % PATH_CLUSTER;
+    int localX = x % PATH_CLUSTER;
+    if (localY != 0 && localY != PATH_CLUSTER - 1 && localX != 0 && localX != PATH_CLUSTER - 1) {
+        return -1;
+    }
+    long index = clusterOf(graph, y, x);
+    int low = graph->treeStart[index], high = graph->treeStart[index + 1];
+    int local = localY * PATH_CLUSTER + localX;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (graph->treeLocal[middle] < local) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < graph->treeStart[index + 1] && graph->treeLocal[low] == local ? low : -1;
+}
+
+// Index the entrances of a generated maze by one walk of its tree from the
+// start, without a stack: the next cell is the first child not yet walked,
+// or else the parent. Returns -1 if out of memory, or if the walk meets a
+// loop and the maze is not a tree after all.
+static int buildTree(PathGraph* graph, const Maze* maze) {
+    long clusters = (long)graph->clusterRows * graph->clusterCols;
+    graph->treeStart = malloc((clusters + 1) * sizeof(int));
+    if (graph->treeStart == NULL) {
+        return -1;
+    }
+    uint16_t local[PATH_MAX_ENTRANCES];
+    uint8_t exits[PATH_MAX_ENTRANCES];
+    int count = 0;
+    for (long i = 0; i < clusters; i++) {
+        graph->treeStart[i] = count;
+        count += findEntrances(maze, (int)(i / graph->clusterCols) * PATH_CLUSTER,
+                               (int)(i % graph->clusterCols) * PATH_CLUSTER, local, exits);
+    }
+    graph->treeStart[clusters] = count;
+    graph->treeLocal = malloc((count + 1) * sizeof(uint16_t));
+    graph->tree = malloc((count + 1) * sizeof(struct PathTreeEntrance));
+    if (graph->treeLocal == NULL || graph->tree == NULL) {
+        return -1;
+    }
+    for (long i = 0; i < clusters; i++) {
+        findEntrances(maze, (int)(i / graph->clusterCols) * PATH_CLUSTER,
+                      (int)(i % graph->clusterCols) * PATH_CLUSTER, graph->treeLocal + graph->treeStart[i], exits);
+    }
+
+    uint32_t cells = (uint32_t)maze->height * maze->width;
+    uint32_t order = 1, depth = 0;
+    int above = -1;
+    int y = maze->startY, x = maze->startX;
+    int entrance = treeEntrance(graph, y, x);
+    if (entrance >= 0) {
+        graph->tree[entrance] = (struct PathTreeEntrance){ 0, 0, 0, -1, (int)clusterOf(graph, y, x) };
+        above = entrance;
+    }
+    int direction = UP;
+    for (;;) {
+        int open = mazeOpenNeighbors(maze, y, x);
+        int parent = mazeParentDirection(maze, y, x);
+        while (direction <= RIGHT && (!(open & DIR_BIT(direction)) || direction == parent)) {
+            direction++;
+        }
+        if (direction <= RIGHT) {
+            // Down to a child
+            if (order == cells) {
+                return -1;
+            }
+            y += stepY[direction];
+            x += stepX[direction];
+            depth++;
+            entrance = treeEntrance(graph, y, x);
+            if (entrance >= 0) {
+                graph->tree[entrance] = (struct PathTreeEntrance){ order, 0, depth, above, (int)clusterOf(graph, y, x) };
+                above = entrance;
+            }
+            order++;
+            direction = UP;
+            continue;
+        }
+
+        // Every child walked: back up, to the direction after this one
+        entrance = treeEntrance(graph, y, x);
+        if (entrance >= 0) {
+            graph->tree[entrance].out = order - 1;
+            above = graph->tree[entrance].above;
+        }
+        if (parent < 0) {
+            break;
+        }
+        y += stepY[parent];
+        x += stepX[parent];
+        depth--;
+        direction = (parent ^ 1) + 1;
+    }
+    return 0;
+}
+
+// Climb from (y, x) towards the start to the first entrance, (y, x) itself
+// if it is one, adding the steps to *depth. Returns -1 if the start comes first.
+static int climbTree(const PathGraph* graph, const Maze* maze, int y, int x, uint32_t* depth) {
+    for (;;) {
+        int entrance = treeEntrance(graph, y, x);
+        if (entrance >= 0) {
+            return entrance;
+        }
+        int parent = mazeParentDirection(maze, y, x);
+        if (parent < 0) {
+            return -1;
+        }
+        y += stepY[parent];
+        x += stepX[parent];
+        (*depth)++;
+    }
+}
+
+// Is the entrance on the way from the cell below first entrance `below` to the start?
+static bool treeAbove(const PathGraph* graph, int entrance, int below) {
+    return below >= 0 && graph->tree[entrance].in <= graph->tree[below].in &&
+           graph->tree[below].in <= graph->tree[entrance].out;
+}
+
+static void entranceCell(const PathGraph* graph, int entrance, int* y, int* x) {
+    int cluster = graph->tree[entrance].cluster;
+    *y = cluster / graph->clusterCols * PATH_CLUSTER + graph->treeLocal[entrance] / PATH_CLUSTER;
+    *x = cluster % graph->clusterCols * PATH_CLUSTER + graph->treeLocal[entrance] % PATH_CLUSTER;
+}
+
+// The walk between two cells of a tree-shaped maze climbs from one end to
+// where the ways to the start meet, then down to the other end. Its
+// entrances are those above the start that are not above the goal, then
+// those above the goal that are not above the start, reversed; between them
+// the walk stays in one cluster, unless it changes cluster at the lowest
+// entrance above both, which it then passes through.
+static int treePath(PathGraph* graph, PathPlan* plan, const Maze* maze, int fromY, int fromX,
+                    int toY, int toX) {
+    uint32_t fromDepth = 0, toDepth = 0;
+    int fromEntrance = climbTree(graph, maze, fromY, fromX, &fromDepth);
+    int toEntrance = climbTree(graph, maze, toY, toX, &toDepth);
+    fromDepth += fromEntrance >= 0 ? graph->tree[fromEntrance].depth : 0;
+    toDepth += toEntrance >= 0 ? graph->tree[toEntrance].depth : 0;
+    if (plan != NULL) {
+        plan->count = 0;
+        plan->next = 0;
+        plan->fieldY = plan->fieldX = -1;
+    }
+
+    // Up from the start
+    int upY = fromY, upX = fromX;
+    uint32_t upDepth = fromDepth;
+    int entrance = fromEntrance;
+    for (; entrance >= 0 && !treeAbove(graph, entrance, toEntrance); entrance = graph->tree[entrance].above) {
+        entranceCell(graph, entrance, &upY, &upX);
+        upDepth = graph->tree[entrance].depth;
+        if (plan != NULL && addWaypoint(plan, upY, upX) < 0) {
+            plan->targetY = plan->targetX = -1;
+            return -1;
+        }
+    }
+    int meet = entrance;
+
+    // The highest entrance of the way down to the goal
+    int downY = toY, downX = toX;
+    uint32_t downDepth = toDepth;
+    int downCount = 0;
+    for (entrance = toEntrance; entrance >= 0 && !treeAbove(graph, entrance, fromEntrance);
+         entrance = graph->tree[entrance].above) {
+        downDepth = graph->tree[entrance].depth;
+        downCount++;
+        if (graph->tree[entrance].above < 0 || treeAbove(graph, graph->tree[entrance].above, fromEntrance)) {
+            entranceCell(graph, entrance, &downY, &downX);
+        }
+    }
+
+    // Across where they meet
+    int steps;
+    if (upY / PATH_CLUSTER != downY / PATH_CLUSTER || upX / PATH_CLUSTER != downX / PATH_CLUSTER) {
+        if (meet < 0) {
+            return -1;
+        }
+        steps = (int)(upDepth + downDepth - 2 * graph->tree[meet].depth);
+        int meetY, meetX;
+        entranceCell(graph, meet, &meetY, &meetX);
+        if (plan != NULL && addWaypoint(plan, meetY, meetX) < 0) {
+            plan->targetY = plan->targetX = -1;
+            return -1;
+        }
+    } else {
+        clusterField(maze, downY, downX, graph->goalField, graph->queue);
+        if (graph->goalField[localIndex(upY, upX)] == PATH_UNREACHED) {
+            return -1;
+        }
+        steps = graph->goalField[localIndex(upY, upX)];
+    }
+    steps += (int)(fromDepth - upDepth) + (int)(toDepth - downDepth);
+
+    if (plan != NULL) {
+        // Down to the goal, listed up from it and then reversed
+        int first = plan->count;
+        for (entrance = toEntrance; downCount-- > 0; entrance = graph->tree[entrance].above) {
+            int y, x;
+            entranceCell(graph, entrance, &y, &x);
+            if (addWaypoint(plan, y, x) < 0) {
+                plan->targetY = plan->targetX = -1;
+                return -1;
+            }
+        }
+        for (int i = first, j = plan->count - 1; i < j; i++, j--) {
+            int y = plan->waypoints[2 * i], x = plan->waypoints[2 * i + 1];
+            plan->waypoints[2 * i] = plan->waypoints[2 * j];
+            plan->waypoints[2 * i + 1] = plan->waypoints[2 * j + 1];
+            plan->waypoints[2 * j] = y;
+            plan->waypoints[2 * j + 1] = x;
+        }
+        if (addWaypoint(plan, toY, toX) < 0) {
+            plan->targetY = plan->targetX = -1;
+            return -1;
+        }
+        plan->targetY = toY;
+        plan->targetX = toX;
+        plan->generatedRows = maze->generatedRows;
+    }
+    return steps;
+}
+
+// Shortest walk between two cells, and when plan is not NULL the entrances
+// along it. Returns -1 if there is none or no memory for the search.
+static int searchPath(PathGraph* graph, PathPlan* plan, const Maze* maze, int fromY, int fromX,
+                      int toY, int toX) {
+    if (!mazeIsOpen(maze, fromY, fromX) || !mazeIsOpen(maze, toY, toX) ||
+        fromY >= maze->generatedRows || toY >= maze->generatedRows || sizeGraph(graph, maze) < 0) {
+        return -1;
+    }
+    if (maze->links != NULL && maze->stream == NULL) {
+        if (graph->treeState == 0 && buildTree(graph, maze) < 0) {
+            freeTree(graph);
+            graph->treeState = -1;
+        } else if (graph->treeState == 0) {
+            graph->treeState = 1;
+        }
+        if (graph->treeState > 0) {
+            return treePath(graph, plan, maze, fromY, fromX, toY, toX);
+        }
+    }
+
+    long startIndex = clusterOf(graph, fromY, fromX);
+    long goalIndex = clusterOf(graph, toY, toX);
+    PathCluster* start = useCluster(graph, maze, startIndex, fromY - fromY % PATH_CLUSTER);
+    PathCluster* goal = useCluster(graph, maze, goalIndex, toY - toY % PATH_CLUSTER);
+    if (start == NULL || goal == NULL) {
+        return -1;
+    }
+    nextStamp(graph);
+
+    // Steps left from each entrance of the goal's cluster, and the walk that
+    // never leaves the cluster when both ends share one
+    clusterField(maze, toY, toX, graph->goalField, graph->queue);
+    int best = INT_MAX;
+    long bestNode = -1;
+    if (startIndex == goalIndex && graph->goalField[localIndex(fromY, fromX)] != PATH_UNREACHED) {
+        best = graph->goalField[localIndex(fromY, fromX)];
+    }
+
+    clusterField(maze, fromY, fromX, graph->startField, graph->queue);
+    for (int i = 0; i < start->count; i++) {
+        uint16_t steps = graph->startField[start->local[i]];
+        if (steps != PATH_UNREACHED && relax(graph, start, startIndex, i, steps, -1, toY, toX) < 0) {
+            return -1;
+        }
+    }
+
+    while (graph->heapCount > 0) {
+        struct PathHeapEntry entry = heapPop(graph);
+        if (entry.estimate >= best) {
+            break;
+        }
+        long index = entry.node / PATH_MAX_ENTRANCES;
+        int entrance = (int)(entry.node % PATH_MAX_ENTRANCES);
+        PathCluster* cluster = &graph->clusters[index];
+        PathNode* node = &cluster->nodes[entrance];
+        if (node->closed || node->cost != entry.cost) {
+            continue;
+        }
+        node->closed = true;
+
+        int local = cluster->local[entrance];
+        if (index == goalIndex && graph->goalField[local] != PATH_UNREACHED &&
+            entry.cost + graph->goalField[local] < best) {
+            best = entry.cost + graph->goalField[local];
+            bestNode = entry.node;
+        }
+
+        for (int edge = cluster->edgeStart[entrance]; edge < cluster->edgeStart[entrance + 1]; edge++) {
+            if (relax(graph, cluster, index, cluster->edgeTo[edge], entry.cost + cluster->edgeSteps[edge],
+                      entry.node, toY, toX) < 0) {
+                return -1;
+            }
+        }
+
+        int y = cluster->originY + local / PATH_CLUSTER;
+        int x = (int)(index % graph->clusterCols) * PATH_CLUSTER + local % PATH_CLUSTER;
+        for (int direction = UP; direction <= RIGHT; direction++) {
+            int nextY = y + stepY[direction];
+            int nextX = x + stepX[direction];
+            if (!(cluster->exits[entrance] & DIR_BIT(direction)) || !mazeIsOpen(maze, nextY, nextX)) {
+                continue; // Not a way out, or into rows a streaming maze has dropped
+            }
+            long nextIndex = clusterOf(graph, nextY, nextX);
+            PathCluster* next = useCluster(graph, maze, nextIndex, nextY - nextY % PATH_CLUSTER);
+            if (next == NULL) {
+                return -1;
+            }
+            int nextEntrance = findEntrance(next, localIndex(nextY, nextX));
+            if (nextEntrance >= 0 &&
+                relax(graph, next, nextIndex, nextEntrance, entry.cost + 1, entry.node, toY, toX) < 0) {
+                return -1;
+            }
+        }
+    }
+    if (best == INT_MAX) {
+        return -1;
+    }
+
+    if (plan != NULL) {
+        // Entrances from the goal back to the start, then reversed
+        plan->count = 0;
+        plan->next = 0;
+        plan->fieldY = plan->fieldX = -1;
+        for (long node = bestNode; node >= 0;) {
+            long index = node / PATH_MAX_ENTRANCES;
+            PathCluster* cluster = &graph->clusters[index];
+            int local = cluster->local[node % PATH_MAX_ENTRANCES];
+            if (addWaypoint(plan, cluster->originY + local / PATH_CLUSTER,
+                            (int)(index % graph->clusterCols) * PATH_CLUSTER + local % PATH_CLUSTER) < 0) {
+                plan->targetY = plan->targetX = -1;
+                return -1;
+            }
+            node = cluster->nodes[node % PATH_MAX_ENTRANCES].parent;
+        }
+        for (int i = 0, j = plan->count - 1; i < j; i++, j--) {
+            int y = plan->waypoints[2 * i], x = plan->waypoints[2 * i + 1];
+            plan->waypoints[2 * i] = plan->waypoints[2 * j];
+            plan->waypoints[2 * i + 1] = plan->waypoints[2 * j + 1];
+            plan->waypoints[2 * j] = y;
+            plan->waypoints[2 * j + 1] = x;
+        }
+        if (addWaypoint(plan, toY, toX) < 0) {
+            plan->targetY = plan->targetX = -1;
+            return -1;
+        }
+        plan->targetY = toY;
+        plan->targetX = toX;
+        plan->generatedRows = maze->generatedRows;
+    }
+    return best;
+}
+
+// Steps along open cells from one cell to another; -1 if there is no path
+int pathDistance(PathGraph* graph, const Maze* maze, int fromY, int fromX, int toY, int toX) {
+    return searchPath(graph, NULL, maze, fromY, fromX, toY, toX);
+}
+
+// Plan the shortest walk from one cell to another for pathStep() to follow.
+// Returns its length, or -1 if there is none; the plan is then empty.
+int planPath(PathGraph* graph, PathPlan* plan, const Maze* maze, int fromY, int fromX, int toY, int toX) {
+    plan->targetY = plan->targetX = -1;
+    plan->count = plan->next = 0;
+    return searchPath(graph, plan, maze, fromY, fromX, toY, toX);
+}
+
+// Direction of the next step from (y, x) along the plan. Returns -1 at the
+// target, or when (y, x) is not on the plan or rows have been carved since,
+// and it has to be made again.
+int pathStep(PathGraph* graph, PathPlan* plan, const Maze* maze, int y, int x) {
+    if (plan->generatedRows != maze->generatedRows) {
+        return -1;
+    }
+    while (plan->next < plan->count && plan->waypoints[2 * plan->next] == y &&
+           plan->waypoints[2 * plan->next + 1] == x) {
+        plan->next++;
+    }
+    if (plan->next == plan->count) {
+        return -1;
+    }
+    int wayY = plan->waypoints[2 * plan->next];
+    int wayX = plan->waypoints[2 * plan->next + 1];
+    int open = mazeOpenNeighbors(maze, y, x);
+
+    // Across a border, or a waypoint right next door
+    for (int direction = UP; direction <= RIGHT; direction++) {
+        if ((open & DIR_BIT(direction)) && y + stepY[direction] == wayY && x + stepX[direction] == wayX) {
+            return direction;
+        }
+    }
+
+    // Otherwise the waypoint is in this cluster: walk down its local field
+    if (y / PATH_CLUSTER != wayY / PATH_CLUSTER || x / PATH_CLUSTER != wayX / PATH_CLUSTER) {
+        return -1;
+    }
+    if (plan->fieldY != wayY || plan->fieldX != wayX) {
+        clusterField(maze, wayY, wayX, plan->field, graph->queue);
+        plan->fieldY = wayY;
+        plan->fieldX = wayX;
+    }
+    uint16_t steps = plan->field[localIndex(y, x)];
+    if (steps == PATH_UNREACHED) {
+        return -1;
+    }
+    for (int direction = UP; direction <= RIGHT; direction++) {
+        int nextY = y + stepY[direction];
+        int nextX = x + stepX[direction];
+        if ((open & DIR_BIT(direction)) && nextY / PATH_CLUSTER == y / PATH_CLUSTER &&
+            nextX / PATH_CLUSTER == x / PATH_CLUSTER && plan->field[localIndex(nextY, nextX)] == steps - 1) {
+            return direction;
+        }
+    }
+    return -1;
+}
+
+void initPathPlan(PathPlan* plan) {
+    memset(plan, 0, sizeof(*plan));
+    plan->targetY = plan->targetX = -1;
+    plan->fieldY = plan->fieldX = -1;
+}
+
+void freePathPlan(PathPlan* plan) {
+    free(plan->waypoints);
+    initPathPlan(plan);
+}
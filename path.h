@@ -0,0 +1,88 @@
+#ifndef PATH_H
+#define PATH_H
+
+#include <stdint.h>
+#include "maze.h"
+
+// Hierarchical pathfinding (HPA*) for large mazes. The maze is cut into
+// PATH_CLUSTER x PATH_CLUSTER clusters. Every open border cell with an open
+// neighbour in the next cluster is an entrance, and a cluster stores the
+// walking distance between each pair of its entrances, measured without
+// leaving it. A query searches the cells of the start and goal clusters
+// only, then runs A* over entrances, where a step is either a stored
+// distance inside a cluster or one cell across a border. Every border
+// crossing is an entrance, so the distances are exact, not approximate.
+//
+// Clusters are built the first time a search reaches them and cached for the
+// rest of the game. Walls never change once carved, so moving the exit or
+// the survivor costs no rebuilding, only a fresh search of the goal's
+// cluster. A streaming maze rebuilds a cluster once more of its rows, or the
+// row below it, have been carved, or rows of it dropped; its bands of
+// clusters take turns in slots for its window, as its rows do.
+//
+// A generated maze that is not streamed is a tree, so the walk between two
+// cells is unique and A* has nothing to choose. Its entrances are indexed
+// instead, by one walk of the whole tree from the start on the first query
+// of a maze (tens of milliseconds at 1001x1001): each records its depth, the
+// nearest entrance above it, and the span of preorder numbers of the cells
+// below it. A query climbs from both ends to the first entrance above each,
+// within their clusters, then follows the chains of entrances above those
+// to where they meet; the entrances passed are the plan, and the length
+// comes from their depths and one local search where the chains meet. No
+// cluster is built and nothing beyond the two ends' clusters is searched,
+// so a replan after the exit or the survivor moves costs tens of
+// nanoseconds per entrance on the way, tens of microseconds across a
+// 1001x1001 maze. Streaming mazes and mazes without links use A*.
+//
+// A plan keeps the entrances along the path found, and following it costs
+// one local search per cluster crossed and a neighbour lookup per step. New
+// rows of a streaming maze can join cells through them, so a plan lapses
+// once more rows are carved.
+
+#define PATH_CLUSTER 32
+#define PATH_CLUSTER_CELLS (PATH_CLUSTER * PATH_CLUSTER)
+#define PATH_UNREACHED 0xFFFF
+
+typedef struct PathCluster PathCluster;
+
+// Cached clusters of one maze and the scratch space of its searches
+typedef struct {
+    int height, width;              // Maze the clusters belong to
+    int clusterRows, clusterCols;
+    PathCluster* clusters;
+    long* built;                    // Clusters built since the last reset
+    long builtCount, builtCapacity;
+    unsigned int stamp;             // Current search
+    struct PathHeapEntry* heap;     // A* open list
+    int heapCount, heapCapacity;
+    int treeState;                  // 1 when the tree index is built, -1 when the maze is not a tree, else 0
+    int* treeStart;                 // Entrances of cluster i are numbered treeStart[i] to treeStart[i + 1] - 1
+    uint16_t* treeLocal;            // Cell of each, as an index into its cluster
+    struct PathTreeEntrance* tree;
+    uint16_t startField[PATH_CLUSTER_CELLS];
+    uint16_t goalField[PATH_CLUSTER_CELLS];
+    uint16_t queue[PATH_CLUSTER_CELLS];
+} PathGraph;
+
+// A path being followed: the entrances it passes through, then the target
+typedef struct {
+    int targetY, targetX;           // -1 when there is no plan
+    int generatedRows;              // maze->generatedRows when it was made
+    int* waypoints;                 // y, x pairs
+    int count, next;                // Waypoints, and the first one not yet reached
+    int capacity;
+    int fieldY, fieldX;             // Waypoint the local field leads to, -1 for none
+    uint16_t field[PATH_CLUSTER_CELLS];
+} PathPlan;
+
+// Function declarations for hierarchical pathfinding
+void initPathGraph(PathGraph* graph);
+void resetPathGraph(PathGraph* graph);
+void freePathGraph(PathGraph* graph);
+int pathDistance(PathGraph* graph, const Maze* maze, int fromY, int fromX, int toY, int toX);
+int planPath(PathGraph* graph, PathPlan* plan, const Maze* maze, int fromY, int fromX, int toY, int toX);
+int pathStep(PathGraph* graph, PathPlan* plan, const Maze* maze, int y, int x);
+void initPathPlan(PathPlan* plan);
+void freePathPlan(PathPlan* plan);
+
+#endif // PATH_H
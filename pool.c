@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <string.h>
+#include "pool.h"
+
+// Keep the ring full until the pool is stopped
+static void* runPoolWorker(void* arg) {
+    GamePool* pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stopping) {
+        if (pool->count == pool->capacity) {
+            pthread_cond_wait(&pool->notFull, &pool->lock);
+            continue;
+        }
+
+        // Seeds stay within 32 bits so a lockstep host can hand them to its peer
+        uint64_t seed = rngNext(&pool->seedRng);
+        pthread_mutex_unlock(&pool->lock);
+
+        Game game;
+        int built = setupGame(&game, pool->height, pool->width, seed);
+
+        pthread_mutex_lock(&pool->lock);
+        if (built < 0) {
+            break; // Out of memory; callers build their own games from now on
+        }
+        if (pool->stopping) {
+            freeMaze(&game.maze);
+            break;
+        }
+        pool->ring[(pool->head + pool->count) % pool->capacity] = game;
+        pool->count++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Start a worker keeping up to capacity games of the given size ready.
+// Returns -1 if the thread could not be started; the pool is then simply empty.
+int startGamePool(GamePool* pool, int capacity, int height, int width, uint64_t seed) {
+    memset(pool, 0, sizeof(*pool));
+    pool->capacity = capacity < 1 ? 1 : capacity > GAME_POOL_MAX ? GAME_POOL_MAX : capacity;
+    pool->height = height;
+    pool->width = width;
+    rngSeed(&pool->seedRng, seed);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->notFull, NULL);
+
+    if (pthread_create(&pool->thread, NULL, runPoolWorker, pool) != 0) {
+        perror("Game pool thread failed");
+        return -1;
+    }
+    pool->running = true;
+    return 0;
+}
+
+// Move a ready game into *game. Returns false at once if none is ready.
+bool takePooledGame(GamePool* pool, Game* game) {
+    if (!pool->running) {
+        return false;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    bool taken = pool->count > 0;
+    if (taken) {
+        *game = pool->ring[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pthread_cond_signal(&pool->notFull);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return taken;
+}
+
+// Stop the worker and free every game it left in the ring
+void stopGamePool(GamePool* pool) {
+    if (pool->running) {
+        pthread_mutex_lock(&pool->lock);
+        pool->stopping = true;
+        pthread_cond_signal(&pool->notFull);
+        pthread_mutex_unlock(&pool->lock);
+        pthread_join(pool->thread, NULL);
+        pool->running = false;
+    }
+
+    for (int i = 0; i < pool->count; i++) {
+        freeMaze(&pool->ring[(pool->head + i) % pool->capacity].maze);
+    }
+    pool->count = 0;
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->notFull);
+}
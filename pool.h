@@ -0,0 +1,33 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <pthread.h>
+#include "engine.h"
+
+#define GAME_POOL_MAX 64
+
+// Games built ahead of time by a worker thread: maze carved, killer placed
+// and dice rolled, so starting a match is a struct copy. The worker refills
+// the ring whenever a game is taken; a caller that finds it empty builds
+// its own game instead of waiting.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t notFull;
+    Game ring[GAME_POOL_MAX];
+    int capacity;
+    int head;               // Oldest ready game
+    int count;
+    int height, width;      // Size of every pooled maze
+    Rng seedRng;            // Worker only
+    bool stopping;
+    bool running;
+    pthread_t thread;
+} GamePool;
+
+// Function declarations for the game pool
+int startGamePool(GamePool* pool, int capacity, int height, int width, uint64_t seed);
+bool takePooledGame(GamePool* pool, Game* game);
+void stopGamePool(GamePool* pool);
+
+#endif // POOL_H
@@ -0,0 +1,470 @@
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "render.h"
+
+// How a cell or a piece of status text looks
+#define STYLE_PLAIN 0
+#define STYLE_SURVIVOR 1
+#define STYLE_EXIT 2
+#define STYLE_KILLER 3
+#define STYLE_WALL 4
+#define STYLE_STATUS 5
+#define STYLE_MEMORY 6              // Walls seen before but out of sight now
+#define STYLE_UNKNOWN -1
+
+// The ncurses attributes of each style; the colour pairs are set up by initScreen()
+static const chtype styleAttrs[] = {
+    A_NORMAL,
+    A_BOLD | COLOR_PAIR(1),
+    COLOR_PAIR(2),
+    A_BOLD | COLOR_PAIR(3),
+    COLOR_PAIR(4),
+    COLOR_PAIR(5),
+    A_DIM | COLOR_PAIR(4),
+};
+
+// The same styles as SGR sequences, each resetting everything first so it
+// does not depend on what was sent before
+static const char* styleColors[] = {
+    "\033[0m",
+    "\033[0;1;32;40m",
+    "\033[0;36;40m",
+    "\033[0;1;31;40m",
+    "\033[0;37;40m",
+    "\033[0;33;40m",
+    "\033[0;2;37;40m",
+};
+static const char* styleMonochrome[] = {
+    "\033[0m", "\033[0;1m", "\033[0m", "\033[0;1m", "\033[0m", "\033[0m", "\033[0;2m",
+};
+
+// Worst case bytes per cell (an SGR sequence and the glyph) and per row
+// (a cursor move), used to size the frame buffer for the screen
+#define ANSI_CELL_BYTES 16
+#define ANSI_ROW_BYTES 16
+#define ANSI_SPARE_BYTES 1024      // Status lines, message and the cells of an incremental frame
+
+// The raw ANSI backend: one frame of escape codes, written at the end
+typedef struct {
+    int renderer;
+    int fd;
+    const char** styles;        // styleColors, or styleMonochrome without colour support
+    char* buffer;               // Sized for the screen, so only a resize reallocates it
+    size_t length, capacity;
+    int style;                  // Style in force at the end of the buffer
+} AnsiOutput;
+
+static AnsiOutput ansi = { RENDER_CURSES, STDOUT_FILENO, styleColors, NULL, 0, 0, STYLE_UNKNOWN };
+
+// What is currently on screen, so the next frame only touches what changed
+typedef struct {
+    bool valid;
+    const uint64_t* cells;      // Identifies the maze that was drawn
+    int height, width;
+    int lines, cols;
+    int generatedRows;          // Rows of a streaming maze carved when it was drawn
+    int firstRow;               // and the first row it still held
+    int viewY, viewX;           // Maze cell at the top left of the screen
+    int survivorY, survivorX;
+    int killerY, killerX;
+    int exitY, exitX;
+    int survivorMovesLeft, killerMovesLeft;
+    int currentTurn;
+    const Fov* fog;             // View the frame was drawn through, or NULL
+    unsigned int fogVersion;
+    int fogY, fogX;             // Its origin
+    char message[128];
+} Frame;
+
+static Frame lastFrame;
+static const Fov* mazeFog = NULL;   // Set by setMazeFog()
+
+// First status row under the maze, kept on screen when the maze is taller than the terminal
+int statusRow(Maze* maze) {
+    return maze->height + 1 < LINES - 3 ? maze->height + 1 : LINES - 3;
+}
+
+// Maze rows that fit above the status lines
+static int viewRows(Maze* maze) {
+    return statusRow(maze) - 1;
+}
+
+// Force the next drawMaze() to repaint everything; call after clearing the screen
+void invalidateMazeView() {
+    lastFrame.valid = false;
+}
+
+// Scroll one axis of the view so position stays away from its edges. The view
+// jumps to centre the player rather than creeping a cell at a time, so most
+// moves still draw incrementally.
+static int followAxis(int view, int position, int mazeSize, int screenSize) {
+    if (mazeSize <= screenSize) {
+        return 0;
+    }
+    int margin = screenSize / 4;
+    if (position < view + margin || position >= view + screenSize - margin) {
+        view = position - screenSize / 2;
+    }
+    if (view > mazeSize - screenSize) {
+        view = mazeSize - screenSize;
+    }
+    return view < 0 ? 0 : view;
+}
+
+// Choose how the maze screen is drawn; RENDER_ANSI frames are written to fd
+void setRenderer(int renderer, int fd) {
+    ansi.renderer = renderer;
+    ansi.fd = fd;
+    ansi.styles = has_colors() ? styleColors : styleMonochrome;
+    // ncurses must not move the cursor about under frames it did not draw
+    leaveok(stdscr, renderer == RENDER_ANSI);
+    lastFrame.valid = false;
+}
+
+// Draw the maze through a player's view from now on, or all of it for NULL
+void setMazeFog(const Fov* fov) {
+    mazeFog = fov;
+}
+
+// Use the renderer named by RENDER_ENV, drawing to the terminal on stdout
+void initRenderer() {
+    const char* name = getenv(RENDER_ENV);
+    setRenderer(name != NULL && strcmp(name, "ansi") == 0 ? RENDER_ANSI : RENDER_CURSES, STDOUT_FILENO);
+}
+
+// Start an ANSI frame: let ncurses send what it still owes the screen, such
+// as a clear(), and make sure the buffer holds a whole screen of cells.
+// Returns false if it cannot, after falling back to ncurses for good.
+static bool ansiBegin() {
+    if (is_wintouched(stdscr)) {
+        refresh();
+    }
+    size_t needed = (size_t)LINES * ((size_t)COLS * ANSI_CELL_BYTES + ANSI_ROW_BYTES) + ANSI_SPARE_BYTES;
+    if (needed > ansi.capacity) {
+        char* buffer = realloc(ansi.buffer, needed);
+        if (buffer == NULL) {
+            setRenderer(RENDER_CURSES, ansi.fd);
+            clearok(curscr, TRUE); // ncurses has no idea what is on screen
+            return false;
+        }
+        ansi.buffer = buffer;
+        ansi.capacity = needed;
+    }
+    ansi.length = 0;
+    ansi.style = STYLE_UNKNOWN;
+    return true;
+}
+
+static void ansiAppend(const char* bytes, size_t count) {
+    if (ansi.length + count <= ansi.capacity) {
+        memcpy(ansi.buffer + ansi.length, bytes, count);
+        ansi.length += count;
+    }
+}
+
+static inline void ansiPut(char glyph) {
+    if (ansi.length < ansi.capacity) {
+        ansi.buffer[ansi.length++] = glyph;
+    }
+}
+
+// Switch style only when it changes, so a run of alike cells shares one SGR sequence
+static inline void ansiStyle(int style) {
+    if (style != ansi.style) {
+        ansiAppend(ansi.styles[style], strlen(ansi.styles[style]));
+        ansi.style = style;
+    }
+}
+
+static void ansiMove(int row, int column) {
+    char move[32];
+    int count = snprintf(move, sizeof(move), "\033[%d;%dH", row + 1, column + 1);
+    ansiAppend(move, count);
+}
+
+// Clear from the cursor to the end of the line, as clrtoeol() does
+static void ansiClearLine() {
+    ansiStyle(STYLE_PLAIN);
+    ansiAppend("\033[K", 3);
+}
+
+// Text starting at column, cut short of the last column so the terminal never wraps or scrolls
+static void ansiText(const char* text, int column) {
+    size_t room = column < COLS - 1 ? (size_t)(COLS - 1 - column) : 0;
+    size_t count = strlen(text);
+    ansiAppend(text, count < room ? count : room);
+}
+
+// Send the frame in one write(), leaving the attributes ncurses expects
+static void ansiFlush() {
+    if (ansi.length == 0) {
+        return; // Nothing changed
+    }
+    ansiStyle(STYLE_PLAIN);
+    size_t sent = 0;
+    while (sent < ansi.length) {
+        ssize_t count = write(ansi.fd, ansi.buffer + sent, ansi.length - sent);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        sent += count;
+    }
+    ansi.length = 0;
+}
+
+// The glyph and style of a maze cell, with the players standing on it.
+// Through fog, cells out of sight show only the walls remembered there.
+static inline int cellLook(Maze* maze, int y, int x, int survivorY, int survivorX, int killerY, int killerX,
+                           char* glyph) {
+    if (mazeFog != NULL && !fovVisible(mazeFog, y, x)) {
+        bool remembered = fovSeen(mazeFog, y, x) && !mazeIsOpen(maze, y, x);
+        *glyph = remembered ? WALL : EMPTY;
+        return remembered ? STYLE_MEMORY : STYLE_PLAIN;
+    }
+    if (y == survivorY && x == survivorX) {
+        *glyph = SURVIVOR;
+        return STYLE_SURVIVOR;
+    }
+    if (y == killerY && x == killerX) {
+        *glyph = KILLER;
+        return STYLE_KILLER;
+    }
+    *glyph = mazeCellChar(maze, y, x);
+    return *glyph == EXIT ? STYLE_EXIT : *glyph == WALL ? STYLE_WALL : STYLE_PLAIN;
+}
+
+// Draw one maze cell with its attributes in a single call
+static void drawCell(Maze* maze, int y, int x, int survivorY, int survivorX, int killerY, int killerX) {
+    int screenY = y - lastFrame.viewY;
+    int screenX = x - lastFrame.viewX;
+    if (y < 0 || y >= maze->height || screenY < 0 || screenY >= viewRows(maze) ||
+        x < 0 || x >= maze->width || screenX < 0 || screenX >= COLS) {
+        return; // Off screen
+    }
+
+    char glyph;
+    int style = cellLook(maze, y, x, survivorY, survivorX, killerY, killerX, &glyph);
+    if (ansi.renderer == RENDER_ANSI) {
+        ansiMove(screenY, screenX);
+        ansiStyle(style);
+        ansiPut(glyph);
+    } else {
+        mvaddch(screenY, screenX, (unsigned char)glyph | styleAttrs[style]);
+    }
+}
+
+// Redraw the square a view was cast over, for the cells that came into or went out of sight
+static void drawFogSquare(Maze* maze, int originY, int originX,
+                          int survivorY, int survivorX, int killerY, int killerX) {
+    for (int y = originY - FOV_RADIUS; y <= originY + FOV_RADIUS; y++) {
+        for (int x = originX - FOV_RADIUS; x <= originX + FOV_RADIUS; x++) {
+            drawCell(maze, y, x, survivorY, survivorX, killerY, killerX);
+        }
+    }
+}
+
+// Draw every maze cell in view: cell by cell with ncurses, or as one cursor
+// move per row and one SGR sequence per run of alike cells
+static void drawView(Maze* maze, int survivorY, int survivorX, int killerY, int killerX) {
+    int viewY = lastFrame.viewY;
+    int viewX = lastFrame.viewX;
+    if (ansi.renderer != RENDER_ANSI) {
+        erase();
+        for (int y = viewY; y < maze->height && y < viewY + viewRows(maze); y++) {
+            for (int x = viewX; x < maze->width && x < viewX + COLS; x++) {
+                drawCell(maze, y, x, survivorY, survivorX, killerY, killerX);
+            }
+        }
+        return;
+    }
+
+    ansiStyle(STYLE_PLAIN);
+    ansiAppend("\033[H\033[2J", 7);
+    for (int y = viewY; y < maze->height && y < viewY + viewRows(maze); y++) {
+        ansiMove(y - viewY, 0);
+        for (int x = viewX; x < maze->width && x < viewX + COLS; x++) {
+            char glyph;
+            ansiStyle(cellLook(maze, y, x, survivorY, survivorX, killerY, killerX, &glyph));
+            ansiPut(glyph);
+        }
+    }
+}
+
+// drawStatus() for the ANSI backend
+static void ansiStatus(Maze* maze, int survivorMovesLeft, int killerMovesLeft, int currentTurn) {
+    int row = statusRow(maze);
+    char line[64];
+
+    ansiMove(row, 0);
+    ansiClearLine();
+    if (currentTurn == SURVIVOR_TURN) {
+        ansiStyle(STYLE_SURVIVOR);
+        ansiText("SURVIVOR'S TURN", 0);
+        ansiMove(row, 17);
+        snprintf(line, sizeof(line), " (Use arrow keys) - Moves left: %d", survivorMovesLeft);
+        ansiStyle(STYLE_STATUS);
+        ansiText(line, 17);
+    } else {
+        ansiStyle(STYLE_KILLER);
+        ansiText("KILLER'S TURN", 0);
+        ansiMove(row, 14);
+        snprintf(line, sizeof(line), " (Use WASD keys) - Moves left: %d", killerMovesLeft);
+        ansiStyle(STYLE_STATUS);
+        ansiText(line, 14);
+    }
+
+    ansiMove(row + 1, 0);
+    ansiClearLine();
+    ansiStyle(STYLE_STATUS);
+    ansiText("Survivor: Arrow keys | Killer: WASD | End Turn: Space | Quit: q", 0);
+}
+
+// Draw the turn/moves line and the key help line
+static void drawStatus(Maze* maze, int survivorMovesLeft, int killerMovesLeft, int currentTurn) {
+    if (ansi.renderer == RENDER_ANSI) {
+        ansiStatus(maze, survivorMovesLeft, killerMovesLeft, currentTurn);
+        return;
+    }
+    int row = statusRow(maze);
+
+    move(row, 0);
+    clrtoeol();
+    if (currentTurn == SURVIVOR_TURN) {
+        attron(COLOR_PAIR(1) | A_BOLD);
+        mvprintw(row, 0, "SURVIVOR'S TURN");
+        attroff(COLOR_PAIR(1) | A_BOLD);
+        attron(COLOR_PAIR(5));
+        mvprintw(row, 17, " (Use arrow keys) - Moves left: %d", survivorMovesLeft);
+    } else {
+        attron(COLOR_PAIR(3) | A_BOLD);
+        mvprintw(row, 0, "KILLER'S TURN");
+        attroff(COLOR_PAIR(3) | A_BOLD);
+        attron(COLOR_PAIR(5));
+        mvprintw(row, 14, " (Use WASD keys) - Moves left: %d", killerMovesLeft);
+    }
+    
+    mvprintw(row + 1, 0, "Survivor: Arrow keys | Killer: WASD | End Turn: Space | Quit: q");
+    attroff(COLOR_PAIR(5));
+}
+
+// Draw the maze. Mazes larger than the terminal are seen through a view
+// that follows whoever's turn it is. The first frame (or one after
+// invalidateMazeView(), a resize or a scroll) paints everything; later
+// frames only repaint the cells the players and the exit left or entered,
+// and the status line if it changed. With RENDER_ANSI the frame goes out
+// in one write() instead of through refresh().
+void drawMaze(Maze* maze, int survivorY, int survivorX, int killerY, int killerX,
+              int survivorMovesLeft, int killerMovesLeft, int currentTurn) {
+    if (ansi.renderer == RENDER_ANSI) {
+        ansiBegin(); // On failure this frame is drawn whole by ncurses
+    }
+    bool survivorTurn = (currentTurn == SURVIVOR_TURN);
+    bool sameMaze = lastFrame.valid && lastFrame.cells == maze->cells &&
+                    lastFrame.height == maze->height && lastFrame.width == maze->width;
+    int viewY = followAxis(sameMaze ? lastFrame.viewY : 0, survivorTurn ? survivorY : killerY,
+                           maze->height, viewRows(maze));
+    int viewX = followAxis(sameMaze ? lastFrame.viewX : 0, survivorTurn ? survivorX : killerX,
+                           maze->width, COLS);
+
+    // A streaming maze that carved rows the last frame showed as wall, or
+    // dropped rows it showed, is repainted too
+    bool full = !sameMaze || lastFrame.lines != LINES || lastFrame.cols != COLS || mazeFog != lastFrame.fog ||
+                viewY != lastFrame.viewY || viewX != lastFrame.viewX ||
+                (maze->generatedRows != lastFrame.generatedRows &&
+                 lastFrame.generatedRows < viewY + viewRows(maze)) ||
+                (maze->firstRow != lastFrame.firstRow && maze->firstRow > viewY);
+    lastFrame.viewY = viewY;
+    lastFrame.viewX = viewX;
+
+    if (full) {
+        drawView(maze, survivorY, survivorX, killerY, killerX);
+        drawStatus(maze, survivorMovesLeft, killerMovesLeft, currentTurn);
+        lastFrame.message[0] = '\0';
+    } else {
+        bool moved = survivorY != lastFrame.survivorY || survivorX != lastFrame.survivorX ||
+                     killerY != lastFrame.killerY || killerX != lastFrame.killerX ||
+                     maze->exitY != lastFrame.exitY || maze->exitX != lastFrame.exitX;
+        if (mazeFog != NULL && mazeFog->version != lastFrame.fogVersion) {
+            drawFogSquare(maze, lastFrame.fogY, lastFrame.fogX, survivorY, survivorX, killerY, killerX);
+            drawFogSquare(maze, mazeFog->originY, mazeFog->originX, survivorY, survivorX, killerY, killerX);
+        }
+        if (moved) {
+            // Old positions first, so a cell vacated by one piece and entered by another ends up right
+            drawCell(maze, lastFrame.survivorY, lastFrame.survivorX, survivorY, survivorX, killerY, killerX);
+            drawCell(maze, lastFrame.killerY, lastFrame.killerX, survivorY, survivorX, killerY, killerX);
+            drawCell(maze, lastFrame.exitY, lastFrame.exitX, survivorY, survivorX, killerY, killerX);
+            drawCell(maze, maze->exitY, maze->exitX, survivorY, survivorX, killerY, killerX);
+            drawCell(maze, survivorY, survivorX, survivorY, survivorX, killerY, killerX);
+            drawCell(maze, killerY, killerX, survivorY, survivorX, killerY, killerX);
+        }
+
+        if (currentTurn != lastFrame.currentTurn ||
+            survivorMovesLeft != lastFrame.survivorMovesLeft ||
+            killerMovesLeft != lastFrame.killerMovesLeft) {
+            drawStatus(maze, survivorMovesLeft, killerMovesLeft, currentTurn);
+        }
+    }
+
+    lastFrame.valid = true;
+    lastFrame.cells = maze->cells;
+    lastFrame.height = maze->height;
+    lastFrame.width = maze->width;
+    lastFrame.lines = LINES;
+    lastFrame.cols = COLS;
+    lastFrame.generatedRows = maze->generatedRows;
+    lastFrame.firstRow = maze->firstRow;
+    lastFrame.survivorY = survivorY;
+    lastFrame.survivorX = survivorX;
+    lastFrame.killerY = killerY;
+    lastFrame.killerX = killerX;
+    lastFrame.exitY = maze->exitY;
+    lastFrame.exitX = maze->exitX;
+    lastFrame.survivorMovesLeft = survivorMovesLeft;
+    lastFrame.killerMovesLeft = killerMovesLeft;
+    lastFrame.currentTurn = currentTurn;
+    lastFrame.fog = mazeFog;
+    if (mazeFog != NULL) {
+        lastFrame.fogVersion = mazeFog->version;
+        lastFrame.fogY = mazeFog->originY;
+        lastFrame.fogX = mazeFog->originX;
+    }
+
+    if (ansi.renderer == RENDER_ANSI) {
+        ansiFlush();
+    } else {
+        refresh();
+    }
+}
+
+// Show a one-line message under the status lines; only rewritten when it changes
+void showMazeMessage(Maze* maze, const char* message) {
+    if (lastFrame.valid && strcmp(lastFrame.message, message) == 0) {
+        return;
+    }
+
+    int row = statusRow(maze) + 2;
+    if (ansi.renderer == RENDER_ANSI && ansiBegin()) {
+        ansiMove(row, 0);
+        ansiClearLine();
+        ansiStyle(STYLE_STATUS);
+        ansiText(message, 0);
+        ansiFlush();
+    } else {
+        move(row, 0);
+        clrtoeol();
+        attron(COLOR_PAIR(5));
+        mvprintw(row, 0, "%s", message);
+        attroff(COLOR_PAIR(5));
+        refresh();
+    }
+
+    strncpy(lastFrame.message, message, sizeof(lastFrame.message) - 1);
+    lastFrame.message[sizeof(lastFrame.message) - 1] = '\0';
+}
@@ -0,0 +1,30 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "maze.h"
+#include "fov.h"
+
+// The maze screen has two backends, picked at startup from RENDER_ENV.
+// RENDER_CURSES draws through ncurses, a library call or more per cell, and
+// ncurses works out what to send on refresh(). RENDER_ANSI composes each
+// frame in a buffer kept sized for the screen, with one cursor move per row
+// and one SGR sequence per run of cells that look alike, and sends it in a
+// single write(). ncurses is still used for input and the other screens;
+// they start with clear(), which makes it repaint everything, as it has no
+// idea what the ANSI frames put on screen.
+
+#define RENDER_CURSES 0
+#define RENDER_ANSI 1
+#define RENDER_ENV "DEJA_RENDER"    // "ansi" for RENDER_ANSI, anything else for RENDER_CURSES
+
+// Function declarations for drawing the maze screen
+void setRenderer(int renderer, int fd);
+void initRenderer();
+void setMazeFog(const Fov* fov);
+int statusRow(Maze* maze);
+void drawMaze(Maze* maze, int survivorY, int survivorX, int killerY, int killerX,
+              int survivorMovesLeft, int killerMovesLeft, int currentTurn);
+void showMazeMessage(Maze* maze, const char* message);
+void invalidateMazeView();
+
+#endif // RENDER_H
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <ncurses.h>
+#include "journal.h"
+#include "render.h"
+
+// Journal player. By default every game is replayed through the engine at
+// full speed and checked against the recorded outcome and state hash; -s
+// steps through one game on screen, one action per key press.
+//
+//   deja_replay [-v] [-s game] [journal]
+
+static const char* actionNames[] = { "up", "down", "left", "right", "end turn", "quit" };
+
+static const char* outcomeName(int outcome) {
+    if (!(outcome & JOURNAL_GAME_OVER)) {
+        return "unfinished";
+    }
+    return (outcome & JOURNAL_SURVIVOR_WON) ? "survivor" : "killer";
+}
+
+// Replay every game and print totals; returns the number of games that diverged
+static int replayAll(JournalReader* reader, bool verbose) {
+    long games = 0, diverged = 0, survivorWins = 0, killerWins = 0, unfinished = 0;
+    long turns = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    JournalGame header;
+    int status;
+    while ((status = journalNextGame(reader, &header)) > 0) {
+        Game game;
+        int result = journalReplayGame(reader, &header, &game);
+        if (result < 0) {
+            status = -1;
+            break;
+        }
+        games++;
+        diverged += result;
+        turns += game.turnCounter;
+        if (!(reader->outcome & JOURNAL_GAME_OVER)) {
+            unfinished++;
+        } else if (reader->outcome & JOURNAL_SURVIVOR_WON) {
+            survivorWins++;
+        } else {
+            killerWins++;
+        }
+        if (verbose) {
+            printf("%6ld  seed %-20llu %5dx%-5d %6d turns  %-10s %s\n", games,
+                   (unsigned long long)header.seed, header.height, header.width, game.turnCounter,
+                   outcomeName(reader->outcome), result == 0 ? "ok" : "DIVERGED");
+        }
+        freeMaze(&game.maze);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (status < 0) {
+        fprintf(stderr, "Journal is corrupt after game %ld\n", games);
+    }
+    printf("%ld games, %ld diverged: %ld survivor, %ld killer, %ld unfinished\n",
+           games, diverged, survivorWins, killerWins, unfinished);
+    if (games > 0) {
+        printf("%.1f turns and %.1f journal bytes per game, %.0f games/s\n",
+               (double)turns / games, (double)reader->length / games, elapsed > 0 ? games / elapsed : 0.0);
+    }
+    return status < 0 ? -1 : (int)diverged;
+}
+
+// Show one game on screen and apply its actions one key press at a time
+static int stepGame(JournalReader* reader, long target) {
+    JournalGame header;
+    for (long i = 0; i < target; i++) {
+        if (journalNextGame(reader, &header) <= 0) {
+            fprintf(stderr, "The journal has no game %ld\n", target);
+            return -1;
+        }
+    }
+
+    Game game;
+    if (setupGame(&game, header.height, header.width, header.seed) < 0) {
+        fprintf(stderr, "Not enough memory for a %dx%d maze\n", header.height, header.width);
+        return -1;
+    }
+    game.relocateInterval = header.relocateInterval;
+
+    initscr();
+    cbreak();
+    noecho();
+    curs_set(0);
+    if (has_colors()) {
+        start_color();
+        use_default_colors();
+        init_pair(1, COLOR_GREEN, COLOR_BLACK);  // Survivor
+        init_pair(2, COLOR_CYAN, COLOR_BLACK);   // Exit
+        init_pair(3, COLOR_RED, COLOR_BLACK);    // Killer
+        init_pair(4, COLOR_WHITE, COLOR_BLACK);  // Wall
+        init_pair(5, COLOR_YELLOW, COLOR_BLACK); // Status text
+    }
+    initRenderer();
+    invalidateMazeView();
+
+    char message[128];
+    long step = 0;
+    int action = 0;
+    while (action != JOURNAL_END) {
+        drawMaze(&game.maze, game.survivorY, game.survivorX, game.killerY, game.killerX,
+                 game.survivorMovesLeft, game.killerMovesLeft, game.currentTurn);
+        action = journalNextAction(reader);
+        if (action < 0) {
+            break;
+        }
+        if (action == JOURNAL_END) {
+            snprintf(message, sizeof(message), "Game %ld over after %ld actions: %s. Press any key.",
+                     target, step, outcomeName(reader->outcome));
+        } else {
+            snprintf(message, sizeof(message), "Game %ld, action %ld: %s %s. Any key steps, q quits.",
+                     target, step + 1, game.currentTurn == SURVIVOR_TURN ? "survivor" : "killer",
+                     actionNames[action]);
+        }
+        showMazeMessage(&game.maze, message);
+
+        int ch = getch();
+        if (ch == 'q' || ch == 'Q') {
+            break;
+        }
+        if (action != JOURNAL_END) {
+            applyAction(&game, action);
+            step++;
+        }
+    }
+
+    endwin();
+    freeMaze(&game.maze);
+    if (action < 0) {
+        fprintf(stderr, "Journal is corrupt in game %ld\n", target);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    bool verbose = false;
+    long stepTarget = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "vs:")) != -1) {
+        switch (opt) {
+            case 'v':
+                verbose = true;
+                break;
+            case 's':
+                stepTarget = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-v] [-s game] [journal]\n", argv[0]);
+                return 1;
+        }
+    }
+    const char* path = optind < argc ? argv[optind] : JOURNAL_FILE;
+
+    JournalReader reader;
+    if (journalOpen(&reader, path) < 0) {
+        return 1;
+    }
+    int result = stepTarget > 0 ? stepGame(&reader, stepTarget) : replayAll(&reader, verbose);
+    journalClose(&reader);
+    return result == 0 ? 0 : 1;
+}
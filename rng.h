@@ -0,0 +1,49 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// Small, fast, seedable generator (xoshiro128**). Every game, server and
+// simulator thread owns one, so there is no shared state between threads and
+// the same seed gives the same game on every machine.
+typedef struct {
+    uint32_t s[4];
+} Rng;
+
+static inline uint32_t rngRotl(uint32_t value, int shift) {
+    return (value << shift) | (value >> (32 - shift));
+}
+
+// Expand a seed into a full state with splitmix64, which never yields all zeroes
+static inline void rngSeed(Rng* rng, uint64_t seed) {
+    for (int i = 0; i < 4; i += 2) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        rng->s[i] = (uint32_t)z;
+        rng->s[i + 1] = (uint32_t)(z >> 32);
+    }
+}
+
+// Next 32 random bits
+static inline uint32_t rngNext(Rng* rng) {
+    uint32_t* s = rng->s;
+    uint32_t result = rngRotl(s[1] * 5, 7) * 9;
+    uint32_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rngRotl(s[3], 11);
+    return result;
+}
+
+// Uniform value in [0, n) by multiply-shift, without a division
+static inline int rngRange(Rng* rng, int n) {
+    return (int)(((uint64_t)rngNext(rng) * (uint32_t)n) >> 32);
+}
+
+#endif // RNG_H
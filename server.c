@@ -0,0 +1,1205 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/random.h>
+#include <netinet/tcp.h>
+#include "network.h"
+#include "engine.h"
+#include "bot.h"
+#include "journal.h"
+#include "pool.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "fov.h"
+#include "server.h"
+
+struct Match;
+
+// One encoded update, shared by every spectator of a match and freed by the
+// last one to finish sending it
+typedef struct {
+    int refs;
+    size_t length;
+    char data[];                // GameState header followed by the maze bitboard
+} SharedFrame;
+
+// One connected player or spectator
+typedef struct Connection {
+    int fd;
+    struct Match* match;
+    int role;
+    char* outbuf;
+    size_t outLen;
+    size_t outCapacity;
+    bool closing;               // Close as soon as outbuf drains
+    bool dead;                  // Already closed, freed at the end of the event batch
+    struct Connection* nextDead;
+    bool spectator;             // Read-only watcher fed from shared frames
+    bool resuming;              // Came in on the resume port and has not sent all of its request
+    ResumeRequest request;
+    size_t requestLength;       // Bytes of request read so far
+    SharedFrame* frames[SPECTATOR_QUEUE]; // Spectators only: queued frames, oldest first
+    int frameCount;
+    size_t frameOffset;         // Bytes of frames[0] already sent
+    struct Connection* nextSpectator;
+} Connection;
+
+// One game in progress; every match owns its own maze and state
+typedef struct Match {
+    Game game;
+    int status;                 // STATUS_ constant sent with every update
+    Connection* players[2];     // Indexed by role; NULL seats are played by the bot unless away
+    Bot bot;
+    JournalWriter journal;      // Appended to JOURNAL_FILE when the match ends
+    int savedTurn;              // turnCounter of the last snapshot, -1 before the first
+    Fov views[2];               // Each player's view, under fog of war
+    unsigned int sentViews[2];  // Version of each view its player was last sent
+    unsigned int sessions[2][2]; // Each human seat's GameState.session, zero for the bot's
+    unsigned int sequences[2];  // GameState.sequence of the last state sent to each seat
+    GameState history[2][SEAT_HISTORY]; // The last states sent to each human seat, by sequence
+    FogView* historyViews[2];   // Under fog of war, the view that went with each of them
+    time_t awayUntil[2];        // When a seat whose player dropped is given up on, 0 if not away
+    bool restoredSeats[2];      // Held since a restart; its player's sequence numbers are the old run's
+    bool away;                  // Listed in awayMatches
+    struct Match* prevAway;     // Neighbours in awayMatches
+    struct Match* nextAway;
+    Connection* spectators;
+    long skippedFrames;         // Frames slow spectators never got
+    Histogram roundTrip;        // Kernel RTT to the players, sampled as their actions arrive
+    struct Match* prev;         // Neighbours in liveMatches
+    struct Match* next;
+} Match;
+
+static int epollFd = -1;
+static Connection* waitingPlayer = NULL;  // Connected player with no opponent yet
+static time_t waitingSince;               // When waitingPlayer connected
+static int botWaitSeconds = BOT_WAIT_SECONDS; // 0 never seats a bot
+static Connection* deadList = NULL;       // Closed connections awaiting free()
+static int mazeHeight = DEFAULT_HEIGHT;   // Size of every maze this server generates
+static int mazeWidth = DEFAULT_WIDTH;
+static Rng seedRng;                       // Seeds each new match
+static GamePool gamePool;                 // Matches built ahead on a worker thread
+static SnapshotWriter snapshotWriter;     // Writes match snapshots on a thread of its own
+static int activeMatches = 0;
+static int connectedPlayers = 0;
+static Match* liveMatches = NULL;         // Newest first; new spectators watch the head
+static Connection* idleSpectators = NULL; // Spectators waiting for a match to start
+static int connectedSpectators = 0;
+static int spectatorListenerTag;          // Its address marks the spectator listener in epoll
+static int resumeListenerTag;             // And this one the resume listener
+static Match* awayMatches = NULL;         // Matches waiting for a player to resume
+static bool fogOfWar = false;             // Players are sent only what they can see
+
+// Unlink a spectator from the match it watches, or from the idle list
+static void unlinkSpectator(Connection* conn) {
+    Connection** link = conn->match != NULL ? &conn->match->spectators : &idleSpectators;
+    while (*link != NULL && *link != conn) {
+        link = &(*link)->nextSpectator;
+    }
+    if (*link == conn) {
+        *link = conn->nextSpectator;
+    }
+    conn->nextSpectator = NULL;
+    conn->match = NULL;
+}
+
+static void releaseFrame(SharedFrame* frame) {
+    if (--frame->refs == 0) {
+        free(frame);
+    }
+}
+
+static void unlinkAway(Match* match) {
+    if (!match->away) {
+        return;
+    }
+    if (match->prevAway != NULL) {
+        match->prevAway->nextAway = match->nextAway;
+    } else {
+        awayMatches = match->nextAway;
+    }
+    if (match->nextAway != NULL) {
+        match->nextAway->prevAway = match->prevAway;
+    }
+    match->prevAway = match->nextAway = NULL;
+    match->away = false;
+}
+
+static void linkAway(Match* match) {
+    if (match->away) {
+        return;
+    }
+    match->away = true;
+    match->nextAway = awayMatches;
+    if (awayMatches != NULL) {
+        awayMatches->prevAway = match;
+    }
+    awayMatches = match;
+}
+
+// A player's connection is gone. While the match is running its seat is kept
+// for RESUME_GRACE_SECONDS; the opponent plays on up to the missing player's turn.
+static void leaveSeat(Connection* conn) {
+    Match* match = conn->match;
+    match->players[conn->role] = NULL;
+    conn->match = NULL;
+    if (match->status != STATUS_PLAYING) {
+        return;
+    }
+    match->awayUntil[conn->role] = time(NULL) + RESUME_GRACE_SECONDS;
+    linkAway(match);
+}
+
+// Close a connection now but defer free() so later events in the batch stay
+// valid. A player's seat waits for it to resume.
+static void dropConnection(Connection* conn) {
+    if (conn->dead) {
+        return;
+    }
+    if (!conn->spectator && conn->match != NULL) {
+        leaveSeat(conn);
+    }
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->dead = true;
+    conn->nextDead = deadList;
+    deadList = conn;
+    if (conn->spectator) {
+        unlinkSpectator(conn);
+        for (int i = 0; i < conn->frameCount; i++) {
+            releaseFrame(conn->frames[i]);
+        }
+        conn->frameCount = 0;
+        connectedSpectators--;
+        return;
+    }
+    connectedPlayers--;
+    if (waitingPlayer == conn) {
+        waitingPlayer = NULL;
+    }
+}
+
+// Watch for writability only while there is something queued
+static void updateInterest(Connection* conn) {
+    struct epoll_event ev;
+    bool pending = conn->spectator ? conn->frameCount > 0 : conn->outLen > 0;
+    ev.events = EPOLLIN | (pending ? EPOLLOUT : 0);
+    ev.data.ptr = conn;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+// Write as much of the queue as the socket takes without blocking
+static void flushConnection(Connection* conn) {
+    size_t sentTotal = 0;
+    while (sentTotal < conn->outLen) {
+        ssize_t sent = send(conn->fd, conn->outbuf + sentTotal, conn->outLen - sentTotal, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            dropConnection(conn);
+            return;
+        }
+        sentTotal += sent;
+    }
+
+    memmove(conn->outbuf, conn->outbuf + sentTotal, conn->outLen - sentTotal);
+    conn->outLen -= sentTotal;
+
+    if (conn->outLen == 0 && conn->closing) {
+        dropConnection(conn);
+        return;
+    }
+    updateInterest(conn);
+}
+
+// Queue a state and the stateBodyBytes() of body that go with it for one
+// player; a client that falls more than OUTBUF_STATES messages behind is dropped
+static void queueState(Connection* conn, GameState* state, const void* body) {
+    if (conn->dead) {
+        return;
+    }
+    uint64_t start = metricsNow();
+
+    size_t bodyBytes = stateBodyBytes(state);
+    size_t messageSize = sizeof(GameState) + bodyBytes;
+
+    if (conn->outLen + messageSize > conn->outCapacity) {
+        size_t capacity = conn->outCapacity ? conn->outCapacity * 2 : messageSize * 2;
+        while (capacity < conn->outLen + messageSize) {
+            capacity *= 2;
+        }
+        char* outbuf = NULL;
+        if (capacity <= OUTBUF_STATES * messageSize) {
+            outbuf = realloc(conn->outbuf, capacity);
+        }
+        if (outbuf == NULL) {
+            dropConnection(conn);
+            return;
+        }
+        conn->outbuf = outbuf;
+        conn->outCapacity = capacity;
+    }
+
+    memcpy(conn->outbuf + conn->outLen, state, sizeof(GameState));
+    if (bodyBytes > 0) {
+        memcpy(conn->outbuf + conn->outLen + sizeof(GameState), body, bodyBytes);
+    }
+    conn->outLen += messageSize;
+    flushConnection(conn);
+    metricsRecord(METRIC_SEND_STATE, start);
+}
+
+// Send as much of a spectator's queued frames as the socket takes, all in one sendmsg()
+static void flushSpectator(Connection* conn) {
+    while (conn->frameCount > 0) {
+        struct iovec parts[SPECTATOR_QUEUE];
+        for (int i = 0; i < conn->frameCount; i++) {
+            size_t skip = (i == 0) ? conn->frameOffset : 0;
+            parts[i].iov_base = conn->frames[i]->data + skip;
+            parts[i].iov_len = conn->frames[i]->length - skip;
+        }
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = parts;
+        message.msg_iovlen = conn->frameCount;
+
+        ssize_t sent = sendmsg(conn->fd, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            dropConnection(conn);
+            return;
+        }
+
+        // Release every frame that went out completely
+        size_t left = sent;
+        while (conn->frameCount > 0 && left >= conn->frames[0]->length - conn->frameOffset) {
+            left -= conn->frames[0]->length - conn->frameOffset;
+            releaseFrame(conn->frames[0]);
+            memmove(conn->frames, conn->frames + 1, (conn->frameCount - 1) * sizeof(SharedFrame*));
+            conn->frameCount--;
+            conn->frameOffset = 0;
+        }
+        conn->frameOffset += left;
+    }
+    updateInterest(conn);
+}
+
+// Queue a shared frame for one spectator. A spectator whose queue is full
+// skips the frames it has not started on: every frame carries the whole
+// state, so only intermediate moves are lost. Returns the frames skipped.
+static int queueFrame(Connection* conn, SharedFrame* frame) {
+    if (conn->dead) {
+        return 0;
+    }
+    int skipped = 0;
+    if (conn->frameCount == SPECTATOR_QUEUE) {
+        int keep = conn->frameOffset > 0 ? 1 : 0;
+        for (int i = keep; i < conn->frameCount; i++) {
+            releaseFrame(conn->frames[i]);
+            skipped++;
+        }
+        conn->frameCount = keep;
+    }
+    frame->refs++;
+    conn->frames[conn->frameCount++] = frame;
+    flushSpectator(conn);
+    return skipped;
+}
+
+// Fill in the match state as everyone sees it; the caller sets role
+static void describeMatch(Match* match, GameState* state) {
+    Game* game = &match->game;
+    memset(state, 0, sizeof(*state));
+    state->height = game->maze.height;
+    state->width = game->maze.width;
+    state->exitY = game->maze.exitY;
+    state->exitX = game->maze.exitX;
+    state->view = VIEW_MAZE;
+    state->survivorY = game->survivorY;
+    state->survivorX = game->survivorX;
+    state->killerY = game->killerY;
+    state->killerX = game->killerX;
+    state->currentTurn = game->currentTurn;
+    state->survivorMovesLeft = game->survivorMovesLeft;
+    state->killerMovesLeft = game->killerMovesLeft;
+    state->status = match->status;
+}
+
+// Encode the match state once for all of its spectators
+static SharedFrame* encodeFrame(Match* match) {
+    Maze* maze = &match->game.maze;
+    size_t mazeBytes = MAZE_BYTES(maze);
+    SharedFrame* frame = malloc(sizeof(SharedFrame) + sizeof(GameState) + mazeBytes);
+    if (frame == NULL) {
+        return NULL;
+    }
+
+    GameState state;
+    describeMatch(match, &state);
+    state.role = SPECTATOR_ROLE;
+    memcpy(frame->data, &state, sizeof(GameState));
+    memcpy(frame->data + sizeof(GameState), maze->cells, mazeBytes);
+    frame->length = sizeof(GameState) + mazeBytes;
+    frame->refs = 1;
+    return frame;
+}
+
+// Start a spectator on a match, or park it until one starts; sendState
+// gives it the current state right away
+static void attachSpectator(Connection* conn, Match* match, bool sendState) {
+    conn->match = match;
+    if (match == NULL) {
+        conn->nextSpectator = idleSpectators;
+        idleSpectators = conn;
+        return;
+    }
+    conn->nextSpectator = match->spectators;
+    match->spectators = conn;
+
+    if (sendState) {
+        SharedFrame* frame = encodeFrame(match);
+        if (frame == NULL) {
+            dropConnection(conn);
+            return;
+        }
+        queueFrame(conn, frame);
+        releaseFrame(frame);
+    }
+}
+
+// Under fog of war, hide from a player what its view does not reach: the
+// opponent and the exit out of sight, and the cells unless the view changed
+// since the player was last sent one or whole is set. Fills in view when it
+// has to go out.
+static void fogState(Match* match, int role, GameState* state, FogView* view, bool whole) {
+    Game* game = &match->game;
+    Fov* fov = &match->views[role];
+    updateFov(fov, &game->maze, role == SURVIVOR_TURN ? game->survivorY : game->killerY,
+              role == SURVIVOR_TURN ? game->survivorX : game->killerX);
+    if (!fovVisible(fov, state->survivorY, state->survivorX)) {
+        state->survivorY = state->survivorX = -1;
+    }
+    if (!fovVisible(fov, state->killerY, state->killerX)) {
+        state->killerY = state->killerX = -1;
+    }
+    if (!fovVisible(fov, state->exitY, state->exitX)) {
+        state->exitY = state->exitX = -1;
+    }
+
+    state->view = VIEW_UNCHANGED;
+    if (whole || fov->version != match->sentViews[role]) {
+        encodeFogView(fov, &game->maze, view);
+        state->view = VIEW_FOG;
+        match->sentViews[role] = fov->version;
+    }
+}
+
+// Number a state for a human seat and keep it for catching its player up
+static void recordState(Match* match, int role, GameState* state, const FogView* view) {
+    state->sequence = ++match->sequences[role];
+    memcpy(state->session, match->sessions[role], sizeof(state->session));
+    int slot = state->sequence % SEAT_HISTORY;
+    match->history[role][slot] = *state;
+    if (state->view == VIEW_FOG) {
+        match->historyViews[role][slot] = *view;
+    }
+}
+
+// Send the match state to both players, each tagged with its own role, and
+// one shared copy to every spectator. An away player's states are only kept.
+static void broadcastMatch(Match* match) {
+    GameState state;
+    describeMatch(match, &state);
+
+    for (int role = SURVIVOR_TURN; role <= KILLER_TURN; role++) {
+        Connection* player = match->players[role];
+        if (player == NULL && match->awayUntil[role] == 0) {
+            continue;
+        }
+        GameState seen = state;
+        seen.role = role;
+        FogView view;
+        const void* body = match->game.maze.cells;
+        if (fogOfWar) {
+            fogState(match, role, &seen, &view, false);
+            body = &view;
+        }
+        recordState(match, role, &seen, &view);
+        if (player != NULL) {
+            queueState(player, &seen, body);
+        }
+    }
+
+    if (match->spectators != NULL) {
+        SharedFrame* frame = encodeFrame(match);
+        if (frame == NULL) {
+            return;
+        }
+        Connection* next;
+        for (Connection* spectator = match->spectators; spectator != NULL; spectator = next) {
+            next = spectator->nextSpectator;
+            match->skippedFrames += queueFrame(spectator, frame);
+        }
+        releaseFrame(frame);
+    }
+}
+
+// Where a match's snapshot lives; the seed names it across restarts
+static void snapshotPath(const Match* match, char* path, size_t size) {
+    snprintf(path, size, "%s/%016llx.snap", SNAPSHOT_DIR, (unsigned long long)match->game.seed);
+}
+
+// Snapshot the match if a turn has ended since the last one, so a restart
+// resumes it from there. Only the encoding happens here; the writer thread
+// does the disk work.
+static void checkpointMatch(Match* match) {
+    if (match->game.turnCounter == match->savedTurn) {
+        return;
+    }
+    char path[64];
+    snapshotPath(match, path, sizeof(path));
+    if (queueSnapshot(&snapshotWriter, &match->game, match->sessions, &match->journal, path) == 0) {
+        match->savedTurn = match->game.turnCounter;
+    }
+}
+
+// Send a player who resumed the states it missed after acked. If some of
+// them are no longer kept it gets the current state whole instead; under fog
+// of war it then forgets the cells it would have seen in between.
+static void catchUp(Match* match, int role, unsigned int acked) {
+    Connection* conn = match->players[role];
+    unsigned int last = match->sequences[role];
+    if (acked == 0 || acked > last || last - acked > SEAT_HISTORY) {
+        GameState state;
+        describeMatch(match, &state);
+        state.role = role;
+        state.sequence = last;
+        memcpy(state.session, match->sessions[role], sizeof(state.session));
+        FogView view;
+        const void* body = match->game.maze.cells;
+        if (fogOfWar) {
+            fogState(match, role, &state, &view, true);
+            body = &view;
+        }
+        queueState(conn, &state, body);
+        return;
+    }
+
+    for (unsigned int sequence = acked + 1; sequence <= last && !conn->dead; sequence++) {
+        int slot = sequence % SEAT_HISTORY;
+        GameState state = match->history[role][slot];
+        if (state.view == VIEW_MAZE) {
+            state.view = VIEW_UNCHANGED; // The maze never changes, and the player has it
+        }
+        queueState(conn, &state, state.view == VIEW_FOG ? &match->historyViews[role][slot] : NULL);
+    }
+}
+
+// Announce the result and release the match; players are closed once flushed
+static void finishMatch(Match* match, int status) {
+    match->status = status;
+    broadcastMatch(match);
+    unlinkAway(match);
+
+    for (int role = SURVIVOR_TURN; role <= KILLER_TURN; role++) {
+        Connection* player = match->players[role];
+        if (player != NULL) {
+            player->match = NULL;
+            player->closing = true;
+            if (!player->dead && player->outLen == 0) {
+                dropConnection(player);
+            }
+        }
+    }
+
+    // Spectators move on to the newest match still running, if any
+    if (match->prev != NULL) {
+        match->prev->next = match->next;
+    } else {
+        liveMatches = match->next;
+    }
+    if (match->next != NULL) {
+        match->next->prev = match->prev;
+    }
+    int spectators = 0;
+    while (match->spectators != NULL) {
+        Connection* spectator = match->spectators;
+        match->spectators = spectator->nextSpectator;
+        attachSpectator(spectator, liveMatches, true);
+        spectators++;
+    }
+
+    char path[64];
+    snapshotPath(match, path, sizeof(path));
+    removeSnapshot(&snapshotWriter, path);
+
+    journalFinish(&match->journal, &match->game, JOURNAL_FILE);
+    freeBot(&match->bot);
+    freeFov(&match->views[SURVIVOR_TURN]);
+    freeFov(&match->views[KILLER_TURN]);
+    free(match->historyViews[SURVIVOR_TURN]);
+    free(match->historyViews[KILLER_TURN]);
+    freeMaze(&match->game.maze);
+    activeMatches--;
+    printf("Match finished (status %d), %d active", status, activeMatches);
+    if (match->roundTrip.count > 0) {
+        printf(", rtt p50 %.2f ms p99 %.2f ms", histogramPercentile(&match->roundTrip, 0.5) / 1e6,
+               histogramPercentile(&match->roundTrip, 0.99) / 1e6);
+    }
+    if (spectators > 0) {
+        printf(", %d spectators, %ld frames skipped", spectators, match->skippedFrames);
+    }
+    printf("\n");
+    free(match);
+}
+
+// Play the bot's seat until it is a human's turn again; returns true if the game ended
+static bool playBotTurns(Match* match) {
+    Game* game = &match->game;
+    while (!game->gameOver && match->players[game->currentTurn] == NULL && match->awayUntil[game->currentTurn] == 0) {
+        int action = botAction(&match->bot, game);
+        journalAction(&match->journal, action);
+        applyAction(game, action);
+    }
+    if (game->gameOver) {
+        finishMatch(match, game->survivorWon ? STATUS_SURVIVOR_WON : STATUS_KILLER_WON);
+        return true;
+    }
+    return false;
+}
+
+// An unguessable token for a seat; the seed RNG stands in if the kernel
+// has no randomness to give
+static void newSession(unsigned int session[2]) {
+    if (getrandom(session, 2 * sizeof(unsigned int), 0) != 2 * sizeof(unsigned int)) {
+        session[0] = rngNext(&seedRng);
+        session[1] = rngNext(&seedRng);
+    }
+    if (session[0] == 0 && session[1] == 0) {
+        session[0] = 1;
+    }
+}
+
+// Give a match whose game is set up its views and bot, and list it as live. Returns false with the game freed if the views cannot be allocated.
+static bool openMatch(Match* match) {
+    if (fogOfWar && (initFov(&match->views[SURVIVOR_TURN], &match->game.maze) < 0 ||
+                     initFov(&match->views[KILLER_TURN], &match->game.maze) < 0 ||
+                     (match->historyViews[SURVIVOR_TURN] = calloc(SEAT_HISTORY, sizeof(FogView))) == NULL ||
+                     (match->historyViews[KILLER_TURN] = calloc(SEAT_HISTORY, sizeof(FogView))) == NULL)) {
+        perror("View allocation failed");
+        freeFov(&match->views[SURVIVOR_TURN]);
+        freeFov(&match->views[KILLER_TURN]);
+        free(match->historyViews[SURVIVOR_TURN]);
+        freeMaze(&match->game.maze);
+        return false;
+    }
+    match->status = STATUS_PLAYING;
+    match->savedTurn = -1;
+    initBot(&match->bot);
+
+    match->next = liveMatches;
+    if (liveMatches != NULL) {
+        liveMatches->prev = match;
+    }
+    liveMatches = match;
+
+    // Spectators waiting for a game watch this one
+    while (idleSpectators != NULL) {
+        Connection* spectator = idleSpectators;
+        idleSpectators = spectator->nextSpectator;
+        attachSpectator(spectator, match, false);
+    }
+    activeMatches++;
+    return true;
+}
+
+// Pair two waiting players into a new match with a fresh maze; a NULL player
+// leaves that seat to the bot
+static void startMatch(Connection* survivor, Connection* killer) {
+    Match* match = calloc(1, sizeof(Match));
+    if (match == NULL) {
+        perror("Match allocation failed");
+        if (survivor != NULL) dropConnection(survivor);
+        if (killer != NULL) dropConnection(killer);
+        return;
+    }
+
+    // Take a ready-made game; build one here only if the pool has run dry
+    uint64_t seed = ((uint64_t)rngNext(&seedRng) << 32) | rngNext(&seedRng);
+    if (!takePooledGame(&gamePool, &match->game) &&
+        setupGame(&match->game, mazeHeight, mazeWidth, seed) < 0) {
+        perror("Maze allocation failed");
+        free(match);
+        if (survivor != NULL) dropConnection(survivor);
+        if (killer != NULL) dropConnection(killer);
+        return;
+    }
+    if (!openMatch(match)) {
+        free(match);
+        if (survivor != NULL) dropConnection(survivor);
+        if (killer != NULL) dropConnection(killer);
+        return;
+    }
+    journalStart(&match->journal, &match->game);
+
+    match->players[SURVIVOR_TURN] = survivor;
+    match->players[KILLER_TURN] = killer;
+    for (int role = SURVIVOR_TURN; role <= KILLER_TURN; role++) {
+        if (match->players[role] != NULL) {
+            match->players[role]->match = match;
+            match->players[role]->role = role;
+            newSession(match->sessions[role]);
+        }
+    }
+
+    printf("Match started%s, %d active, %d players connected\n",
+           survivor == NULL || killer == NULL ? " against the bot" : "", activeMatches, connectedPlayers);
+    if (!playBotTurns(match)) {
+        checkpointMatch(match);
+        broadcastMatch(match);
+    }
+}
+
+// Apply one action from a player, using the same rules as local play
+static void handleAction(Connection* conn, int action) {
+    Match* match = conn->match;
+    if (match == NULL) {
+        return;
+    }
+    if (action == ACTION_QUIT) {
+        // Applied too, so the journaled game ends as a replay of it does
+        journalAction(&match->journal, action);
+        applyAction(&match->game, action);
+        finishMatch(match, STATUS_ABORTED);
+        return;
+    }
+
+    Game* game = &match->game;
+    if (conn->role != game->currentTurn || action > ACTION_END_TURN) {
+        return; // Not this player's turn, or not a game action
+    }
+
+    journalAction(&match->journal, action);
+    applyAction(game, action);
+    if (!playBotTurns(match)) {
+        checkpointMatch(match);
+        broadcastMatch(match);
+    }
+}
+
+// Sample the kernel's smoothed round-trip time to a player into its match
+// and the server-wide histogram
+static void sampleRoundTrip(Connection* conn) {
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+    if (conn->match != NULL && getsockopt(conn->fd, IPPROTO_TCP, TCP_INFO, &info, &length) == 0 &&
+        info.tcpi_rtt > 0) {
+        histogramRecord(&conn->match->roundTrip, (uint64_t)info.tcpi_rtt * 1000);
+        histogramRecord(&metrics[METRIC_ROUND_TRIP], (uint64_t)info.tcpi_rtt * 1000);
+    }
+}
+
+// Read pending actions; each action is a single byte
+static void handleReadable(Connection* conn) {
+    unsigned char actions[64];
+    while (!conn->dead) {
+        ssize_t received = recv(conn->fd, actions, sizeof(actions), 0);
+        if (received == 0) {
+            dropConnection(conn);
+            return;
+        }
+        if (received < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                dropConnection(conn);
+            }
+            return;
+        }
+        sampleRoundTrip(conn);
+        for (ssize_t i = 0; i < received && conn->match != NULL; i++) {
+            handleAction(conn, actions[i]);
+        }
+    }
+}
+
+// Accept every pending client and pair it with the waiting one, if any
+static void acceptClients(int listenFd) {
+    while (1) {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("Accept failed");
+            }
+            return;
+        }
+
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        enableKeepalive(fd);
+
+        Connection* conn = calloc(1, sizeof(Connection));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("Epoll add failed");
+            close(fd);
+            free(conn);
+            continue;
+        }
+        connectedPlayers++;
+
+        if (waitingPlayer == NULL) {
+            GameState waitState;
+            memset(&waitState, 0, sizeof(waitState));
+            waitState.status = STATUS_WAITING;
+            waitingPlayer = conn;
+            waitingSince = time(NULL);
+            queueState(conn, &waitState, NULL);
+        } else {
+            Connection* survivor = waitingPlayer;
+            waitingPlayer = NULL;
+            startMatch(survivor, conn);
+        }
+    }
+}
+
+// Seat a player who came back in place of its old connection, which may
+// not have been noticed as dead yet, and catch it up
+static void resumeSeat(Connection* conn, Match* match, int role, unsigned int acked) {
+    Connection* old = match->players[role];
+    if (old != NULL) {
+        old->match = NULL;
+        dropConnection(old);
+    }
+    match->players[role] = conn;
+    match->awayUntil[role] = 0;
+    if (match->awayUntil[1 - role] == 0) {
+        unlinkAway(match);
+    }
+    conn->match = match;
+    conn->role = role;
+    if (match->restoredSeats[role]) {
+        // What it acked was numbered before the restart; start it afresh
+        match->restoredSeats[role] = false;
+        acked = 0;
+    }
+    printf("Player resumed a match, %u states to catch up on\n", match->sequences[role] - acked);
+    catchUp(match, role, acked);
+}
+
+// Read the ResumeRequest of a connection on the resume port and give it back
+// its seat, or tell it the match is over. Returns false until the whole
+// request is in. Resumes are rare, so the live matches are searched rather
+// than indexed by session.
+static bool handleResume(Connection* conn) {
+    while (conn->requestLength < sizeof(ResumeRequest)) {
+        ssize_t received = recv(conn->fd, (char*)&conn->request + conn->requestLength,
+                                sizeof(ResumeRequest) - conn->requestLength, 0);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            dropConnection(conn);
+        }
+        if (received <= 0) {
+            return false;
+        }
+        conn->requestLength += received;
+    }
+    conn->resuming = false;
+
+    const unsigned int* session = conn->request.session;
+    if (session[0] != 0 || session[1] != 0) {
+        for (Match* match = liveMatches; match != NULL; match = match->next) {
+            for (int role = SURVIVOR_TURN; role <= KILLER_TURN; role++) {
+                if (memcmp(match->sessions[role], session, sizeof(match->sessions[role])) == 0) {
+                    resumeSeat(conn, match, role, conn->request.sequence);
+                    return true;
+                }
+            }
+        }
+    }
+
+    GameState over;
+    memset(&over, 0, sizeof(over));
+    over.status = STATUS_ABORTED;
+    conn->closing = true;
+    queueState(conn, &over, NULL);
+    return false;
+}
+
+// Accept every pending player coming back to a match; each is seated once
+// its request has been read
+static void acceptResumes(int listenFd) {
+    while (1) {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("Accept failed");
+            }
+            return;
+        }
+
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        enableKeepalive(fd);
+
+        Connection* conn = calloc(1, sizeof(Connection));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->resuming = true;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("Epoll add failed");
+            close(fd);
+            free(conn);
+            continue;
+        }
+        connectedPlayers++;
+    }
+}
+
+// Spectators only ever send junk or close; drain it and notice the close
+static void handleSpectatorReadable(Connection* conn) {
+    char discard[256];
+    while (!conn->dead) {
+        ssize_t received = recv(conn->fd, discard, sizeof(discard), 0);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            dropConnection(conn);
+        }
+        if (received <= 0) {
+            return;
+        }
+    }
+}
+
+// Accept every pending spectator and start it on the newest live match
+static void acceptSpectators(int listenFd) {
+    while (1) {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("Accept failed");
+            }
+            return;
+        }
+        enableKeepalive(fd);
+
+        Connection* conn = calloc(1, sizeof(Connection));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->spectator = true;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("Epoll add failed");
+            close(fd);
+            free(conn);
+            continue;
+        }
+        connectedSpectators++;
+        attachSpectator(conn, liveMatches, true);
+    }
+}
+
+// Milliseconds until the waiting player gets a bot opponent, or -1 to wait forever
+static int botSeatTimeout(void) {
+    if (waitingPlayer == NULL || botWaitSeconds <= 0) {
+        return -1;
+    }
+    time_t remaining = waitingSince + botWaitSeconds - time(NULL);
+    return remaining > 0 ? (int)remaining * 1000 : 0;
+}
+
+// Milliseconds until the first away player's seat is given up on, or -1 if nobody is away
+static int awayTimeout(void) {
+    if (awayMatches == NULL) {
+        return -1;
+    }
+    time_t first = 0;
+    for (Match* match = awayMatches; match != NULL; match = match->nextAway) {
+        for (int role = SURVIVOR_TURN; role <= KILLER_TURN; role++) {
+            if (match->awayUntil[role] != 0 && (first == 0 || match->awayUntil[role] < first)) {
+                first = match->awayUntil[role];
+            }
+        }
+    }
+    time_t remaining = first - time(NULL);
+    return remaining > 0 ? (int)remaining * 1000 : 0;
+}
+
+// Abort the matches whose player did not come back in time; the opponent is told
+static void expireAwaySeats(void) {
+    time_t now = time(NULL);
+    Match* next;
+    for (Match* match = awayMatches; match != NULL; match = next) {
+        next = match->nextAway;
+        if ((match->awayUntil[SURVIVOR_TURN] != 0 && match->awayUntil[SURVIVOR_TURN] <= now) ||
+            (match->awayUntil[KILLER_TURN] != 0 && match->awayUntil[KILLER_TURN] <= now)) {
+            finishMatch(match, STATUS_ABORTED);
+        }
+    }
+}
+
+// Load the snapshot of every match a previous run left unfinished. Each is
+// mapped and checked in place, so thousands load in well under a second.
+// A restored match waits RESTORE_HOLD_SECONDS on the resume port for the
+// players whose sessions it saved, and is aborted if they do not all come
+// back; it is never handed to anyone else.
+static void restoreMatches(void) {
+    if (mkdir(SNAPSHOT_DIR, 0755) < 0 && errno != EEXIST) {
+        perror("Cannot create " SNAPSHOT_DIR);
+        return;
+    }
+    DIR* dir = opendir(SNAPSHOT_DIR);
+    if (dir == NULL) {
+        perror("Cannot open " SNAPSHOT_DIR);
+        return;
+    }
+
+    uint64_t start = metricsNow();
+    time_t holdUntil = time(NULL) + RESTORE_HOLD_SECONDS;
+    int restored = 0;
+    int rejected = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", SNAPSHOT_DIR, entry->d_name);
+        if (length >= 9 && strcmp(entry->d_name + length - 9, ".snap.tmp") == 0) {
+            unlink(path); // A write the last run was killed in the middle of
+            continue;
+        }
+        if (length < 5 || strcmp(entry->d_name + length - 5, ".snap") != 0) {
+            continue;
+        }
+        Match* match = calloc(1, sizeof(Match));
+        if (match == NULL) {
+            perror("Match allocation failed");
+            break;
+        }
+        if (loadSnapshot(&match->game, match->sessions, &match->journal, path) < 0) {
+            fprintf(stderr, "Skipping damaged or outdated snapshot %s\n", path);
+            free(match);
+            rejected++;
+            continue;
+        }
+        bool held = false;
+        for (int role = SURVIVOR_TURN; role <= KILLER_TURN; role++) {
+            held |= (match->sessions[role][0] != 0 || match->sessions[role][1] != 0);
+        }
+        if (!held) {
+            // Nobody could ever claim it
+            freeMaze(&match->game.maze);
+            journalDiscard(&match->journal);
+            free(match);
+            unlink(path);
+            rejected++;
+            continue;
+        }
+        if (!openMatch(match)) {
+            journalDiscard(&match->journal);
+            free(match);
+            break;
+        }
+        match->savedTurn = match->game.turnCounter;
+        for (int role = SURVIVOR_TURN; role <= KILLER_TURN; role++) {
+            if (match->sessions[role][0] != 0 || match->sessions[role][1] != 0) {
+                match->awayUntil[role] = holdUntil;
+                match->restoredSeats[role] = true;
+            }
+        }
+        linkAway(match);
+        restored++;
+        playBotTurns(match);
+    }
+    closedir(dir);
+
+    if (restored > 0 || rejected > 0) {
+        printf("Restored %d unfinished matches from %s in %.1f ms, %d snapshots skipped\n",
+               restored, SNAPSHOT_DIR, (metricsNow() - start) / 1e6, rejected);
+        printf("Their players have %d seconds to resume them\n", RESTORE_HOLD_SECONDS);
+    }
+}
+
+int runServer(int port, int height, int width, int botWait) {
+    mazeHeight = height;
+    mazeWidth = width;
+    botWaitSeconds = botWait;
+    fogOfWar = fogEnabled();
+    rngSeed(&seedRng, ((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid());
+
+    int listenFd = createListener(port);
+    if (listenFd < 0) {
+        return -1;
+    }
+    int spectatorFd = createListener(port + SPECTATOR_PORT_OFFSET);
+    if (spectatorFd < 0) {
+        close(listenFd);
+        return -1;
+    }
+    int resumeFd = createListener(port + RESUME_PORT_OFFSET);
+    if (resumeFd < 0) {
+        close(listenFd);
+        close(spectatorFd);
+        return -1;
+    }
+
+    epollFd = epoll_create1(0);
+    if (epollFd < 0) {
+        perror("Epoll creation failed");
+        close(listenFd);
+        close(spectatorFd);
+        close(resumeFd);
+        return -1;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // NULL marks the listening socket
+    struct epoll_event spectatorEv;
+    spectatorEv.events = EPOLLIN;
+    spectatorEv.data.ptr = &spectatorListenerTag;
+    struct epoll_event resumeEv;
+    resumeEv.events = EPOLLIN;
+    resumeEv.data.ptr = &resumeListenerTag;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev) < 0 ||
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, spectatorFd, &spectatorEv) < 0 ||
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, resumeFd, &resumeEv) < 0) {
+        perror("Epoll add failed");
+        close(epollFd);
+        close(listenFd);
+        close(spectatorFd);
+        close(resumeFd);
+        return -1;
+    }
+
+    startSnapshotWriter(&snapshotWriter);
+    restoreMatches();
+    startGamePool(&gamePool, SERVER_POOL_GAMES, mazeHeight, mazeWidth, rngNext(&seedRng));
+
+    printf("Dedicated server listening on port %d, %dx%d mazes\n", port, mazeHeight, mazeWidth);
+    printf("Spectators connect to port %d\n", port + SPECTATOR_PORT_OFFSET);
+    printf("Players who drop out have %d seconds to resume on port %d\n", RESUME_GRACE_SECONDS,
+           port + RESUME_PORT_OFFSET);
+    if (startMetricsSocket("server") == 0) {
+        printf("Latency metrics on %s (send \"json\" for JSON)\n", metricsSocketPath());
+    }
+    if (fogOfWar) {
+        printf("Fog of war: players see %d cells around them and are sent only those\n", FOV_RADIUS);
+    }
+    if (botWaitSeconds > 0) {
+        printf("Players left waiting %d seconds are matched against the bot\n", botWaitSeconds);
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (1) {
+        int timeout = botSeatTimeout();
+        int away = awayTimeout();
+        if (timeout < 0 || (away >= 0 && away < timeout)) {
+            timeout = away;
+        }
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Epoll wait failed");
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            Connection* conn = events[i].data.ptr;
+            if (conn == NULL) {
+                acceptClients(listenFd);
+                continue;
+            }
+            if (events[i].data.ptr == &spectatorListenerTag) {
+                acceptSpectators(spectatorFd);
+                continue;
+            }
+            if (events[i].data.ptr == &resumeListenerTag) {
+                acceptResumes(resumeFd);
+                continue;
+            }
+            if (conn->dead) {
+                continue;
+            }
+            if (conn->spectator) {
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    dropConnection(conn);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    flushSpectator(conn);
+                }
+                if (!conn->dead && (events[i].events & EPOLLIN)) {
+                    handleSpectatorReadable(conn);
+                }
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                dropConnection(conn);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                flushConnection(conn);
+            }
+            // Actions may follow a resume request in the same segment
+            if (!conn->dead && conn->resuming && (events[i].events & EPOLLIN) && !handleResume(conn)) {
+                continue;
+            }
+            if (!conn->dead && (events[i].events & EPOLLIN)) {
+                handleReadable(conn);
+            }
+        }
+
+        // Nobody came for the waiting player in time; the bot plays the killer
+        if (botSeatTimeout() == 0) {
+            Connection* survivor = waitingPlayer;
+            waitingPlayer = NULL;
+            startMatch(survivor, NULL);
+        }
+        expireAwaySeats();
+
+        // Free everything closed during this batch
+        while (deadList != NULL) {
+            Connection* next = deadList->nextDead;
+            free(deadList->outbuf);
+            free(deadList);
+            deadList = next;
+        }
+    }
+
+    close(epollFd);
+    close(listenFd);
+    close(spectatorFd);
+    close(resumeFd);
+    stopGamePool(&gamePool);
+    stopSnapshotWriter(&snapshotWriter);
+    stopMetricsSocket();
+    return -1;
+}
@@ -0,0 +1,16 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#define MAX_EVENTS 256
+#define OUTBUF_STATES 8     // GameStates a slow client may have queued before we drop it
+#define SPECTATOR_QUEUE 4   // Frames a spectator may have queued; unsent older ones are skipped
+#define SERVER_POOL_GAMES 16 // Matches kept ready so a burst of pairings never waits on generation
+#define BOT_WAIT_SECONDS 10 // How long a player waits for a human opponent before the bot steps in
+#define SEAT_HISTORY 16     // States kept per player to catch it up when it resumes a match
+#define RESTORE_HOLD_SECONDS RESUME_GRACE_SECONDS // How long a match restored after a restart waits for its players
+
+// Run the headless multi-match server until a fatal error occurs. Players
+// left unpaired for botWait seconds play the bot instead; 0 disables it.
+int runServer(int port, int height, int width, int botWait);
+
+#endif // SERVER_H
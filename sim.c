@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "engine.h"
+#include "bot.h"
+#include "journal.h"
+
+// Batch balance runner: plays many headless games across all cores and
+// reports win rates and game lengths for each exit-relocation interval.
+//
+//   deja_sim [-n games] [-j threads] [-s HEIGHTxWIDTH] [-r 5,10,20] [-p random|greedy|bot] [-c turn cap] [-S seed] [-J journal]
+//
+// Every worker seeds its own generators from the run seed, so a run is
+// reproducible for a given seed and thread count. Game seeds and player
+// decisions come from separate generators, so however many decisions a game
+// takes, every interval is played on the same sequence of mazes.
+
+#define MAX_INTERVALS 16
+#define DECISION_SEED_SALT 0xD1CE5EEDD1CE5EEDull // Keeps a worker's decisions apart from its game seeds
+
+#define POLICY_RANDOM 0
+#define POLICY_GREEDY 1
+#define POLICY_BOT 2
+
+// Settings shared by every worker
+typedef struct {
+    int height, width;
+    int policy;
+    int turnCap;
+    uint64_t seed;
+    const char* journalPath;    // Append every game here, or NULL
+} SimConfig;
+
+// One thread's share of the games and its results
+typedef struct {
+    const SimConfig* config;
+    int interval;
+    long games;
+    long survivorWins;
+    long killerWins;
+    long capped;        // Games stopped at the turn cap
+    long totalTurns;
+    long scored;        // Games whose maze scoreMaze() could rate
+    long totalExitDistance;
+    long totalSpawnDistance;
+    long totalDeadEnds;
+    long* turnCounts;   // Games per final turn count, turnCap + 1 entries
+    Rng seeds;          // Seed of each of this thread's games, the same for every interval
+    Rng rng;            // Player decisions for this thread
+    Bot bot;            // Plays both sides under the bot policy
+    pthread_t thread;
+} SimWorker;
+
+// Pick a random open direction, or end the turn if boxed in
+static int randomAction(Game* game, int y, int x, Rng* rng) {
+    int open = mazeOpenNeighbors(&game->maze, y, x);
+    if (open == 0) {
+        return ACTION_END_TURN;
+    }
+    int choices[4];
+    int count = 0;
+    for (int direction = UP; direction <= RIGHT; direction++) {
+        if (open & DIR_BIT(direction)) {
+            choices[count++] = direction;
+        }
+    }
+    return choices[rngRange(rng, count)];
+}
+
+// Scripted play: step towards the target by Manhattan distance, with some
+// randomness so players do not get stuck behind walls forever
+static int greedyAction(Game* game, int y, int x, int targetY, int targetX, Rng* rng) {
+    static const int dy[4] = {-1, 1, 0, 0};
+    static const int dx[4] = {0, 0, -1, 1};
+
+    if (rngRange(rng, 4) == 0) {
+        return randomAction(game, y, x, rng);
+    }
+
+    int open = mazeOpenNeighbors(&game->maze, y, x);
+    int best = -1;
+    int bestDistance = 0;
+    int ties = 0;
+    for (int direction = UP; direction <= RIGHT; direction++) {
+        if (!(open & DIR_BIT(direction))) {
+            continue;
+        }
+        int distance = abs(y + dy[direction] - targetY) + abs(x + dx[direction] - targetX);
+        if (best < 0 || distance < bestDistance) {
+            best = direction;
+            bestDistance = distance;
+            ties = 1;
+        } else if (distance == bestDistance && rngRange(rng, ++ties) == 0) {
+            best = direction;
+        }
+    }
+    return best < 0 ? ACTION_END_TURN : best;
+}
+
+// Next action for whoever's turn it is
+static int chooseAction(Game* game, int policy, Rng* rng, Bot* bot) {
+    bool survivorTurn = (game->currentTurn == SURVIVOR_TURN);
+    int y = survivorTurn ? game->survivorY : game->killerY;
+    int x = survivorTurn ? game->survivorX : game->killerX;
+
+    if (policy == POLICY_RANDOM) {
+        return randomAction(game, y, x, rng);
+    }
+    if (policy == POLICY_BOT) {
+        return botAction(bot, game);
+    }
+    if (survivorTurn) {
+        return greedyAction(game, y, x, game->maze.exitY, game->maze.exitX, rng);
+    }
+    return greedyAction(game, y, x, game->survivorY, game->survivorX, rng);
+}
+
+// Play this worker's games back to back
+static void* runWorker(void* arg) {
+    SimWorker* worker = arg;
+    const SimConfig* config = worker->config;
+    long target = worker->games;
+    worker->games = 0;
+    initBot(&worker->bot);
+
+    for (long i = 0; i < target; i++) {
+        Game game;
+        uint64_t seed = ((uint64_t)rngNext(&worker->seeds) << 32) | rngNext(&worker->seeds);
+        if (setupGame(&game, config->height, config->width, seed) < 0) {
+            break;
+        }
+        game.relocateInterval = worker->interval;
+        resetBot(&worker->bot);
+        if (game.maze.score.exitDistance >= 0) {
+            worker->scored++;
+            worker->totalExitDistance += game.maze.score.exitDistance;
+            worker->totalSpawnDistance += game.spawnDistance;
+            worker->totalDeadEnds += game.maze.score.deadEnds;
+        }
+
+        JournalWriter journal;
+        if (config->journalPath != NULL) {
+            journalStart(&journal, &game);
+        }
+
+        while (!game.gameOver && game.turnCounter < config->turnCap) {
+            int action = chooseAction(&game, config->policy, &worker->rng, &worker->bot);
+            if (config->journalPath != NULL) {
+                journalAction(&journal, action);
+            }
+            applyAction(&game, action);
+        }
+
+        if (config->journalPath != NULL) {
+            journalFinish(&journal, &game, config->journalPath);
+        }
+
+        worker->games++;
+        worker->totalTurns += game.turnCounter;
+        worker->turnCounts[game.turnCounter]++;
+        if (!game.gameOver) {
+            worker->capped++;
+        } else if (game.survivorWon) {
+            worker->survivorWins++;
+        } else {
+            worker->killerWins++;
+        }
+        freeMaze(&game.maze);
+    }
+    freeBot(&worker->bot);
+    return NULL;
+}
+
+// Smallest turn count reached by at least the given fraction of games
+static int turnPercentile(const long* turnCounts, int turnCap, long games, double fraction) {
+    long needed = (long)(fraction * games);
+    long seen = 0;
+    for (int turns = 0; turns <= turnCap; turns++) {
+        seen += turnCounts[turns];
+        if (seen > needed) {
+            return turns;
+        }
+    }
+    return turnCap;
+}
+
+static double secondsSince(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Run every game for one relocation interval and print a result row, and
+// below it what the mazes were like if describeMazes is set
+static int simulateInterval(const SimConfig* config, int interval, long games, int threads, bool describeMazes) {
+    SimWorker* workers = calloc(threads, sizeof(SimWorker));
+    long* turnCounts = calloc(config->turnCap + 1, sizeof(long));
+    if (workers == NULL || turnCounts == NULL) {
+        free(workers);
+        free(turnCounts);
+        return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        workers[i].config = config;
+        workers[i].interval = interval;
+        workers[i].games = games / threads + (i < games % threads ? 1 : 0);
+        workers[i].turnCounts = calloc(config->turnCap + 1, sizeof(long));
+        rngSeed(&workers[i].seeds, config->seed + i);
+        rngSeed(&workers[i].rng, (config->seed + i) ^ DECISION_SEED_SALT);
+        if (workers[i].turnCounts == NULL ||
+            pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]) != 0) {
+            free(workers[i].turnCounts);
+            break;
+        }
+        started++;
+    }
+
+    // Merge the per-thread results
+    SimWorker total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total.games += workers[i].games;
+        total.survivorWins += workers[i].survivorWins;
+        total.killerWins += workers[i].killerWins;
+        total.capped += workers[i].capped;
+        total.totalTurns += workers[i].totalTurns;
+        total.scored += workers[i].scored;
+        total.totalExitDistance += workers[i].totalExitDistance;
+        total.totalSpawnDistance += workers[i].totalSpawnDistance;
+        total.totalDeadEnds += workers[i].totalDeadEnds;
+        for (int turns = 0; turns <= config->turnCap; turns++) {
+            turnCounts[turns] += workers[i].turnCounts[turns];
+        }
+        free(workers[i].turnCounts);
+    }
+    double elapsed = secondsSince(&start);
+
+    if (total.games > 0) {
+        printf("%8d %10ld %9.2f%% %9.2f%% %8.2f%% %10.1f %6d %6d %10.0f\n",
+               interval, total.games,
+               100.0 * total.survivorWins / total.games,
+               100.0 * total.killerWins / total.games,
+               100.0 * total.capped / total.games,
+               (double)total.totalTurns / total.games,
+               turnPercentile(turnCounts, config->turnCap, total.games, 0.5),
+               turnPercentile(turnCounts, config->turnCap, total.games, 0.9),
+               total.games / elapsed);
+    }
+    if (describeMazes && total.scored > 0) {
+        printf("Mazes: %.1f steps start to exit, %.1f between the spawns, %.1f dead ends on average\n",
+               (double)total.totalExitDistance / total.scored, (double)total.totalSpawnDistance / total.scored,
+               (double)total.totalDeadEnds / total.scored);
+    }
+
+    free(workers);
+    free(turnCounts);
+    return started == threads ? 0 : -1;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-n games] [-j threads] [-s HEIGHTxWIDTH] [-r interval,...] "
+                    "[-p random|greedy|bot] [-c turn cap] [-S seed] [-J journal]\n", program);
+}
+
+int main(int argc, char** argv) {
+    SimConfig config = { DEFAULT_HEIGHT, DEFAULT_WIDTH, POLICY_GREEDY, 1000, (uint64_t)time(NULL), NULL };
+    long games = 100000;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int intervals[MAX_INTERVALS] = { RELOCATE_INTERVAL };
+    int intervalCount = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:j:s:r:p:c:S:J:")) != -1) {
+        switch (opt) {
+            case 'n':
+                games = atol(optarg);
+                break;
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 's':
+                if (!parseMazeSize(optarg, &config.height, &config.width)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'r': {
+                // Comma-separated list; 0 means the exit never moves
+                intervalCount = 0;
+                for (char* item = strtok(optarg, ","); item != NULL && intervalCount < MAX_INTERVALS;
+                     item = strtok(NULL, ",")) {
+                    intervals[intervalCount++] = atoi(item);
+                }
+                break;
+            }
+            case 'p':
+                if (strcmp(optarg, "random") == 0) {
+                    config.policy = POLICY_RANDOM;
+                } else if (strcmp(optarg, "greedy") == 0) {
+                    config.policy = POLICY_GREEDY;
+                } else if (strcmp(optarg, "bot") == 0) {
+                    config.policy = POLICY_BOT;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'c':
+                config.turnCap = atoi(optarg);
+                break;
+            case 'S':
+                config.seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'J':
+                config.journalPath = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (games <= 0 || threads <= 0 || config.turnCap <= 0 || intervalCount == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    static const char* policyNames[] = { "random", "greedy", "bot" };
+    printf("%ld games per interval on %d threads, %dx%d maze, %s policy, cap %d turns, seed %llu\n",
+           games, threads, config.height, config.width, policyNames[config.policy], config.turnCap,
+           (unsigned long long)config.seed);
+    printf("%8s %10s %10s %10s %9s %10s %6s %6s %10s\n",
+           "interval", "games", "survivor", "killer", "capped", "mean turns", "p50", "p90", "games/s");
+
+    for (int i = 0; i < intervalCount; i++) {
+        // Every interval plays the same mazes, so describing them once is enough
+        if (simulateInterval(&config, intervals[i], games, threads, i == intervalCount - 1) < 0) {
+            fprintf(stderr, "Simulation for interval %d failed\n", intervals[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
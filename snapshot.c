@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "snapshot.h"
+#include "stream.h"
+
+// Cells and links follow the header on 8-byte boundaries
+_Static_assert(sizeof(SnapshotHeader) % 8 == 0, "SnapshotHeader must keep the bitboard aligned");
+
+// Bytes of the room links of a generated maze
+static size_t linkBytes(int height, int width) {
+    return ((size_t)(height / 2) * (width / 2) + 3) / 4;
+}
+
+// FNV-1a, a word at a time, over the given parts in order
+static uint32_t snapshotChecksum(const struct iovec* parts, int count) {
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < count; i++) {
+        const unsigned char* bytes = parts[i].iov_base;
+        size_t length = parts[i].iov_len;
+        size_t offset = 0;
+        for (; offset + 8 <= length; offset += 8) {
+            uint64_t word;
+            memcpy(&word, bytes + offset, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        for (; offset < length; offset++) {
+            hash = (hash ^ bytes[offset]) * 1099511628211ull;
+        }
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// Flush the directory holding path, so a rename into it survives a crash
+static void syncDirectory(const char* path) {
+    char directory[512];
+    snprintf(directory, sizeof(directory), "%s", path);
+    char* slash = strrchr(directory, '/');
+    if (slash == NULL) {
+        strcpy(directory, ".");
+    } else {
+        *slash = '\0';
+    }
+    int fd = open(directory, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// The snapshot of a game as it will be written, in one allocation; a server
+// passes its seats' sessions, local games NULL. Returns NULL if out of memory.
+static unsigned char* encodeSnapshot(const Game* game, const unsigned int sessions[2][2],
+                                     const JournalWriter* journal, size_t* length) {
+    const Maze* maze = &game->maze;
+    bool streaming = (maze->stream != NULL);
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.headerBytes = sizeof(header);
+    header.seed = game->seed;
+    header.cellsBytes = streaming ? 0 : MAZE_BYTES(maze);
+    header.linksBytes = (streaming || maze->links == NULL) ? 0 : linkBytes(maze->height, maze->width);
+    header.journalBytes = (journal == NULL || journal->failed) ? 0 : journal->length;
+    header.journalRunAction = header.journalBytes > 0 ? journal->runAction : -1;
+    header.journalRunLength = header.journalBytes > 0 ? journal->runLength : 0;
+    header.height = maze->height;
+    header.width = maze->width;
+    header.generatedRows = maze->generatedRows;
+    header.startY = maze->startY;
+    header.startX = maze->startX;
+    header.exitY = maze->exitY;
+    header.exitX = maze->exitX;
+    header.exitDistance = maze->score.exitDistance;
+    header.deadEnds = maze->score.deadEnds;
+    header.survivorY = game->survivorY;
+    header.survivorX = game->survivorX;
+    header.killerY = game->killerY;
+    header.killerX = game->killerX;
+    header.spawnDistance = game->spawnDistance;
+    header.survivorMovesLeft = game->survivorMovesLeft;
+    header.killerMovesLeft = game->killerMovesLeft;
+    header.currentTurn = game->currentTurn;
+    header.turnCounter = game->turnCounter;
+    header.lastRelocatedTurn = game->lastRelocatedTurn;
+    header.relocateInterval = game->relocateInterval;
+    memcpy(header.rng, game->rng.s, sizeof(header.rng));
+    header.hash = hashGame(game);
+    if (sessions != NULL) {
+        memcpy(header.sessions, sessions, sizeof(header.sessions));
+    }
+    header.gameOver = game->gameOver;
+    header.survivorWon = game->survivorWon;
+
+    size_t mazeBytes = header.cellsBytes + header.linksBytes;
+    *length = sizeof(header) + mazeBytes + header.journalBytes;
+    unsigned char* data = malloc(*length);
+    if (data == NULL) {
+        return NULL;
+    }
+    memcpy(data + sizeof(header), maze->cells, header.cellsBytes);
+    memcpy(data + sizeof(header) + header.cellsBytes, maze->links, header.linksBytes);
+    if (header.journalBytes > 0) {
+        memcpy(data + sizeof(header) + mazeBytes, journal->data, header.journalBytes);
+    }
+
+    // Split as validSnapshot() splits it
+    struct iovec parts[3] = {
+        { &header, sizeof(header) },
+        { data + sizeof(header), mazeBytes },
+        { data + sizeof(header) + mazeBytes, header.journalBytes },
+    };
+    header.checksum = snapshotChecksum(parts, 3);
+    memcpy(data, &header, sizeof(header));
+    return data;
+}
+
+// Write an encoded snapshot to a temporary file, flush it and rename it over
+// path; the caller flushes the directory. Returns -1 if it could not be
+// written; the previous snapshot is then kept.
+static int writeSnapshotFile(const unsigned char* data, size_t length, const char* path) {
+    char temporary[512];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t written = write(fd, data, length);
+    // The data must be on disk before the rename is, or a crash could leave
+    // the new name on an empty file
+    bool synced = (written == (ssize_t)length && fsync(fd) == 0);
+    if (close(fd) < 0 || !synced || rename(temporary, path) < 0) {
+        unlink(temporary);
+        return -1;
+    }
+    return 0;
+}
+
+// Write the game and its journal buffer to path, replacing any snapshot
+// there in one rename; a server passes its seats' sessions, local games
+// NULL. Returns -1 if it could not be written; the previous snapshot is then kept.
+int saveSnapshot(const Game* game, const unsigned int sessions[2][2], const JournalWriter* journal, const char* path) {
+    size_t length;
+    unsigned char* data = encodeSnapshot(game, sessions, journal, &length);
+    if (data == NULL) {
+        return -1;
+    }
+    int result = writeSnapshotFile(data, length, path);
+    free(data);
+    if (result == 0) {
+        syncDirectory(path);
+    }
+    return result;
+}
+
+// A file for the writer thread to write, or to remove
+struct SnapshotJob {
+    char path[256];
+    unsigned char* data;        // Encoded snapshot, NULL to remove the file
+    size_t length;
+    SnapshotJob* next;
+};
+
+// Write queued snapshots until the writer is stopped and the queue drained.
+// Each batch taken from the queue is written file by file, then their
+// directory is flushed once for all of them.
+static void* runSnapshotWriter(void* arg) {
+    SnapshotWriter* writer = arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        if (writer->head == NULL) {
+            if (writer->stopping) {
+                break;
+            }
+            pthread_cond_wait(&writer->ready, &writer->lock);
+            continue;
+        }
+        SnapshotJob* batch = writer->head;
+        writer->head = writer->tail = NULL;
+        pthread_mutex_unlock(&writer->lock);
+
+        char directory[256] = "";
+        while (batch != NULL) {
+            SnapshotJob* job = batch;
+            batch = job->next;
+            if (job->data == NULL) {
+                unlink(job->path);
+                snprintf(directory, sizeof(directory), "%s", job->path);
+            } else if (writeSnapshotFile(job->data, job->length, job->path) < 0) {
+                fprintf(stderr, "Snapshot %s could not be written\n", job->path);
+            } else {
+                snprintf(directory, sizeof(directory), "%s", job->path);
+            }
+            free(job->data);
+            free(job);
+        }
+        if (directory[0] != '\0') {
+            syncDirectory(directory);
+        }
+
+        pthread_mutex_lock(&writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+// Start the writer thread. Returns -1 if it could not be started; snapshots
+// are then written by the caller, as saveSnapshot() does.
+int startSnapshotWriter(SnapshotWriter* writer) {
+    memset(writer, 0, sizeof(*writer));
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->ready, NULL);
+
+    if (pthread_create(&writer->thread, NULL, runSnapshotWriter, writer) != 0) {
+        perror("Snapshot writer thread failed");
+        return -1;
+    }
+    writer->running = true;
+    return 0;
+}
+
+// Hand a job for path to the writer. A job still queued for the same path
+// is replaced in place, so a match has at most one and its files change in
+// the order they were queued. Returns -1 if out of memory.
+static int queueJob(SnapshotWriter* writer, const char* path, unsigned char* data, size_t length) {
+    pthread_mutex_lock(&writer->lock);
+    for (SnapshotJob* job = writer->head; job != NULL; job = job->next) {
+        if (strcmp(job->path, path) == 0) {
+            free(job->data);
+            job->data = data;
+            job->length = length;
+            pthread_mutex_unlock(&writer->lock);
+            return 0;
+        }
+    }
+    SnapshotJob* job = malloc(sizeof(SnapshotJob));
+    if (job == NULL) {
+        pthread_mutex_unlock(&writer->lock);
+        return -1;
+    }
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    job->data = data;
+    job->length = length;
+    job->next = NULL;
+    if (writer->tail != NULL) {
+        writer->tail->next = job;
+    } else {
+        writer->head = job;
+    }
+    writer->tail = job;
+    pthread_cond_signal(&writer->ready);
+    pthread_mutex_unlock(&writer->lock);
+    return 0;
+}
+
+// Encode the game on the caller's thread and queue it to be written to
+// path, as saveSnapshot() would. Returns -1 if out of memory; the previous
+// snapshot is then kept.
+int queueSnapshot(SnapshotWriter* writer, const Game* game, const unsigned int sessions[2][2],
+                  const JournalWriter* journal, const char* path) {
+    if (!writer->running) {
+        return saveSnapshot(game, sessions, journal, path);
+    }
+    size_t length;
+    unsigned char* data = encodeSnapshot(game, sessions, journal, &length);
+    if (data == NULL || queueJob(writer, path, data, length) < 0) {
+        free(data);
+        return -1;
+    }
+    return 0;
+}
+
+// Remove the snapshot at path once any write queued for it is done with
+void removeSnapshot(SnapshotWriter* writer, const char* path) {
+    if (!writer->running || queueJob(writer, path, NULL, 0) < 0) {
+        unlink(path);
+    }
+}
+
+// Write everything still queued, then stop the thread
+void stopSnapshotWriter(SnapshotWriter* writer) {
+    if (writer->running) {
+        pthread_mutex_lock(&writer->lock);
+        writer->stopping = true;
+        pthread_cond_signal(&writer->ready);
+        pthread_mutex_unlock(&writer->lock);
+        pthread_join(writer->thread, NULL);
+        writer->running = false;
+    }
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->ready);
+}
+
+// Does the mapped file hold a whole snapshot this build can load?
+static bool validSnapshot(const unsigned char* data, size_t length) {
+    if (length < sizeof(SnapshotHeader)) {
+        return false;
+    }
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION || header.headerBytes != sizeof(header) ||
+        header.height < MIN_MAZE_SIZE || header.width < MIN_MAZE_SIZE ||
+        header.height > MAX_STREAM_HEIGHT || header.width > MAX_MAZE_SIZE) {
+        return false;
+    }
+
+    bool streaming = header.height > MAX_MAZE_SIZE;
+    uint64_t cellsBytes = streaming ? 0 : (uint64_t)header.height * ((header.width + 63) / 64) * sizeof(uint64_t);
+    uint64_t links = streaming ? 0 : linkBytes(header.height, header.width);
+    if (header.cellsBytes != cellsBytes || header.linksBytes != links ||
+        header.journalBytes > length || length != sizeof(header) + cellsBytes + links + header.journalBytes) {
+        return false;
+    }
+
+    uint32_t checksum = header.checksum;
+    header.checksum = 0;
+    // Parts are hashed a word at a time from their own start, so the links
+    // and the journal are split as they were when saved
+    size_t maze = cellsBytes + links;
+    struct iovec parts[3] = {
+        { &header, sizeof(header) },
+        { (void*)(data + sizeof(header)), maze },
+        { (void*)(data + sizeof(header) + maze), header.journalBytes },
+    };
+    return snapshotChecksum(parts, 3) == checksum;
+}
+
+// Rebuild a game from a snapshot, and the seats' sessions and the journal
+// buffer for whichever of sessions and journal is not NULL. Returns -1 if
+// there is none at path, it is damaged or from another version, or the maze
+// cannot be allocated; the journal is then left alone.
+int loadSnapshot(Game* game, unsigned int sessions[2][2], JournalWriter* journal, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size < (off_t)sizeof(SnapshotHeader)) {
+        close(fd);
+        return -1;
+    }
+    unsigned char* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    if (!validSnapshot(data, info.st_size)) {
+        munmap(data, info.st_size);
+        return -1;
+    }
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    memset(game, 0, sizeof(*game));
+    Maze* maze = &game->maze;
+    int result = 0;
+    if (header.height > MAX_MAZE_SIZE) {
+        // Carve the same rows again, which leaves the window where it was;
+        // only the game's state below comes from the file
+        result = setupGame(game, header.height, header.width, header.seed);
+        if (result == 0) {
+            restoreMazeStream(maze, header.generatedRows);
+        }
+    } else {
+        maze->links = malloc(header.linksBytes);
+        result = (maze->links == NULL || allocateMaze(maze, header.height, header.width) < 0) ? -1 : 0;
+        if (result == 0) {
+            memcpy(maze->cells, data + sizeof(header), header.cellsBytes);
+            memcpy(maze->links, data + sizeof(header) + header.cellsBytes, header.linksBytes);
+        }
+    }
+    JournalWriter saved;
+    if (result == 0 && journal != NULL) {
+        journalResume(&saved, data + sizeof(header) + header.cellsBytes + header.linksBytes, header.journalBytes,
+                      header.journalRunAction, header.journalRunLength);
+    }
+    munmap(data, info.st_size);
+    if (result < 0) {
+        freeMaze(maze);
+        return -1;
+    }
+
+    maze->startY = header.startY;
+    maze->startX = header.startX;
+    maze->exitY = header.exitY;
+    maze->exitX = header.exitX;
+    maze->score.exitDistance = header.exitDistance;
+    maze->score.deadEnds = header.deadEnds;
+    game->seed = header.seed;
+    game->survivorY = header.survivorY;
+    game->survivorX = header.survivorX;
+    game->killerY = header.killerY;
+    game->killerX = header.killerX;
+    game->spawnDistance = header.spawnDistance;
+    game->survivorMovesLeft = header.survivorMovesLeft;
+    game->killerMovesLeft = header.killerMovesLeft;
+    game->currentTurn = header.currentTurn;
+    game->turnCounter = header.turnCounter;
+    game->lastRelocatedTurn = header.lastRelocatedTurn;
+    game->relocateInterval = header.relocateInterval;
+    memcpy(game->rng.s, header.rng, sizeof(header.rng));
+    game->gameOver = header.gameOver;
+    game->survivorWon = header.survivorWon;
+    keepPlayerRows(game);
+
+    // A checksum only proves the file is whole; the state must also be
+    // playable. A streaming maze's exit may lie outside the rows it holds.
+    bool exitHeld = maze->exitY >= maze->firstRow && maze->exitY < maze->generatedRows;
+    if ((game->currentTurn != SURVIVOR_TURN && game->currentTurn != KILLER_TURN) ||
+        maze->generatedRows != header.generatedRows ||
+        !mazeIsOpen(maze, game->survivorY, game->survivorX) ||
+        !mazeIsOpen(maze, game->killerY, game->killerX) ||
+        (!mazeIsOpen(maze, maze->exitY, maze->exitX) && (maze->stream == NULL || exitHeld)) ||
+        hashGame(game) != header.hash) {
+        freeMaze(maze);
+        if (journal != NULL) {
+            journalDiscard(&saved);
+        }
+        return -1;
+    }
+    if (sessions != NULL) {
+        memcpy(sessions, header.sessions, sizeof(header.sessions));
+    }
+    if (journal != NULL) {
+        *journal = saved;
+    }
+    return 0;
+}
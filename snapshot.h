@@ -0,0 +1,93 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "engine.h"
+#include "journal.h"
+
+// Snapshots of games in progress, so a match outlives a quit, a crash or a
+// server restart. A snapshot has a fixed layout in native byte order:
+//
+//   SnapshotHeader, the maze bitboard (cellsBytes), the room links (linksBytes),
+//   the game's journal buffer (journalBytes)
+//
+// It is written to a temporary file, flushed, then renamed over the previous
+// snapshot and the directory flushed, so a crash leaves one whole snapshot or
+// the other. Loading maps the file and checks the header, the sizes and a
+// checksum in place, then copies the bitboard and links straight into the
+// maze; nothing is parsed.
+// Streaming mazes store no cells: their rows depend only on the seed and how
+// many were carved, so they are carved again on load. A server match also
+// keeps each seat's session token, so its players can claim it after a restart.
+// The journal buffer lets the resumed game be journaled from its first move.
+//
+// A server snapshots every match at every turn end, so it hands the writing
+// to a SnapshotWriter thread and never waits on the disk: queueSnapshot()
+// encodes the game into one buffer on the caller's thread and queues it. A
+// snapshot still queued for the same file is replaced rather than followed,
+// so the queue holds one per match at most however slow the disk is, and a
+// removal queued when the match ends waits behind any write of its file.
+// The thread takes the whole queue at a time, writes and flushes each file,
+// then flushes the directory once for the batch.
+
+#define SNAPSHOT_FILE "deja.snapshot"       // The game's unfinished local match
+#define SNAPSHOT_DIR "deja.snapshots"       // The server's, one file per match
+#define SNAPSHOT_MAGIC "DEJS"
+#define SNAPSHOT_VERSION 4                  // Bumped whenever the layout or the carving of rows changes
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerBytes;       // sizeof(SnapshotHeader)
+    uint32_t checksum;          // snapshotChecksum() of the file with this field zeroed
+    uint64_t seed;
+    uint64_t cellsBytes;
+    uint64_t linksBytes;
+    uint64_t journalBytes;      // 0 if the game was not being journaled
+    int32_t journalRunAction;   // The journal's pending run of repeated actions
+    uint32_t journalRunLength;
+    int32_t height, width;
+    int32_t generatedRows;
+    int32_t startY, startX;
+    int32_t exitY, exitX;
+    int32_t exitDistance, deadEnds;
+    int32_t survivorY, survivorX;
+    int32_t killerY, killerX;
+    int32_t spawnDistance;
+    int32_t survivorMovesLeft, killerMovesLeft;
+    int32_t currentTurn;
+    int32_t turnCounter;
+    int32_t lastRelocatedTurn;
+    int32_t relocateInterval;
+    uint32_t rng[4];
+    uint32_t hash;              // hashGame() of the saved state
+    uint32_t sessions[2][2];    // Each seat's session token on a server, zero for the bot's and in local games
+    uint8_t gameOver, survivorWon;
+    uint8_t reserved[2];
+} SnapshotHeader;
+
+typedef struct SnapshotJob SnapshotJob;
+
+// Writer thread and its queue of encoded snapshots and removals
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    SnapshotJob* head;          // Oldest job not yet taken by the thread
+    SnapshotJob* tail;
+    bool stopping;
+    bool running;
+    pthread_t thread;
+} SnapshotWriter;
+
+// Function declarations for game snapshots
+int saveSnapshot(const Game* game, const unsigned int sessions[2][2], const JournalWriter* journal, const char* path);
+int loadSnapshot(Game* game, unsigned int sessions[2][2], JournalWriter* journal, const char* path);
+int startSnapshotWriter(SnapshotWriter* writer);
+int queueSnapshot(SnapshotWriter* writer, const Game* game, const unsigned int sessions[2][2],
+                  const JournalWriter* journal, const char* path);
+void removeSnapshot(SnapshotWriter* writer, const char* path);
+void stopSnapshotWriter(SnapshotWriter* writer);
+
+#endif // SNAPSHOT_H
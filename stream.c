@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+
+// Eller's algorithm state between rows. Sets are named by labels in
+// [0, columns); a row never holds more sets than rooms, so labels freed by
+// merges are always enough for the rooms that start new sets.
+struct MazeStream {
+    Rng rng;                // Carving only, so the game's own draws do not depend on when rows are carved
+    int columns;            // Rooms per row
+    int nextRow;            // Next room row to carve
+    int keepRow;            // First row the engine still needs; carving never drops it
+    int doorX;              // Column of the exit's door in the bottom row
+    int* sets;              // Label of each room in the row being carved
+    int* parent;            // Union-find over labels while the row is joined
+    int* last;              // Rightmost room of each set, -1 once the set has gone down
+};
+
+static int findSet(int* parent, int label) {
+    while (parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
+}
+
+// Carve one room row, its passages to the right and its passages down, into
+// window rows freed by dropping the oldest. Returns false, carving nothing,
+// if that would drop a row the engine keeps.
+static bool carveRow(Maze* maze, MazeStream* stream) {
+    int columns = stream->columns;
+    int* sets = stream->sets;
+    int* parent = stream->parent;
+    int* last = stream->last;
+    int y = 2 * stream->nextRow + 1;
+    bool lastRow = (stream->nextRow == maze->height / 2 - 1);
+    int end = lastRow ? maze->height : y + 2;
+
+    int firstRow = end - (maze->rowMask + 1);
+    if (firstRow > maze->firstRow) {
+        if (firstRow > stream->keepRow) {
+            return false;
+        }
+        maze->firstRow = firstRow;
+    }
+    for (int row = y; row < end; row++) {
+        memset(MAZE_ROW(maze, row), 0, maze->stride * sizeof(uint64_t));
+    }
+
+    // Each band starts its sets afresh, so rooms count as joined only through
+    // rows of this band and the last, which the window still holds
+    if (stream->nextRow % STREAM_BAND_ROWS == 0) {
+        for (int j = 0; j < columns; j++) {
+            sets[j] = j;
+        }
+    }
+
+    for (int j = 0; j < columns; j++) {
+        mazeOpenCell(maze, y, 2 * j + 1);
+        parent[j] = j;
+    }
+
+    // Join neighbouring rooms of different sets at random; the last row joins
+    // them all, which connects the whole maze
+    for (int j = 0; j + 1 < columns; j++) {
+        int left = findSet(parent, sets[j]);
+        int right = findSet(parent, sets[j + 1]);
+        if (left != right && (lastRow || rngRange(&stream->rng, 2) == 0)) {
+            parent[right] = left;
+            mazeOpenCell(maze, y, 2 * j + 2);
+        }
+    }
+    for (int j = 0; j < columns; j++) {
+        sets[j] = findSet(parent, sets[j]);
+    }
+    stream->nextRow++;
+    if (lastRow) {
+        mazeOpenCell(maze, maze->height - 1, stream->doorX);
+        maze->generatedRows = maze->height;
+        return true;
+    }
+
+    // Every set goes down through at least one room, its rightmost one if
+    // chance has not picked another; parent[] now marks labels in use
+    for (int j = 0; j < columns; j++) {
+        parent[j] = 0;
+    }
+    for (int j = 0; j < columns; j++) {
+        last[sets[j]] = j;
+        parent[sets[j]] = 1;
+    }
+    int fresh = 0;
+    for (int j = 0; j < columns; j++) {
+        int set = sets[j];
+        if (last[set] == j || rngRange(&stream->rng, 2) == 0) {
+            mazeOpenCell(maze, y + 1, 2 * j + 1);
+            last[set] = -1;
+        } else {
+            // Rooms that do not go down start a set of their own in the next row
+            while (parent[fresh]) {
+                fresh++;
+            }
+            parent[fresh] = 1;
+            sets[j] = fresh;
+        }
+    }
+    maze->generatedRows = y + 2;
+    return true;
+}
+
+// Carve bands until rows down to y + STREAM_AHEAD_ROWS exist, or the window
+// cannot move on without dropping rows the engine keeps
+void extendMazeStream(Maze* maze, int y) {
+    MazeStream* stream = maze->stream;
+    while (maze->generatedRows < maze->height && maze->generatedRows <= y + STREAM_AHEAD_ROWS) {
+        for (int i = 0; i < STREAM_BAND_ROWS && maze->generatedRows < maze->height; i++) {
+            if (!carveRow(maze, stream)) {
+                return;
+            }
+        }
+    }
+}
+
+// Keep the rows from STREAM_BEHIND_ROWS above top, then carve below bottom as
+// far as that allows; the engine calls this with the players' rows after
+// every move, which also carves on once the higher player has followed
+void keepMazeRows(Maze* maze, int top, int bottom) {
+    if (maze->stream != NULL) {
+        maze->stream->keepRow = top - STREAM_BEHIND_ROWS;
+        extendMazeStream(maze, bottom);
+    }
+}
+
+// Carve row by row until exactly rows rows exist, whatever the engine keeps,
+// as when a saved game is loaded: the window then ends where it did
+void restoreMazeStream(Maze* maze, int rows) {
+    MazeStream* stream = maze->stream;
+    int keepRow = stream->keepRow;
+    stream->keepRow = maze->height;
+    while (maze->generatedRows < rows && maze->generatedRows < maze->height) {
+        carveRow(maze, stream);
+    }
+    stream->keepRow = keepRow;
+}
+
+// Start a streaming maze: the first bands are carved, the rest waits for the
+// players. The exit starts on the bottom edge. Returns -1 if out of memory.
+int initializeStreamingMaze(Maze* maze, int height, int width, Rng* rng) {
+    freeMaze(maze);
+
+    int columns = width / 2;
+    MazeStream* stream = calloc(1, sizeof(MazeStream));
+    int* state = malloc(3 * (size_t)columns * sizeof(int));
+    int stride = (width + 63) / 64;
+    uint64_t* cells = calloc((size_t)STREAM_WINDOW_ROWS * stride, sizeof(uint64_t));
+    if (stream == NULL || state == NULL || cells == NULL) {
+        free(stream);
+        free(state);
+        free(cells);
+        return -1;
+    }
+
+    stream->columns = columns;
+    stream->sets = state;
+    stream->parent = state + columns;
+    stream->last = state + 2 * columns;
+    for (int j = 0; j < columns; j++) {
+        stream->sets[j] = j;
+    }
+    rngSeed(&stream->rng, (uint64_t)rngNext(rng) << 32 | rngNext(rng));
+
+    maze->height = height;
+    maze->width = width;
+    maze->stride = stride;
+    maze->cells = cells;
+    maze->generatedRows = 0;
+    maze->firstRow = 0;
+    maze->rowMask = STREAM_WINDOW_ROWS - 1;
+    maze->stream = stream;
+    maze->startY = 1;
+    maze->startX = 1;
+    extendMazeStream(maze, maze->startY);
+
+    // The door is opened when the bottom row is carved
+    maze->exitY = height - 1;
+    maze->exitX = 1 + 2 * rngRange(rng, columns);
+    stream->doorX = maze->exitX;
+    return 0;
+}
+
+// Release the row generator; the bitboard goes with freeMaze()
+void freeMazeStream(Maze* maze) {
+    if (maze->stream != NULL) {
+        free(maze->stream->sets);
+        free(maze->stream);
+        maze->stream = NULL;
+    }
+}
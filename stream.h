@@ -0,0 +1,36 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "maze.h"
+
+// Streaming mazes. Mazes taller than MAX_MAZE_SIZE are carved lazily, a band
+// of rows at a time, with Eller's algorithm: it only needs the set of each
+// room in the current row, so its working state is O(width) however tall
+// the maze is. Every band starts its sets afresh, which leaves a few loops
+// along its top row but means two rooms are never joined only through rows
+// more than a band above them. movePlayer() keeps carving at least STREAM_AHEAD_ROWS below
+// every player, and rows below that read as wall until they are reached.
+//
+// The bitboard holds only a window of STREAM_WINDOW_ROWS rows, a ring that
+// row y maps into at y & maze->rowMask, so memory stays the same however
+// deep the players go. Carving a row past the window drops the top one,
+// which then reads as wall; the search scratch space, fog of war views and
+// path clusters are sized to the window too. The engine holds the rows from
+// STREAM_BEHIND_ROWS above the higher player with keepMazeRows(), and no row
+// is carved while that would drop one of them, so the players can be about
+// STREAM_WINDOW_ROWS - STREAM_BEHIND_ROWS - STREAM_AHEAD_ROWS rows apart
+// before the lower one finds the way down walled off until the other follows.
+
+#define STREAM_BAND_ROWS 64         // Room rows carved per band
+#define STREAM_AHEAD_ROWS 128       // Cell rows kept carved below every player
+#define STREAM_BEHIND_ROWS 512      // Cell rows kept above the higher player
+#define STREAM_WINDOW_ROWS 2048     // Cell rows held at once; a power of two
+
+// Function declarations for streaming mazes
+int initializeStreamingMaze(Maze* maze, int height, int width, Rng* rng);
+void extendMazeStream(Maze* maze, int y);
+void keepMazeRows(Maze* maze, int top, int bottom);
+void restoreMazeStream(Maze* maze, int rows);
+void freeMazeStream(Maze* maze);
+
+#endif // STREAM_H
@@ -1,109 +1,177 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <locale.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <ncurses.h>
 #include "game.h"
+#include "maze.h"
+#include "metrics.h"
+#include "render.h"
 
 // Global state variable definition
 int currentState = STATE_TITLE;
+int mazeHeight = DEFAULT_HEIGHT;
+int mazeWidth = DEFAULT_WIDTH;
 
+extern char** environ;
+
+// Background music player, or 0 when none is running
+static pid_t musicPid = 0;
+
+// Start the music player directly, without a shell in between. Its output
+// goes to /dev/null so it cannot draw over the screen.
 void bg_music() {
-    system("nohup mpg123 -q bg-music.mp3 > /dev/null 2>&1 &"); // Fully detach music
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    char* args[] = { "mpg123", "-q", "bg-music.mp3", NULL };
+    if (posix_spawnp(&musicPid, "mpg123", &actions, NULL, args, environ) != 0) {
+        musicPid = 0; // No player installed; play silently
+    }
+    posix_spawn_file_actions_destroy(&actions);
+}
+
+// Stop the player started by bg_music() and reap it
+void stopMusic() {
+    if (musicPid > 0) {
+        kill(musicPid, SIGTERM);
+        waitpid(musicPid, NULL, 0);
+        musicPid = 0;
+    }
+}
+
+// Set up the one ncurses session shared by the menus and the game
+void initScreen() {
+    setlocale(LC_ALL, ""); // The title art is UTF-8
+    initscr();
+    cbreak();
+    noecho();
+    keypad(stdscr, TRUE);
+    curs_set(0); // Hide cursor
+
+    // Initialize colors if terminal supports them
+    if (has_colors()) {
+        start_color();
+        use_default_colors(); // Use terminal default colors
+
+        init_pair(1, COLOR_GREEN, COLOR_BLACK);  // Survivor
+        init_pair(2, COLOR_CYAN, COLOR_BLACK);   // Exit
+        init_pair(3, COLOR_RED, COLOR_BLACK);    // Killer
+        init_pair(4, COLOR_WHITE, COLOR_BLACK);  // Wall
+        init_pair(5, COLOR_YELLOW, COLOR_BLACK); // Status text
+    }
+    initRenderer();
 }
 
 // Function to display the title screen
 void showTitleScreen() {
-    const char *RED = "\033[31m";
-    const char *RESET = "\033[0m";
-    printf("\n\n");
-    printf("%s▓█████▄ ▓█████ ▄▄▄██▀▀▀▄▄▄      %s\n", RED, RESET);
-    printf("%s▒██▀ ██▌▓█   ▀   ▒██  ▒████▄    %s\n", RED, RESET);
-    printf("%s░██   █▌▒███     ░██  ▒██  ▀█▄  %s\n", RED, RESET);
-    printf("%s░▓█▄   ▌▒▓█  ▄▓██▄██▓ ░██▄▄▄▄██ %s\n", RED, RESET);
-    printf("%s░▒████▓ ░▒████▒▓███▒   ▓█   ▓██▒%s\n", RED, RESET);
-    printf("%s ▒▒▓  ▒ ░░ ▒░ ░▒▓▒▒░   ▒▒   ▓▒█░%s\n", RED, RESET);
-    printf("%s ░ ▒  ▒  ░ ░  ░▒ ░▒░    ▒   ▒▒ ░%s\n", RED, RESET);
-    printf("%s ░ ░  ░    ░   ░ ░ ░    ░   ▒   %s\n", RED, RESET);
-    printf("%s   ░       ░  ░░   ░        ░  ░%s\n", RED, RESET);
-    printf("%s ░                              %s\n", RED, RESET);
-    printf("\n\n");
-    printf("1. Start Game        \n");
-    printf("2. Instructions      \n");
-    printf("3. Exit              \n");
-    printf("=================================\n");
-    printf("Choose an option (1-3): ");
+    static const char* logo[] = {
+        "▓█████▄ ▓█████ ▄▄▄██▀▀▀▄▄▄      ",
+        "▒██▀ ██▌▓█   ▀   ▒██  ▒████▄    ",
+        "░██   █▌▒███     ░██  ▒██  ▀█▄  ",
+        "░▓█▄   ▌▒▓█  ▄▓██▄██▓ ░██▄▄▄▄██ ",
+        "░▒████▓ ░▒████▒▓███▒   ▓█   ▓██▒",
+        " ▒▒▓  ▒ ░░ ▒░ ░▒▓▒▒░   ▒▒   ▓▒█░",
+        " ░ ▒  ▒  ░ ░  ░▒ ░▒░    ▒   ▒▒ ░",
+        " ░ ░  ░    ░   ░ ░ ░    ░   ▒   ",
+        "   ░       ░  ░░   ░        ░  ░",
+        " ░                              ",
+    };
+    int lines = sizeof(logo) / sizeof(logo[0]);
+
+    clear();
+    attron(COLOR_PAIR(3));
+    for (int i = 0; i < lines; i++) {
+        mvprintw(2 + i, 0, "%s", logo[i]);
+    }
+    attroff(COLOR_PAIR(3));
+    mvprintw(lines + 4, 0, "1. Start Game");
+    mvprintw(lines + 5, 0, "2. Instructions");
+    mvprintw(lines + 6, 0, "3. Exit");
+    mvprintw(lines + 7, 0, "=================================");
+    mvprintw(lines + 8, 0, "Choose an option (1-3): ");
+    refresh();
 }
 
 void startGame() {
-    // Set the game state to playing
+    // Set the game state to playing; main() hands over to runGame()
     currentState = STATE_PLAYING;
-    printf("\nStarting the game...\n");
-    // This will call the game logic from main.c
 }
 
 void showInstructions() {
     currentState = STATE_INSTRUCTIONS;
-    printf("\n===== GAME INSTRUCTIONS =====\n");
-    printf("SURVIVOR: Use arrow keys to move\n");
-    printf("KILLER: Use WASD keys to move\n");
-    printf("End your turn with spacebar\n");
-    printf("Survivor's goal: Reach the exit (E)\n");
-    printf("Killer's goal: Catch the survivor\n");
-    printf("Each player rolls dice to determine movement points\n");
-    printf("The exit relocates every 10 turns\n");
-    printf("Press Q to quit the game\n");
-    printf("=============================\n");
-    
-    printf("\nPress Enter to return to the title screen...");
-    getchar(); // Wait for Enter key
+    clear();
+    mvprintw(0, 0, "===== GAME INSTRUCTIONS =====");
+    mvprintw(1, 0, "SURVIVOR: Use arrow keys to move");
+    mvprintw(2, 0, "KILLER: Use WASD keys to move");
+    mvprintw(3, 0, "End your turn with spacebar");
+    mvprintw(4, 0, "Survivor's goal: Reach the exit (E)");
+    mvprintw(5, 0, "Killer's goal: Catch the survivor");
+    mvprintw(6, 0, "Each player rolls dice to determine movement points");
+    mvprintw(7, 0, "The exit relocates every 10 turns");
+    mvprintw(8, 0, "Press Q to quit the game");
+    mvprintw(9, 0, "=============================");
+    mvprintw(11, 0, "Press any key to return to the title screen...");
+    refresh();
+    getch();
     currentState = STATE_TITLE;
 }
 
-int main() {
-    int choice;
-    
+// Leave the terminal and the music the way they were found
+static void shutdownFrontEnd() {
+    if (!isendwin()) {
+        endwin();
+    }
+    stopMusic();
+    stopMetricsSocket();
+}
+
+int main(int argc, char** argv) {
+    // Optional maze size, e.g. "./deadly_escape 21x61"
+    if (argc > 1 && !parseMazeSize(argv[1], &mazeHeight, &mazeWidth)) {
+        fprintf(stderr, "Usage: %s [HEIGHTxWIDTH]  (each between %d and %d, heights up to %d)\n",
+                argv[0], MIN_MAZE_SIZE, MAX_MAZE_SIZE, MAX_STREAM_HEIGHT);
+        return 1;
+    }
+
     bg_music(); // Start music once when program runs
-    
+    startMetricsSocket("client"); // Latency snapshots on /tmp/deja-client-<pid>.sock
+    initScreen();
+    atexit(shutdownFrontEnd); // Also covers the exit() calls on network errors
+
     // Main menu loop
     while (1) {
         // If the state is STATE_PLAYING, run the game
         if (currentState == STATE_PLAYING) {
             runGame(); // Call the game logic from main.c
             currentState = STATE_TITLE; // Return to title screen after game ends
-            system("clear || cls"); // Clear screen
             continue;
         }
-        
-        // Show title screen and get user input
+
+        // Show title screen and read one key
         showTitleScreen();
-        if (scanf("%d", &choice) != 1) {
-            // If input is invalid (not a number)
-            printf("Invalid input. Please enter a number.\n");
-            while (getchar() != '\n'); // Clear invalid input
-            continue;
-        }
-        
-        while (getchar() != '\n'); // Clear input buffer after valid scanf
-        
-        switch (choice) {
-            case 1:
+        switch (getch()) {
+            case '1':
                 startGame();
                 break;
-            case 2:
+            case '2':
                 showInstructions();
                 break;
-            case 3:
-                printf("Exiting the game. Goodbye!\n");
-                system("killall mpg123"); // Stop the background music
-                exit(0);
+            case '3':
+            case 'q':
+            case 'Q':
+                return 0; // shutdownFrontEnd() restores the terminal
             default:
-                printf("Invalid choice. Try again.\n");
-                printf("\nPress Enter to continue...");
-                getchar();
-        }
-        
-        if (currentState != STATE_INSTRUCTIONS) {
-            system("clear || cls"); // Clear screen (Linux/Windows)
+                break; // Redraw the menu
         }
     }
-    
+
     return 0;
 }
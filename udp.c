@@ -0,0 +1,474 @@
+#include <stdlib.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "udp.h"
+#include "metrics.h"
+
+// Datagram flags
+#define UDP_FLAG_HELLO 1
+#define UDP_FLAG_CLOSE 2
+
+#define UDP_HEADER_BYTES 10
+#define UDP_DATAGRAM_BYTES (UDP_HEADER_BYTES + UDP_MAX_RECORDS * RECORD_MAX_BYTES)
+#define MS 1000000u     // metricsNow() ticks per millisecond
+
+// A record sent but not yet acked
+typedef struct {
+    Record record;
+    bool reliable;          // Resent on the timer rather than left to the next datagram
+    int transmissions;
+    uint64_t firstSent;     // metricsNow() of the first transmission
+} Outgoing;
+
+static struct {
+    int fd;                 // Connected UDP socket, or -1 when there is no link
+    int readFd, writeFd;    // One byte per record in the inbox; closed at the far end when the peer goes
+    int stopFds[2];         // Wakes the link thread to stop it
+    bool host;
+    bool closed;            // The peer said goodbye, went silent or refused our datagrams
+    pthread_t thread;
+
+    Outgoing window[UDP_MAX_RECORDS];
+    uint32_t windowSeq;     // Sequence number of window[0]
+    int windowCount;
+    uint64_t resendAt;      // When unacked reliable records go out again, or 0
+    uint64_t resendDelay;
+    int resendRun;          // Resends since an ack last moved the window on
+    int longestResendRun;
+
+    uint32_t expected;      // Next sequence number from the peer
+    Record inbox[UDP_INBOX_RECORDS];
+    int inboxHead, inboxCount;
+
+    uint64_t lastSent, lastHeard;
+    int lossPercent;
+    Rng lossRng;
+} udpLink = { .fd = -1, .readFd = -1, .writeFd = -1, .stopFds = { -1, -1 } };
+
+static pthread_mutex_t linkLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void putU32(unsigned char* buffer, uint32_t value) {
+    value = htonl(value);
+    memcpy(buffer, &value, sizeof(value));
+}
+
+static uint32_t getU32(const unsigned char* buffer) {
+    uint32_t value;
+    memcpy(&value, buffer, sizeof(value));
+    return ntohl(value);
+}
+
+// Send one datagram, unless simulated loss eats it
+static void sendDatagram(const unsigned char* buffer, size_t length) {
+    if (udpLink.lossPercent > 0 && rngRange(&udpLink.lossRng, 100) < udpLink.lossPercent) {
+        return;
+    }
+    send(udpLink.fd, buffer, length, MSG_NOSIGNAL);
+}
+
+// Send the ack and every unacked record. Caller holds linkLock.
+static void transmit(int flags) {
+    unsigned char buffer[UDP_DATAGRAM_BYTES];
+    uint64_t now = metricsNow();
+    buffer[0] = (unsigned char)flags;
+    putU32(buffer + 1, udpLink.expected);
+    putU32(buffer + 5, udpLink.windowSeq);
+    buffer[9] = (unsigned char)udpLink.windowCount;
+
+    size_t length = UDP_HEADER_BYTES;
+    for (int i = 0; i < udpLink.windowCount; i++) {
+        Outgoing* outgoing = &udpLink.window[i];
+        if (outgoing->transmissions++ == 0) {
+            outgoing->firstSent = now;
+        }
+        length += encodeRecord(&outgoing->record, buffer + length);
+    }
+    sendDatagram(buffer, length);
+    udpLink.lastSent = now;
+}
+
+// Wake the game with end of file; records already in the inbox are still read first
+static void markClosed(void) {
+    udpLink.closed = true;
+    if (udpLink.writeFd >= 0) {
+        close(udpLink.writeFd);
+        udpLink.writeFd = -1;
+    }
+}
+
+// Drop what the peer acked and rearm the resend timer for what is left
+static void applyAck(uint32_t ack) {
+    uint32_t acked = ack - udpLink.windowSeq;
+    if (acked == 0 || acked > (uint32_t)udpLink.windowCount) {
+        return;
+    }
+    for (uint32_t i = 0; i < acked; i++) {
+        // Only a record sent once gives an unambiguous round trip
+        if (udpLink.window[i].transmissions == 1) {
+            metricsRecord(METRIC_ROUND_TRIP, udpLink.window[i].firstSent);
+        }
+    }
+    udpLink.resendRun = 0;
+    udpLink.windowCount -= acked;
+    memmove(udpLink.window, udpLink.window + acked, udpLink.windowCount * sizeof(Outgoing));
+    udpLink.windowSeq = ack;
+
+    udpLink.resendAt = 0;
+    for (int i = 0; i < udpLink.windowCount; i++) {
+        if (udpLink.window[i].reliable) {
+            udpLink.resendDelay = UDP_RESEND_MS * MS;
+            udpLink.resendAt = metricsNow() + udpLink.resendDelay;
+            break;
+        }
+    }
+}
+
+// Take in one datagram from the peer. Caller holds linkLock.
+static void handleDatagram(const unsigned char* buffer, size_t length) {
+    if (length < UDP_HEADER_BYTES) {
+        return;
+    }
+    udpLink.lastHeard = metricsNow();
+    if (buffer[0] & UDP_FLAG_CLOSE) {
+        markClosed();
+        return;
+    }
+    applyAck(getU32(buffer + 1));
+
+    uint32_t sequence = getU32(buffer + 5);
+    int count = buffer[9];
+    size_t offset = UDP_HEADER_BYTES;
+    for (int i = 0; i < count; i++, sequence++) {
+        Record record;
+        size_t used = decodeRecord(buffer + offset, length - offset, &record);
+        if (used == 0) {
+            break;
+        }
+        offset += used;
+        // Records before the expected one were delivered already; a full
+        // inbox leaves the rest unacked so the peer sends them again
+        if (sequence != udpLink.expected || udpLink.inboxCount == UDP_INBOX_RECORDS) {
+            continue;
+        }
+        udpLink.inbox[(udpLink.inboxHead + udpLink.inboxCount) % UDP_INBOX_RECORDS] = record;
+        udpLink.inboxCount++;
+        udpLink.expected++;
+        unsigned char byte = 0;
+        if (write(udpLink.writeFd, &byte, 1) < 0) {
+            perror("Link pipe write failed");
+        }
+    }
+
+    // Ack at once, even repeats, as our previous ack may be the one that was lost.
+    // The host answers every hello, so a joiner whose answer was lost still gets one.
+    if (count > 0 || (udpLink.host && (buffer[0] & UDP_FLAG_HELLO))) {
+        transmit(udpLink.host && (buffer[0] & UDP_FLAG_HELLO) ? UDP_FLAG_HELLO : 0);
+    }
+}
+
+// Milliseconds until the next timer is due
+static int nextTimerMs(uint64_t now) {
+    uint64_t due = udpLink.lastSent + UDP_PING_MS * MS;
+    if (udpLink.resendAt != 0 && udpLink.resendAt < due) {
+        due = udpLink.resendAt;
+    }
+    if (udpLink.lastHeard + UDP_TIMEOUT_MS * MS < due) {
+        due = udpLink.lastHeard + UDP_TIMEOUT_MS * MS;
+    }
+    return due <= now ? 0 : (int)((due - now + MS - 1) / MS);
+}
+
+// Link thread: receive datagrams, resend, ping and watch for a silent peer
+static void* runLink(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&linkLock);
+    while (1) {
+        struct pollfd fds[2];
+        fds[0].fd = udpLink.stopFds[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = udpLink.fd;
+        fds[1].events = POLLIN;
+        // Once the peer is gone only a stop request is left to wait for
+        int count = udpLink.closed ? 1 : 2;
+        int timeoutMs = udpLink.closed ? -1 : nextTimerMs(metricsNow());
+        pthread_mutex_unlock(&linkLock);
+        int ready = poll(fds, count, timeoutMs);
+        pthread_mutex_lock(&linkLock);
+        if (ready > 0 && fds[0].revents != 0) {
+            break;
+        }
+        if (udpLink.closed) {
+            continue;
+        }
+
+        unsigned char buffer[UDP_DATAGRAM_BYTES];
+        ssize_t received;
+        while (!udpLink.closed && (received = recv(udpLink.fd, buffer, sizeof(buffer), MSG_DONTWAIT)) >= 0) {
+            handleDatagram(buffer, received);
+        }
+        if (udpLink.closed) {
+            continue;
+        }
+        if (errno == ECONNREFUSED) {
+            markClosed(); // Nobody is listening on the peer's port any more
+            continue;
+        }
+
+        uint64_t now = metricsNow();
+        if (now - udpLink.lastHeard >= UDP_TIMEOUT_MS * MS) {
+            markClosed();
+            continue;
+        }
+        if (udpLink.resendAt != 0 && now >= udpLink.resendAt) {
+            transmit(0);
+            if (++udpLink.resendRun > udpLink.longestResendRun) {
+                udpLink.longestResendRun = udpLink.resendRun;
+            }
+            udpLink.resendDelay *= 2;
+            if (udpLink.resendDelay > UDP_MAX_RESEND_MS * MS) {
+                udpLink.resendDelay = UDP_MAX_RESEND_MS * MS;
+            }
+            udpLink.resendAt = now + udpLink.resendDelay;
+        } else if (now - udpLink.lastSent >= UDP_PING_MS * MS) {
+            transmit(0); // Also carries any moves whose datagram was lost
+        }
+    }
+    pthread_mutex_unlock(&linkLock);
+    return NULL;
+}
+
+// Simulated loss for testing, from the environment
+static void readLossSetting(void) {
+    const char* loss = getenv(UDP_LOSS_ENV);
+    udpLink.lossPercent = loss != NULL ? atoi(loss) : 0;
+    rngSeed(&udpLink.lossRng, ((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid());
+}
+
+// Start the link thread on a connected socket; returns the fd the game reads
+static int startLink(int fd, bool host) {
+    int inbox[2];
+    if (pipe(inbox) < 0 || pipe(udpLink.stopFds) < 0) {
+        perror("Pipe creation failed");
+        close(fd);
+        return -1;
+    }
+    udpLink.fd = fd;
+    udpLink.readFd = inbox[0];
+    udpLink.writeFd = inbox[1];
+    udpLink.host = host;
+    udpLink.closed = false;
+    udpLink.windowSeq = 0;
+    udpLink.windowCount = 0;
+    udpLink.resendAt = 0;
+    udpLink.resendRun = 0;
+    udpLink.longestResendRun = 0;
+    udpLink.expected = 0;
+    udpLink.inboxHead = 0;
+    udpLink.inboxCount = 0;
+    udpLink.lastHeard = udpLink.lastSent = metricsNow();
+
+    pthread_mutex_lock(&linkLock);
+    if (host) {
+        transmit(UDP_FLAG_HELLO); // Answer the joiner's hello
+    }
+    pthread_mutex_unlock(&linkLock);
+
+    if (pthread_create(&udpLink.thread, NULL, runLink, NULL) != 0) {
+        perror("Link thread failed");
+        close(inbox[0]);
+        close(inbox[1]);
+        close(udpLink.stopFds[0]);
+        close(udpLink.stopFds[1]);
+        close(fd);
+        udpLink.fd = udpLink.readFd = udpLink.writeFd = udpLink.stopFds[0] = udpLink.stopFds[1] = -1;
+        return -1;
+    }
+    return udpLink.readFd;
+}
+
+// Wait on the port for a joiner's hello and link up with it
+int udpHost(int port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        perror("Bind failed");
+        close(fd);
+        return -1;
+    }
+
+    printf("Waiting for a UDP peer on port %d...\n", port);
+    while (1) {
+        unsigned char buffer[UDP_DATAGRAM_BYTES];
+        struct sockaddr_in peer;
+        socklen_t peerLength = sizeof(peer);
+        ssize_t received = recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr*)&peer, &peerLength);
+        if (received < 0 && errno != EINTR) {
+            perror("Receive failed");
+            close(fd);
+            return -1;
+        }
+        if (received >= UDP_HEADER_BYTES && (buffer[0] & UDP_FLAG_HELLO)) {
+            // From now on the socket only talks to this peer
+            if (connect(fd, (struct sockaddr*)&peer, peerLength) < 0) {
+                perror("Connection failed");
+                close(fd);
+                return -1;
+            }
+            break;
+        }
+    }
+
+    printf("Peer connected!\n");
+    readLossSetting();
+    return startLink(fd, true);
+}
+
+// Say hello to a host until it answers
+int udpJoin(const char* ip, int port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &address.sin_addr) <= 0) {
+        perror("Invalid address");
+        close(fd);
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        perror("Connection failed");
+        close(fd);
+        return -1;
+    }
+
+    printf("Connecting to UDP host at %s:%d...\n", ip, port);
+    readLossSetting();
+    udpLink.fd = fd;
+    unsigned char hello[UDP_HEADER_BYTES] = { UDP_FLAG_HELLO };
+    for (int attempt = 0; attempt < UDP_HELLO_TRIES; attempt++) {
+        sendDatagram(hello, sizeof(hello));
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, UDP_HELLO_MS) <= 0) {
+            continue;
+        }
+        // Any datagram from the host means it has us; anything it sent
+        // besides the hello is resent once the link is up
+        unsigned char buffer[UDP_DATAGRAM_BYTES];
+        if (recv(fd, buffer, sizeof(buffer), 0) >= UDP_HEADER_BYTES) {
+            printf("Connected to host!\n");
+            return startLink(fd, false);
+        }
+        // A refusal means the host is not listening yet; keep trying
+        usleep(UDP_HELLO_MS * 1000);
+    }
+
+    fprintf(stderr, "Connection failed: no answer from %s:%d\n", ip, port);
+    udpLink.fd = -1;
+    close(fd);
+    return -1;
+}
+
+bool udpIsLink(int fd) {
+    return fd >= 0 && fd == udpLink.readFd;
+}
+
+// Queue a record and send it straight away; fails once the peer is gone or
+// has stopped acking
+int udpSendRecord(const Record* record) {
+    unsigned char encoded[RECORD_MAX_BYTES];
+    int length = (int)encodeRecord(record, encoded);
+
+    pthread_mutex_lock(&linkLock);
+    if (udpLink.closed || udpLink.windowCount == UDP_MAX_RECORDS) {
+        pthread_mutex_unlock(&linkLock);
+        return -1;
+    }
+    Outgoing* outgoing = &udpLink.window[udpLink.windowCount++];
+    outgoing->record = *record;
+    outgoing->transmissions = 0;
+    outgoing->reliable = record->type != RECORD_INPUT || record->dice != 0 || record->action == ACTION_QUIT;
+    if (outgoing->reliable && udpLink.resendAt == 0) {
+        udpLink.resendDelay = UDP_RESEND_MS * MS;
+        udpLink.resendAt = metricsNow() + udpLink.resendDelay;
+    }
+    transmit(0);
+    pthread_mutex_unlock(&linkLock);
+    return length;
+}
+
+// Wait for the next record in order; returns 0 once the peer has gone
+int udpReceiveRecord(Record* record) {
+    unsigned char byte;
+    ssize_t received;
+    while ((received = read(udpLink.readFd, &byte, 1)) < 0 && errno == EINTR) {
+    }
+    if (received <= 0) {
+        if (received < 0) {
+            perror("Receive failed");
+        }
+        return received;
+    }
+
+    pthread_mutex_lock(&linkLock);
+    *record = udpLink.inbox[udpLink.inboxHead];
+    udpLink.inboxHead = (udpLink.inboxHead + 1) % UDP_INBOX_RECORDS;
+    udpLink.inboxCount--;
+    pthread_mutex_unlock(&linkLock);
+
+    unsigned char encoded[RECORD_MAX_BYTES];
+    return (int)encodeRecord(record, encoded);
+}
+
+// Most resends the link has made in a row before the peer acked anything
+// new, as a measure of how hard loss has hit it
+int udpLongestResendRun(void) {
+    pthread_mutex_lock(&linkLock);
+    int run = udpLink.longestResendRun;
+    pthread_mutex_unlock(&linkLock);
+    return run;
+}
+
+// Say goodbye, stop the link thread and release everything
+void udpClose(void) {
+    if (udpLink.fd < 0) {
+        return;
+    }
+    pthread_mutex_lock(&linkLock);
+    if (!udpLink.closed) {
+        for (int i = 0; i < UDP_CLOSE_REPEATS; i++) {
+            transmit(UDP_FLAG_CLOSE);
+        }
+    }
+    pthread_mutex_unlock(&linkLock);
+
+    unsigned char byte = 0;
+    if (write(udpLink.stopFds[1], &byte, 1) < 0) {
+        perror("Link pipe write failed");
+    }
+    pthread_join(udpLink.thread, NULL);
+
+    markClosed();
+    close(udpLink.readFd);
+    close(udpLink.stopFds[0]);
+    close(udpLink.stopFds[1]);
+    close(udpLink.fd);
+    udpLink.fd = udpLink.readFd = udpLink.stopFds[0] = udpLink.stopFds[1] = -1;
+}
@@ -0,0 +1,43 @@
+#ifndef UDP_H
+#define UDP_H
+
+#include "network.h"
+
+// Lockstep records over UDP. Every record gets a sequence number, and every
+// datagram carries the receiver's next expected number as an ack plus all
+// of the sender's records not yet acked, so a newer datagram supersedes any
+// older one that was lost. Moves within a turn are never resent on their
+// own: the next datagram delivers them. Records the peer must get (turn
+// ends, hashes, seeds and quits) are resent on a backing-off timer until
+// acked. An idle link exchanges a datagram every UDP_PING_MS, and a peer
+// silent for UDP_TIMEOUT_MS is given up on, like the TCP keepalive.
+//
+//   datagram: u8 flags, u32 ack, u32 first sequence, u8 count, count records
+//
+// Records are encoded as on TCP. A thread runs the link so acks and resends
+// go out while the game waits on a key; the game reads records through a
+// pipe that is readable whenever one has arrived and at end of file once the
+// peer has gone, so it can poll the link like a TCP socket. There is one
+// link per process.
+
+#define UDP_MAX_RECORDS 64          // Unacked records a datagram can carry
+#define UDP_INBOX_RECORDS 256       // Received records not yet read by the game
+#define UDP_RESEND_MS 40            // First resend of a record the peer must get
+#define UDP_MAX_RESEND_MS 1000      // Resends back off up to this
+#define UDP_PING_MS 250             // Longest a link stays quiet; also carries lost moves
+#define UDP_TIMEOUT_MS 8000
+#define UDP_HELLO_MS 200            // A joining peer says hello this often...
+#define UDP_HELLO_TRIES 25          // ...until the host answers or this many tries pass
+#define UDP_CLOSE_REPEATS 3         // Goodbyes sent on close, as any of them may be lost
+#define UDP_LOSS_ENV "DEJA_UDP_LOSS" // Percentage of outgoing datagrams to drop, for testing
+
+// Function declarations for the UDP link
+int udpHost(int port);
+int udpJoin(const char* ip, int port);
+bool udpIsLink(int fd);
+int udpSendRecord(const Record* record);
+int udpReceiveRecord(Record* record);
+int udpLongestResendRun(void);
+void udpClose(void);
+
+#endif // UDP_H